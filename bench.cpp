@@ -0,0 +1,489 @@
+// bench.cpp: Microbenchmark harness for the library engine
+// Builds the engine from main.cpp without its menus, generates a synthetic dataset in a scratch
+// directory and prints one JSON document with the timing of every benchmark.
+//
+// Usage: library_bench [--books N] [--students N] [--faculty N] [--loans N] [--reservations N]
+//                      [--history N] [--iterations N] [--seed N] [--dir PATH]
+#define LIBRARY_NO_MAIN
+#include "main.cpp"
+#include "datagen.h"
+
+// BenchResult: Timing of one benchmark
+struct BenchResult {
+    string name;
+    size_t iterations;
+    double total_ms;
+    double ns_per_op;
+};
+
+vector<BenchResult> bench_results;
+
+// Function to time f(i) for i in [0, iterations) and record the result
+template <typename F>
+void runBench(const string& name, size_t iterations, F f) {
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i++) {
+        f(i);
+    }
+    double ns = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+    bench_results.push_back({name, iterations, ns / 1e6, iterations ? ns / iterations : 0});
+}
+
+// Function to stop the optimizer from discarding a benchmarked result
+template <typename T>
+void keepResult(const T& value) {
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+// Function to write a roster file of count students with ids starting at first_id
+void writeRoster(const string& path, size_t count, int first_id) {
+    string out = "role,user_id,name,email,phone,roll_number\n";
+    for (size_t i = 0; i < count; i++) {
+        int id = first_id + i;
+        out += "Student,"; appendNumber(out, id);
+        out += ",Enrolled "; appendNumber(out, id);
+        out += ",enrolled"; appendNumber(out, id);
+        out += "@example.com,"; appendNumber(out, 7000000000LL + id);
+        out += ','; appendNumber(out, 250000 + i); out += '\n';
+    }
+    writeBuffer(path, out);
+}
+
+// Function to write a CSV of count new books with ids starting at first_id
+void writeAcquisitions(const string& path, size_t count, int first_id) {
+    string out = "book_id,title,author,publisher,isbn,year\n";
+    for (size_t i = 0; i < count; i++) {
+        int id = first_id + i;
+        out += to_string(id) + ",\"Acquisition " + to_string(id / 2) + ", Vol. 1\",Author " + to_string(i % 977) + ",Publisher " + to_string(i % 113) + ",979" + to_string(1000000000LL + id / 2) + "," + to_string(1980 + i % 40) + "\n";
+    }
+    writeBuffer(path, out);
+}
+
+// The validators as they were before the character table, kept as the reference for the differential check
+bool referenceIsValidEmail(const string& email) {
+    size_t atPos = email.find('@');
+    size_t dotPos = email.find('.');
+    return atPos != string::npos && dotPos != string::npos &&
+           atPos > 0 && dotPos > atPos + 1 && dotPos < email.length() - 1;
+}
+
+bool referenceIsValidPhone(const string& phone) {
+    if (phone.length() != 10) return false;
+    return all_of(phone.begin(), phone.end(), [](unsigned char c) { return isdigit(c); });
+}
+
+bool referenceIsNumeric(const string& str) {
+    return all_of(str.begin(), str.end(), [](unsigned char c) { return isdigit(c); });
+}
+
+// Function to count the inputs on which a table-driven validator disagrees with its reference
+size_t validatorMismatches(const string& input) {
+    size_t mismatches = 0;
+    if (isValidEmail(input) != referenceIsValidEmail(input)) mismatches++;
+    if (isValidPhone(input) != referenceIsValidPhone(input)) mismatches++;
+    if (isNumeric(input) != referenceIsNumeric(input)) mismatches++;
+    int value = -1;
+    bool parsed = parseNumber(input, value);
+    bool expected = !input.empty() && referenceIsNumeric(input) && input.size() <= 9;
+    if (parsed != expected || (parsed && value != stoi(input))) mismatches++;
+    return mismatches;
+}
+
+int main(int argc, char* argv[]) {
+    DatasetConfig config;
+    size_t iterations = 100000;
+    string directory = (filesystem::temp_directory_path() / "library_bench").string();
+    for (int i = 1; i + 1 < argc; i += 2) {
+        string option = argv[i];
+        unsigned long long value = strtoull(argv[i + 1], nullptr, 10);
+        if (option == "--books") config.books = value;
+        else if (option == "--students") config.students = value;
+        else if (option == "--faculty") config.faculty = value;
+        else if (option == "--loans") config.loans = value;
+        else if (option == "--reservations") config.reservations = value;
+        else if (option == "--history") config.history = value;
+        else if (option == "--iterations") iterations = value;
+        else if (option == "--seed") config.seed = value;
+        else if (option == "--dir") directory = argv[i + 1];
+        else {
+            cerr << "Unknown option " << option << endl;
+            return 1;
+        }
+    }
+
+    // Library functions report to cout; benchmarks run with it pointed at /dev/null
+    ostream json(cout.rdbuf());
+    ofstream devnull("/dev/null");
+    cout.rdbuf(devnull.rdbuf());
+
+    filesystem::remove_all(directory);
+    auto generate_start = chrono::steady_clock::now();
+    writeDataset(config, directory);
+    double generate_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - generate_start).count();
+    filesystem::current_path(directory);
+    loadLibraryData();
+
+    // Validators
+    const string emails[] = {"student123@example.com", "not-an-email", "a.b@example.com", "prof.meera@iitk.ac.in"};
+    const string phones[] = {"9876543210", "98765-4321", "12345", "0000000000"};
+    runBench("isValidEmail", iterations, [&](size_t i) { keepResult(isValidEmail(emails[i & 3])); });
+    runBench("isValidPhone", iterations, [&](size_t i) { keepResult(isValidPhone(phones[i & 3])); });
+    runBench("isNumeric", iterations, [&](size_t i) { keepResult(isNumeric(phones[i & 3])); });
+    // Differential check against the previous validators: edge cases, then random strings over an alphabet of
+    // the characters the validators care about plus bytes above 127; any disagreement fails the run
+    size_t validator_mismatches = 0;
+    for (const string& input : {string(), string("@"), string("."), string("@."), string("a@.b"), string("a@b."), string("a@b.c"), string(".@a.b"),
+                                string("0123456789"), string("012345678"), string("000000000"), string("999999999"), string("1234567890"),
+                                string("12345\xff" "7890"), string("\xb9\xb2"), string(" 123"), string("+12"), string("-1"), string("12|3")}) {
+        validator_mismatches += validatorMismatches(input);
+    }
+    for (const string& email : emails) validator_mismatches += validatorMismatches(email);
+    for (const string& phone : phones) validator_mismatches += validatorMismatches(phone);
+    DataRandom validator_rng(config.seed);
+    const char alphabet[] = "0123456789@.a-| \xff\xb9";
+    string input;
+    for (size_t i = 0; i < iterations * 10; i++) {
+        input.resize(validator_rng.below(14));
+        for (char& c : input) c = alphabet[validator_rng.below(sizeof(alphabet) - 1)];
+        validator_mismatches += validatorMismatches(input);
+    }
+    if (validator_mismatches) {
+        cerr << validator_mismatches << " validator results differ from the previous implementations" << endl;
+        return 1;
+    }
+
+    // Cost of timing one operation with the metrics surface
+    runBench("scopedMetric_overhead", iterations, [&](size_t) { ScopedMetric metric(MetricOp::Search); });
+    tracer.start("/dev/null", 0);
+    runBench("scopedMetric_traced_every_op", iterations, [&](size_t) { ScopedMetric metric(MetricOp::Search); });
+    tracer.stop();
+
+    // Catalog lookups and updates
+    DataRandom rng(config.seed);
+    size_t book_count = max<size_t>(1, config.books);
+    runBench("getBook", iterations, [&](size_t) { keepResult(getBook(1 + rng.below(book_count))); });
+    int scratch_id = config.books + 1000000;
+    Work scratch_work("Benchmark Title", "Benchmark Author", "Benchmark Press", "9790000000001", 2020);
+    runBench("addBook_removeBook", iterations, [&](size_t) {
+        addBook(scratch_id, scratch_work);
+        removeBook(scratch_id);
+    });
+
+    // Circulation on books 1..books/10, which the generator never lends out
+    int bench_user = 2 + config.students + config.faculty + 1000;
+    addstudent(new Student(bench_user, "Bench Student", "bench@example.com", "1234567890", 1));
+    Student* student = getStudent(bench_user);
+    int loanable = max<size_t>(1, config.books / 10);
+    // Consecutive ids are copies of one title and a user may hold one copy of a title, so loans held
+    // together are taken a title apart
+    int copies = max<size_t>(1, config.copies_per_title);
+    int loanable_titles = max(1, loanable / copies);
+    auto titleCopy = [copies](int title) { return 1 + title * copies; };
+    runBench("borrow_return_round_trip", iterations, [&](size_t i) {
+        int book_id = 1 + i % loanable;
+        student->borrowBook(book_id);
+        student->returnBook(book_id);
+    });
+    for (int title = 0; title < 3 && title < loanable_titles; title++) {
+        student->borrowBook(titleCopy(title));
+    }
+    runBench("check_fine_3_loans", iterations, [&](size_t) { keepResult(student->check_fine()); });
+    // The same with twenty years of closures (every Sunday plus ten holidays a year) around today
+    vector<long long> closed;
+    long long today = dayOf(getCurrentTime());
+    for (long long day = today - 3650; day < today + 3650; day++) {
+        if ((day + 4) % 7 == 0 || day % 37 == 0) closed.push_back(day);
+    }
+    calendar.build(closed);
+    runBench("check_fine_3_loans_20y_closures", iterations, [&](size_t) { keepResult(student->check_fine()); });
+    runBench("dueDay_20y_closures", iterations, [&](size_t i) { keepResult(calendar.dueDay(getCurrentTime() - (i % 1000) * 86400LL, 15)); });
+    // The due date and the fine must agree: a loan is not late on its due day and one day late on the next,
+    // whatever the time of day it was borrowed, with and without closures
+    size_t due_mismatches = 0;
+    for (int pass = 0; pass < 2; pass++) {
+        for (size_t i = 0; i < 5000; i++) {
+            long long borrowed = getCurrentTime() - (long long)(i * 7919 % 200) * 86400 - (long long)(i * 104729 % 86400);
+            for (int period : {15, 60}) {
+                long long due = calendar.dueDay(borrowed, period);
+                if (calendar.daysLate(borrowed, due * 86400 + 86399, period) != 0 || calendar.daysLate(borrowed, (due + 1) * 86400, period) != 1) due_mismatches++;
+            }
+        }
+        calendar.clear();
+    }
+    if (due_mismatches) {
+        cerr << due_mismatches << " loans are late on their due day or not late the day after" << endl;
+        return 1;
+    }
+    for (int title = 0; title < 3 && title < loanable_titles; title++) {
+        student->returnBook(titleCopy(title));
+    }
+
+    // Three books per transaction against three single round trips; a refused checkout (the fourth book
+    // over the limit) must leave nothing issued
+    size_t batch_failures = 0;
+    runBench("checkout_return_3_single", iterations, [&](size_t i) {
+        int first = (i * 3) % max(1, loanable_titles - 2);
+        for (int k = 0; k < 3; k++) student->borrowBook(titleCopy(first + k));
+        for (int k = 0; k < 3; k++) student->returnBook(titleCopy(first + k));
+    });
+    runBench("checkout_return_3_batch", iterations, [&](size_t i) {
+        int first = (i * 3) % max(1, loanable_titles - 2);
+        vector<int> ids = {titleCopy(first), titleCopy(first + 1), titleCopy(first + 2)};
+        if (student->checkoutBooks(ids).size() != 3 || !student->returnBooks(ids)) batch_failures++;
+    });
+    if (loanable_titles >= 4 && (!student->checkoutBooks({titleCopy(0), titleCopy(1), titleCopy(2), titleCopy(3)}).empty() || student->hasBorrowedBooks())) batch_failures++;
+    // Two copies of one title, or a title already on loan, must be refused as well
+    if (copies >= 2 && (!student->checkoutBooks({titleCopy(0), titleCopy(0) + 1}).empty() || student->hasBorrowedBooks())) batch_failures++;
+    student->borrowBook(titleCopy(0));
+    if (!student->checkoutBooks({titleCopy(0)}).empty() || !student->checkoutBooks({titleCopy(0) + copies - 1}).empty()) batch_failures++;
+    student->returnBook(titleCopy(0));
+    if (batch_failures) {
+        cerr << "Batch checkout failed " << batch_failures << " times" << endl;
+        return 1;
+    }
+
+    // Reports on catalog versions during a borrow/return storm: a reader thread sweeps fines from pinned
+    // versions while the round trips run. Every version must be self-consistent (the accounts count
+    // exactly the copies out on loan); the storm's throughput and the number of sweeps are reported.
+    atomic<bool> storm_running{true};
+    size_t sweeps = 0, inconsistent = 0;
+    auto storm_start = chrono::steady_clock::now();
+    thread reporter([&] {
+        while (storm_running.load(memory_order_relaxed)) {
+            VersionView view;
+            FinesReport report = computeFines(*view.version, getCurrentTime());
+            if (report.loans != report.account_loans) inconsistent++;
+            sweeps++;
+        }
+    });
+    runBench("borrow_return_during_fines_sweeps", iterations, [&](size_t i) {
+        int book_id = 1 + i % loanable;
+        student->borrowBook(book_id);
+        student->returnBook(book_id);
+    });
+    storm_running = false;
+    reporter.join();
+    double storm_ns = chrono::duration<double, nano>(chrono::steady_clock::now() - storm_start).count();
+    bench_results.push_back({"fines_sweep_during_storm", sweeps, storm_ns / 1e6, sweeps ? storm_ns / sweeps : 0});
+    if (inconsistent) {
+        cerr << inconsistent << " of " << sweeps << " fines sweeps saw an inconsistent catalog version" << endl;
+        return 1;
+    }
+
+    // Sharded engine: borrow/return round trips with one client thread per shard, from 1 shard up to the
+    // hardware thread count. Each client keeps WINDOW round trips in flight on its own users and books.
+    size_t hardware = min<size_t>(max(1u, thread::hardware_concurrency()), ShardedEngine::MAX_CLIENTS);
+    int engine_first_user = bench_user + 200000;  // clear of the enrolment roster below
+    for (size_t i = 0; i < hardware * ShardedEngine::WINDOW; i++) {
+        int id = engine_first_user + i;
+        addstudent(new Student(id, "Engine Student " + to_string(id), "engine@example.com", "1234567890", id));
+    }
+    size_t engine_failures = 0;
+    for (size_t shards = 1; shards <= hardware; shards = shards < hardware && shards * 2 > hardware ? hardware : shards * 2) {
+        ShardedEngine engine;
+        engine.start(shards, shards);
+        size_t pairs = shards * ShardedEngine::WINDOW;
+        size_t per_client = max<size_t>(ShardedEngine::WINDOW, iterations / shards);
+        atomic<size_t> failures{0};
+        runBench("sharded_borrow_return_shards_" + to_string(shards), 1, [&](size_t) {
+            vector<thread> clients;
+            for (size_t c = 0; c < shards; c++) {
+                clients.emplace_back([&, c] {
+                    EngineClient client(engine, c);
+                    vector<int> book(ShardedEngine::WINDOW);
+                    vector<bool> returning(ShardedEngine::WINDOW, false);
+                    size_t issued = 0, done = 0;
+                    auto user = [&](size_t k) { return engine_first_user + int(c * ShardedEngine::WINDOW + k); };
+                    for (size_t k = 0; k < ShardedEngine::WINDOW; k++) {
+                        book[k] = 1 + (c * ShardedEngine::WINDOW + k) % loanable;
+                        client.submit(EngineOp::Borrow, user(k), book[k], k);
+                        issued++;
+                    }
+                    Backoff backoff;
+                    while (client.in_flight > 0) {
+                        size_t received = client.poll([&](const EngineReply& reply) {
+                            size_t k = reply.cookie;
+                            if (reply.status != EngineStatus::Ok) failures++;
+                            if (!returning[k] && reply.status == EngineStatus::Ok) {
+                                returning[k] = true;
+                                client.submit(EngineOp::Return, user(k), book[k], k);
+                                return;
+                            }
+                            returning[k] = false;
+                            done++;
+                            book[k] = 1 + (book[k] - 1 + pairs) % loanable;
+                            if (issued < per_client) {
+                                client.submit(EngineOp::Borrow, user(k), book[k], k);
+                                issued++;
+                            }
+                        });
+                        if (!received) backoff.idle();
+                        else backoff.polls = 0;
+                    }
+                });
+            }
+            for (thread& client : clients) client.join();
+        });
+        engine.stop();
+        bench_results.back().iterations = per_client * shards;
+        bench_results.back().ns_per_op = bench_results.back().total_ms * 1e6 / (per_client * shards);
+        engine_failures += failures;
+    }
+    // Reservations pass the coordinator: an unknown user and the copy's own borrower are refused; so is a
+    // borrow of a second copy of a held title
+    {
+        ShardedEngine engine;
+        engine.start(2, 1);
+        EngineClient client(engine, 0);
+        int holder = engine_first_user, other = engine_first_user + 1, book_id = titleCopy(0);
+        if (client.call(EngineOp::Reserve, -7, book_id) != EngineStatus::UnknownUser) engine_failures++;
+        if (client.call(EngineOp::Borrow, holder, book_id) != EngineStatus::Ok) engine_failures++;
+        if (client.call(EngineOp::Reserve, holder, book_id) != EngineStatus::AlreadyBorrowed) engine_failures++;
+        if (client.call(EngineOp::Reserve, other, book_id) != EngineStatus::Ok) engine_failures++;
+        // A second copy of a title the user already holds is refused, as borrowBook() does
+        if (copies >= 2 && client.call(EngineOp::Borrow, holder, book_id + 1) != EngineStatus::AlreadyBorrowed) engine_failures++;
+        if (client.call(EngineOp::Return, holder, book_id) != EngineStatus::Ok) engine_failures++;
+        engine.stop();
+        if (!getStudent(other)->User::cancelReservation(book_id)) engine_failures++;
+    }
+    if (engine_failures) {
+        cerr << engine_failures << " sharded engine operations failed" << endl;
+        return 1;
+    }
+
+    // Catalog queries
+    runBench("availability_count", iterations, [&](size_t) { keepResult(library.availableCount()); });
+    runBench("displayAvailabilityCount_devnull", iterations, [&](size_t) { library.displayAvailabilityCount(); });
+    CatalogQuery query;
+    query.publisher = "Publisher 7";
+    query.year_min = 2000;
+    query.status = "Available";
+    runBench("queryCatalog_publisher_year_status", max<size_t>(1, iterations / 100), [&](size_t) { keepResult(queryCatalog(query)); });
+    runBench("displayAllBooks_devnull", 3, [&](size_t) { library.displayAllBooks(); });
+    runBench("circulation_report", 1, [&](size_t) { keepResult(computeCirculationStats()); });
+
+    // Persistence: every table is saved, then the whole library is reloaded table by table
+    runBench("saveBooks", 1, [&](size_t) { saveBooks(); });
+    runBench("saveStudents", 1, [&](size_t) { saveStudents(); });
+    runBench("saveFaculties", 1, [&](size_t) { saveFaculties(); });
+    runBench("saveLibrarians", 1, [&](size_t) { saveLibrarians(); });
+    runBench("savecurrentlyborrowed", 1, [&](size_t) { savecurrentlyborrowed(); });
+    runBench("saveBorrowingHistory", 1, [&](size_t) { saveBorrowingHistory(); });
+    runBench("saveReservedBooks", 1, [&](size_t) { saveReservedBooks(); });
+    // A fine ledger of 10 rows per iteration: charges and the payments that settle them, over the last year
+    for (size_t i = 0; i < iterations * 5; i++) {
+        int user_id = 2 + rng.below(max<size_t>(1, config.students));
+        long long time = getCurrentTime() - rng.below(365 * 86400LL);
+        long long amount = 10 * (1 + (long long)rng.below(30));
+        fine_ledger.record({user_id, int(1 + rng.below(book_count)), time, amount});
+        fine_ledger.record({user_id, -1, time + 86400, -amount});
+    }
+    runBench("saveFineLedger", 1, [&](size_t) { saveFineLedger(); });
+    size_t ledger_mismatches = 0;
+    runBench("fine_ledger_report", 1, [&](size_t) { ledger_mismatches = runFineLedgerReport(); });
+    if (ledger_mismatches) {
+        cerr << ledger_mismatches << " accounts disagree with the fine ledger" << endl;
+        return 1;
+    }
+    runBench("verifyTableFile_books", 1, [&](size_t) { keepResult(verifyTableFile("books.txt")); });
+
+    // Background persistence: the foreground pause is the snapshot copy, the write runs on the worker.
+    // Round trips keep running during the write; their count and mean latency are reported.
+    runBench("takeSnapshot_pause", 10, [&](size_t) { keepResult(takeSnapshot()); });
+    size_t foreground_ops = 0;
+    runBench("borrow_return_during_background_save", 1, [&](size_t) {
+        persistence.submit(takeSnapshot());
+        while (!persistence.isIdle()) {
+            int book_id = 1 + foreground_ops++ % loanable;
+            student->borrowBook(book_id);
+            student->returnBook(book_id);
+        }
+    });
+    bench_results.back().iterations = foreground_ops;
+    bench_results.back().ns_per_op = foreground_ops ? bench_results.back().total_ms * 1e6 / foreground_ops : 0;
+    persistence.stop();
+    library.clear();
+    runBench("loadBooks", 1, [&](size_t) { loadBooks(); });
+    runBench("loadStudents", 1, [&](size_t) { loadStudents(); });
+    runBench("loadFaculties", 1, [&](size_t) { loadFaculties(); });
+    runBench("loadLibrarians", 1, [&](size_t) { loadLibrarians(); });
+    runBench("loadcurrentlyborrowed", 1, [&](size_t) { loadcurrentlyborrowed(); });
+    runBench("loadBorrowingHistory", 1, [&](size_t) { loadBorrowingHistory(); });
+    runBench("loadReservedBooks", 1, [&](size_t) { loadReservedBooks(); });
+    runBench("loadFineLedger", 1, [&](size_t) { loadFineLedger(); });
+
+    // Integrity check of the reloaded tables against each other and the history and ledger segments; any error fails the run
+    IntegrityChecker checker;
+    runBench("integrity_check", 1, [&](size_t) { checker.run(); });
+    if (checker.errors() != 0) {
+        checker.print(cerr);
+        return 1;
+    }
+
+    // Storage backends: the whole library saved and reloaded in memory (no disk I/O), then through the journal
+    for (const char* backend : {"memory", "journal"}) {
+        selectStorage(backend);
+        runBench(string("saveLibraryData_") + backend, 1, [&](size_t) { saveLibraryData(); });
+        runBench(string("loadLibraryData_") + backend, 1, [&](size_t) { loadLibraryData(); });
+    }
+    selectStorage("text");
+
+    // Bulk paths
+    writeRoster("bench_roster.csv", 100000, bench_user + 1);
+    runBench("enrolUsers_100k_roster", 1, [&](size_t) { enrolUsers("bench_roster.csv", "bench_enrol_errors.txt"); });
+    writeAcquisitions("bench_books.csv", 100000, scratch_id + 1);
+    runBench("importBooks_100k_rows", 1, [&](size_t) { importBooks("bench_books.csv", "bench_import_errors.txt"); });
+
+    // A simulated semester on the loaded library, 20 events per iteration; the run fails on any broken invariant
+    SemesterSimulator simulator;
+    simulator.start_time = getCurrentTime();
+    simulator.days = 60;
+    simulator.target_events = iterations * 20;
+    simulator.seed = config.seed;
+    runBench("semester_simulation", 1, [&](size_t) { simulator.run(); });
+    bench_results.back().iterations = simulator.events;
+    bench_results.back().ns_per_op = simulator.events ? bench_results.back().total_ms * 1e6 / simulator.events : 0;
+    if (!simulator.problems.empty()) {
+        for (const string& problem : simulator.problems) cerr << problem << endl;
+        return 1;
+    }
+
+    // Session replay: a shorter semester is recorded, the library is reloaded as it was before it and the log is
+    // replayed on one thread; the run fails if any operation ends differently than it did when recorded
+    selectStorage("memory");
+    saveLibraryData();
+    SemesterSimulator recorded_semester;
+    recorded_semester.start_time = getCurrentTime();
+    recorded_semester.days = 30;
+    recorded_semester.target_events = iterations * 5;
+    recorded_semester.seed = config.seed + 1;
+    session_recorder.start("bench_session.log");
+    runBench("semester_simulation_recorded", 1, [&](size_t) { recorded_semester.run(); });
+    bench_results.back().iterations = recorded_semester.events;
+    bench_results.back().ns_per_op = recorded_semester.events ? bench_results.back().total_ms * 1e6 / recorded_semester.events : 0;
+    session_recorder.stop();
+    loadLibraryData();
+    SessionReplayer replayer;
+    replayer.load("bench_session.log");
+    runBench("session_replay", 1, [&](size_t) { replayer.run(); });
+    bench_results.back().iterations = replayer.records.size();
+    bench_results.back().ns_per_op = replayer.records.empty() ? 0 : bench_results.back().total_ms * 1e6 / replayer.records.size();
+    if (replayer.records.empty() || replayer.totalDiverged() != 0) {
+        replayer.print(cerr);
+        return 1;
+    }
+    selectStorage("text");
+
+    json << "{\n";
+    json << "  \"config\": {\"books\": " << config.books << ", \"students\": " << config.students << ", \"faculty\": " << config.faculty
+         << ", \"loans\": " << config.loans << ", \"reservations\": " << config.reservations << ", \"history\": " << config.history
+         << ", \"iterations\": " << iterations << ", \"seed\": " << config.seed << ", \"generate_ms\": " << fixed << setprecision(3) << generate_ms << "},\n";
+    json << "  \"results\": [\n";
+    for (size_t i = 0; i < bench_results.size(); i++) {
+        const BenchResult& r = bench_results[i];
+        json << "    {\"name\": \"" << r.name << "\", \"iterations\": " << r.iterations << ", \"total_ms\": " << r.total_ms << ", \"ns_per_op\": " << r.ns_per_op << "}" << (i + 1 < bench_results.size() ? "," : "") << "\n";
+    }
+    json << "  ]\n}\n";
+    cout.rdbuf(json.rdbuf());
+    return 0;
+}
@@ -0,0 +1,57 @@
+// datagen.cpp: Command-line front end for the synthetic dataset generator in datagen.h
+// Writes a complete library data directory that library_system can be started in.
+//
+// Usage: library_datagen DIR [--books N] [--copies N] [--students N] [--faculty N] [--loans N]
+//                            [--reservations N] [--reservation-density R] [--history N] [--months N]
+//                            [--zipf S] [--overdue-ratio R] [--seed N] [--now EPOCH] [--legacy-history]
+#include <iostream>
+#include <chrono>
+#include <cstdlib>
+#include "datagen.h"
+
+int main(int argc, char* argv[]) {
+    if (argc < 2 || argv[1][0] == '-') {
+        cerr << "Usage: library_datagen DIR [--books N] [--copies N] [--students N] [--faculty N] [--loans N]\n"
+             << "                           [--reservations N] [--reservation-density R] [--history N] [--months N]\n"
+             << "                           [--zipf S] [--overdue-ratio R] [--seed N] [--now EPOCH] [--legacy-history]" << endl;
+        return 1;
+    }
+    string directory = argv[1];
+    DatasetConfig config;
+    for (int i = 2; i < argc; i++) {
+        string option = argv[i];
+        if (option == "--legacy-history") {
+            config.legacy_history = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            cerr << "Missing value for " << option << endl;
+            return 1;
+        }
+        const char* value = argv[++i];
+        if (option == "--books") config.books = strtoull(value, nullptr, 10);
+        else if (option == "--copies") config.copies_per_title = strtoull(value, nullptr, 10);
+        else if (option == "--students") config.students = strtoull(value, nullptr, 10);
+        else if (option == "--faculty") config.faculty = strtoull(value, nullptr, 10);
+        else if (option == "--loans") config.loans = strtoull(value, nullptr, 10);
+        else if (option == "--reservations") config.reservations = strtoull(value, nullptr, 10);
+        else if (option == "--reservation-density") config.reservation_density = strtod(value, nullptr);
+        else if (option == "--history") config.history = strtoull(value, nullptr, 10);
+        else if (option == "--months") config.history_months = strtoull(value, nullptr, 10);
+        else if (option == "--zipf") config.zipf_exponent = strtod(value, nullptr);
+        else if (option == "--overdue-ratio") config.overdue_ratio = strtod(value, nullptr);
+        else if (option == "--seed") config.seed = strtoull(value, nullptr, 10);
+        else if (option == "--now") config.now = strtoll(value, nullptr, 10);
+        else {
+            cerr << "Unknown option " << option << endl;
+            return 1;
+        }
+    }
+
+    auto start = chrono::steady_clock::now();
+    writeDataset(config, directory);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "Wrote " << config.books << " books, " << config.students << " students, " << config.faculty << " faculty and "
+         << config.history << " history rows to " << directory << " in " << seconds << " s" << endl;
+    return 0;
+}
@@ -0,0 +1,269 @@
+// datagen.h: Synthetic dataset generator shared by the benchmark harness and library_datagen
+// Writes books.txt, students.txt, faculties.txt, librarians.txt, currently_borrowed.txt,
+// reserved_books.txt and the history/ segments (or a legacy borrowing_history.txt) in the same
+// formats the library loads. The output depends only on the configuration and the seed.
+#pragma once
+#include <string>
+#include <vector>
+#include <fstream>
+#include <filesystem>
+#include <charconv>
+#include <cstdint>
+#include <ctime>
+#include <algorithm>
+#include <cmath>
+using namespace std;
+
+// DatasetConfig: Sizes of the generated tables
+struct DatasetConfig {
+    size_t books = 100000;
+    size_t copies_per_title = 2;
+    size_t students = 10000;
+    size_t faculty = 1000;
+    size_t loans = 5000;
+    size_t reservations = 500;
+    double reservation_density = -1; // fraction of current loans with a reservation; overrides reservations when >= 0
+    size_t history = 1000000;
+    size_t history_months = 24;
+    double zipf_exponent = 0;    // book popularity skew for loans and history; 0 is uniform
+    double overdue_ratio = 0.1;  // fraction of current loans past their due date
+    uint64_t seed = 42;
+    long long now = 0;           // 0 means the current time
+    bool legacy_history = false; // write one borrowing_history.txt instead of history/ segments
+};
+
+// DataRandom: Small deterministic generator (splitmix64) so a seed gives the same files on every platform
+class DataRandom {
+public:
+    uint64_t state;
+
+    explicit DataRandom(uint64_t seed) : state(seed) {}
+
+    uint64_t next() {
+        uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+
+    // Function to get a uniform value in [0, n)
+    uint64_t below(uint64_t n) {
+        return n == 0 ? 0 : (uint64_t)(((unsigned __int128)next() * n) >> 64);
+    }
+};
+
+// ZipfSampler Class: Draws ranks 0..n-1 with probability proportional to 1 / (rank + 1)^exponent
+// Uses Vose's alias method, so each draw is O(1) after an O(n) setup.
+class ZipfSampler {
+public:
+    vector<double> probability;
+    vector<uint32_t> alias;
+
+    ZipfSampler(size_t n, double exponent) : probability(n), alias(n) {
+        if (n == 0) return;
+        vector<double> weight(n);
+        double total = 0;
+        for (size_t i = 0; i < n; i++) {
+            weight[i] = exponent == 0 ? 1.0 : 1.0 / pow(double(i + 1), exponent);
+            total += weight[i];
+        }
+        vector<uint32_t> small, large;
+        for (size_t i = 0; i < n; i++) {
+            weight[i] = weight[i] * n / total;
+            (weight[i] < 1.0 ? small : large).push_back(i);
+        }
+        while (!small.empty() && !large.empty()) {
+            uint32_t s = small.back(), l = large.back();
+            small.pop_back();
+            probability[s] = weight[s];
+            alias[s] = l;
+            weight[l] -= 1.0 - weight[s];
+            if (weight[l] < 1.0) {
+                large.pop_back();
+                small.push_back(l);
+            }
+        }
+        for (uint32_t i : large) probability[i] = 1.0;
+        for (uint32_t i : small) probability[i] = 1.0;
+    }
+
+    size_t sample(DataRandom& rng) const {
+        size_t column = rng.below(probability.size());
+        double coin = (rng.next() >> 11) * 0x1.0p-53;
+        return coin < probability[column] ? column : alias[column];
+    }
+};
+
+// Function to append an integer to a buffer without going through a stream
+inline void appendNumber(string& out, long long value) {
+    char digits[24];
+    auto result = to_chars(digits, digits + sizeof(digits), value);
+    out.append(digits, result.ptr);
+}
+
+// Function to write a buffer to a file in one call
+inline void writeBuffer(const string& path, const string& data) {
+    ofstream file(path, ios::binary | ios::trunc);
+    file.write(data.data(), data.size());
+}
+
+// DatasetUser: Generated user id with its role limits
+struct DatasetUser {
+    int user_id;
+    bool is_student;
+};
+
+// Function to write a consistent synthetic dataset into directory
+// Book ids 1..books/10 are never lent out so benchmarks can always borrow them.
+inline void writeDataset(const DatasetConfig& config, const string& directory) {
+    DataRandom rng(config.seed);
+    long long now = config.now != 0 ? config.now : (long long)time(nullptr);
+    filesystem::create_directories(config.legacy_history ? directory : directory + "/history");
+    string out;
+
+    // Users: librarian 1, students from 2, faculty after the students
+    out.clear();
+    out += "1|Mr. LibGod|libgod@example.com|9999999999|Librarian|password\n";
+    writeBuffer(directory + "/librarians.txt", out);
+    vector<DatasetUser> users;
+    users.reserve(config.students + config.faculty);
+    out.clear();
+    for (size_t i = 0; i < config.students; i++) {
+        int id = 2 + i;
+        users.push_back({id, true});
+        appendNumber(out, id);
+        out += "|Student "; appendNumber(out, id);
+        out += "|student"; appendNumber(out, id);
+        out += "@example.com|"; appendNumber(out, 1000000000LL + id);
+        out += "|Student|password\n";
+    }
+    writeBuffer(directory + "/students.txt", out);
+    out.clear();
+    for (size_t i = 0; i < config.faculty; i++) {
+        int id = 2 + config.students + i;
+        users.push_back({id, false});
+        appendNumber(out, id);
+        out += "|Prof. "; appendNumber(out, id);
+        out += "|prof"; appendNumber(out, id);
+        out += "@example.com|"; appendNumber(out, 9000000000LL + id);
+        out += "|Faculty|password\n";
+    }
+    writeBuffer(directory + "/faculties.txt", out);
+
+    // Loans and reservations are decided before books.txt so book rows carry the matching state
+    vector<int> borrower(config.books + 1, -1);
+    vector<long long> borrowed_time(config.books + 1, 0);
+    vector<int> reserver(config.books + 1, -1);
+    vector<unsigned char> loan_count(users.size(), 0);
+    size_t protected_books = max<size_t>(1, config.books / 10);
+    ZipfSampler loan_books(config.books > protected_books ? config.books - protected_books : 0, config.zipf_exponent);
+    vector<int> loaned;
+    string loans_out;
+    for (size_t i = 0; i < config.loans && !users.empty() && config.books > protected_books; i++) {
+        for (int attempt = 0; attempt < 32; attempt++) {
+            size_t u = rng.below(users.size());
+            int book_id = protected_books + 1 + loan_books.sample(rng);
+            int limit = users[u].is_student ? 3 : 5;
+            if (loan_count[u] >= limit || borrower[book_id] != -1) continue;
+            loan_count[u]++;
+            borrower[book_id] = users[u].user_id;
+            // Overdue loans started more than the loan period ago (15 days for students, 60 for faculty)
+            long long period = users[u].is_student ? 15 : 60;
+            bool overdue = rng.below(1000000) < config.overdue_ratio * 1000000;
+            long long age = overdue ? (period + 1) * 86400LL + rng.below(30 * 86400LL) : rng.below(period * 86400LL);
+            borrowed_time[book_id] = now - age;
+            loaned.push_back(book_id);
+            appendNumber(loans_out, users[u].user_id); loans_out += '|';
+            appendNumber(loans_out, book_id); loans_out += '|';
+            appendNumber(loans_out, borrowed_time[book_id]); loans_out += '\n';
+            break;
+        }
+    }
+    writeBuffer(directory + "/currently_borrowed.txt", loans_out);
+
+    string reserved_out;
+    size_t reservations = config.reservation_density >= 0 ? size_t(loaned.size() * min(1.0, config.reservation_density)) : config.reservations;
+    for (size_t i = 0, placed = 0; placed < reservations && i < reservations * 4 && !loaned.empty() && users.size() > 1; i++) {
+        int book_id = loaned[rng.below(loaned.size())];
+        if (reserver[book_id] != -1) continue;
+        int user_id = users[rng.below(users.size())].user_id;
+        if (user_id == borrower[book_id]) continue;
+        reserver[book_id] = user_id;
+        placed++;
+        appendNumber(reserved_out, user_id); reserved_out += '|';
+        appendNumber(reserved_out, book_id); reserved_out += '|';
+        appendNumber(reserved_out, now - (long long)rng.below(7 * 86400LL)); reserved_out += '\n';
+    }
+    writeBuffer(directory + "/reserved_books.txt", reserved_out);
+
+    // Books: consecutive ids share a title copies_per_title at a time
+    out.clear();
+    out.reserve(config.books * 96);
+    size_t copies = max<size_t>(1, config.copies_per_title);
+    for (size_t id = 1; id <= config.books; id++) {
+        long long work = (id - 1) / copies;
+        appendNumber(out, id);
+        out += "|Title "; appendNumber(out, work);
+        out += "|Author "; appendNumber(out, work % 20000);
+        out += "|Publisher "; appendNumber(out, work % 500);
+        out += "|978"; appendNumber(out, 1000000000LL + work);
+        out += '|'; appendNumber(out, 1950 + work % 75);
+        out += borrower[id] != -1 ? "|Borrowed|" : "|Available|";
+        appendNumber(out, borrower[id]); out += '|';
+        appendNumber(out, borrowed_time[id]); out += '|';
+        out += reserver[id] != -1 ? '1' : '0'; out += '|';
+        appendNumber(out, reserver[id]); out += '\n';
+    }
+    writeBuffer(directory + "/books.txt", out);
+
+    // History: rows spread evenly over the last history_months months, one segment file per month
+    ZipfSampler history_books(config.books, config.zipf_exponent);
+    string index_out;
+    ofstream legacy_file;
+    if (config.legacy_history) legacy_file.open(directory + "/borrowing_history.txt", ios::binary | ios::trunc);
+    vector<unsigned char> seen(users.size());
+    time_t now_t = now;
+    tm parts;
+    gmtime_r(&now_t, &parts);
+    int current = (parts.tm_year + 1900) * 12 + parts.tm_mon;
+    size_t months = max<size_t>(1, config.history_months);
+    for (size_t m = 0; m < months && !users.empty(); m++) {
+        int month = current - (months - 1) + m;
+        tm start_parts{};
+        start_parts.tm_year = month / 12 - 1900;
+        start_parts.tm_mon = month % 12;
+        start_parts.tm_mday = 1;
+        long long start = timegm(&start_parts);
+        start_parts.tm_mon += 1;
+        long long end = min<long long>(timegm(&start_parts), now);
+        size_t rows = config.history * (m + 1) / months - config.history * m / months;
+        if (rows == 0 || end <= start) continue;
+
+        char name[32];
+        snprintf(name, sizeof(name), "%04d-%02d", month / 12, month % 12 + 1);
+        fill(seen.begin(), seen.end(), 0);
+        out.clear();
+        out.reserve(rows * 44);
+        for (size_t r = 0; r < rows; r++) {
+            size_t u = rng.below(users.size());
+            long long return_time = start + (long long)rng.below(end - start);
+            appendNumber(out, users[u].user_id); out += '|';
+            appendNumber(out, config.books ? 1 + history_books.sample(rng) : 1); out += '|';
+            appendNumber(out, return_time); out += '|';
+            appendNumber(out, return_time - 86400 - (long long)rng.below(40 * 86400LL)); out += '\n';
+            if (!seen[u]) {
+                seen[u] = 1;
+                appendNumber(index_out, users[u].user_id);
+                index_out += '|';
+                index_out += name;
+                index_out += '\n';
+            }
+        }
+        if (config.legacy_history) {
+            legacy_file.write(out.data(), out.size());
+        } else {
+            writeBuffer(directory + "/history/" + name + ".txt", out);
+        }
+    }
+    if (!config.legacy_history) writeBuffer(directory + "/history/index.txt", index_out);
+}
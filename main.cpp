@@ -1,6 +1,7 @@
 #include <iostream>
 #include <vector>
 #include <unordered_map>
+#include <unordered_set>
 #include <chrono>
 #include <algorithm>
 #include <fstream>
@@ -8,1265 +9,6349 @@
 #include <string>
 #include <memory>
 #include <iomanip>
+#include <cstdint>
+#include <climits>
+#include <ctime>
+#include <map>
+#include <filesystem>
+#include <charconv>
+#include <string_view>
+#include <thread>
+#include <atomic>
+#include <array>
+#include <tuple>
+#include <mutex>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <queue>
+#include <random>
+#include <numeric>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
 using namespace std;
 
-// getCurrentTime(): Returns current time in seconds since epoch
+// Clock Class: Where the library reads the time of day
+// Every due date, fine and reservation time goes through getCurrentTime(), so installing another clock
+// (the semester simulator's ManualClock) moves the whole library through simulated time.
+class Clock {
+public:
+    virtual ~Clock() = default;
+    virtual long long now() const = 0;
+};
+
+// SystemClock Class: The wall clock, in seconds since epoch
+class SystemClock : public Clock {
+public:
+    long long now() const override {
+        return chrono::duration_cast<chrono::seconds>(chrono::system_clock::now().time_since_epoch()).count();
+    }
+};
+
+// ManualClock Class: Time that only moves when it is set or advanced
+class ManualClock : public Clock {
+public:
+    atomic<long long> current;
+
+    explicit ManualClock(long long start = 0) : current(start) {}
+
+    long long now() const override {
+        return current.load(memory_order_relaxed);
+    }
+
+    void set(long long time) {
+        current.store(time, memory_order_relaxed);
+    }
+
+    void advance(long long seconds) {
+        current.fetch_add(seconds, memory_order_relaxed);
+    }
+};
+
+SystemClock system_clock;
+Clock* library_clock = &system_clock;
+
+// getCurrentTime(): Returns current time in seconds since epoch, as told by the installed clock
 long long getCurrentTime() {
-    return chrono::duration_cast<chrono::seconds>(chrono::system_clock::now().time_since_epoch()).count();
+    return library_clock->now();
 }
 
-// isValidEmail(): Validates email format using basic checks
-bool isValidEmail(const string& email) {
-    // Basic email validation
-    size_t atPos = email.find('@');
-    size_t dotPos = email.find('.');
-    return atPos != string::npos && dotPos != string::npos && 
-           atPos > 0 && dotPos > atPos + 1 && dotPos < email.length() - 1;
+// Function to get the day number (days since 1970-01-01) of a timestamp, rounding down before 1970
+constexpr long long dayOf(long long timestamp) {
+    return timestamp >= 0 ? timestamp / 86400 : (timestamp - 86399) / 86400;
 }
 
-// Input validation functions
-bool isValidBookInput(int book_id, int year) {
-    // Basic validation for book input
-    return book_id > 0 && year > 1000 && year <= 2025;
+// Function to get the day number of a proleptic Gregorian date (days_from_civil)
+constexpr long long daysFromCivil(long long year, long long month, long long day) {
+    year -= month <= 2;
+    long long era = (year >= 0 ? year : year - 399) / 400;
+    long long yoe = year - era * 400;
+    long long doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    long long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
 }
 
-bool isValidPhone(const string& phone) {
-    // Check if phone number is 10 digits
-    if (phone.length() != 10) return false;
-    return all_of(phone.begin(), phone.end(), ::isdigit);
+// Function to format a day number as YYYY-MM-DD
+string formatDay(long long day) {
+    time_t timestamp = day * 86400;
+    tm parts;
+    gmtime_r(&timestamp, &parts);
+    char text[16];
+    strftime(text, sizeof(text), "%Y-%m-%d", &parts);
+    return text;
 }
 
-// Function to check if a string is numeric
-bool isNumeric(const string& str) {
-    return all_of(str.begin(), str.end(), ::isdigit);
-}
+static_assert(daysFromCivil(1970, 1, 1) == 0 && daysFromCivil(2000, 3, 1) == 11017 && dayOf(-1) == -1);
 
-// Book Class: Represents a book in the library with its attributes and status
-class Book {
+// ClosureCalendar Class: Days the library is closed; loan periods and fines count open days only
+// open_before[i] is the number of open days in [first_day, first_day + i) and open_days lists the open days
+// of the covered range in order, so counting the open days between two dates and finding the n-th open day
+// after a date are both two lookups however many years of closures are loaded. Days outside the range are open.
+class ClosureCalendar {
 public:
-    int book_id;
-    string title, author, publisher, isbn;
-    int year;
-    string status;
-    int borrower_id;
-    long long borrowed_time;
-    bool is_reserved;
-    int reservation_id;
+    long long first_day = 0;
+    vector<uint32_t> open_before{0};  // one entry per covered day, plus one
+    vector<uint32_t> open_days;       // offsets from first_day of the open days in the covered range
 
-    Book(int book_id, string title, string author, string publisher, string isbn, int year, string status = "Available", int borrower_id = -1, long long borrowed_time = 0, bool is_reserved = false, int reservation_id = -1) {
-        this->book_id = book_id;
-        this->title = title;
-        this->author = author;
-        this->publisher = publisher;
-        this->isbn = isbn;
-        this->year = year;
-        this->status = status;
-        this->borrower_id = borrower_id;
-        this->borrowed_time = borrowed_time;
-        this->is_reserved = is_reserved;
-        this->reservation_id = reservation_id;
+    // Function to get the number of days the tables cover
+    long long span() const {
+        return open_before.size() - 1;
     }
-};
-
-// Forward declarations
-class Library;
-class User; 
-class Student;
-class Faculty;
-class Librarian;
 
+    // Function to check whether any closure is loaded
+    bool empty() const {
+        return open_before.size() == 1;
+    }
 
-// Library Class: Central management class that handles all library operations and data
-class Library {
-private:
-    vector<Book> books;
-    unordered_map<int, Student*> students;
-    unordered_map<int, Faculty*> faculties;
-    unordered_map<int, Librarian*> librarians;
-public:
-    friend class User;
-    friend class Student;
-    friend class Faculty;
-    friend class Librarian;
+    void clear() {
+        first_day = 0;
+        open_before.assign(1, 0);
+        open_days.clear();
+    }
 
-    // Function to display book details
-    static void displayBook(const Book* book, bool show_return_time = false, long long return_time = 0) {
-        if (!book) {
-            cout << "Book not found" << endl;
-            return;
-        }
-        cout << "----------------------------------------" << endl;
-        cout << "Book ID: " << book->book_id << endl;
-        cout << "Title: " << book->title << endl;
-        cout << "Author: " << book->author << endl;
-        cout << "Publisher: " << book->publisher << endl;
-        cout << "ISBN: " << book->isbn << endl;
-        cout << "Year: " << book->year << endl;
-        cout << "Status: " << book->status << endl;
-        if (book->status == "Borrowed") {
-            cout << "Borrower ID: " << book->borrower_id << endl;
-            time_t timestamp = book->borrowed_time;
-            cout << "Borrowed on: " << ctime(&timestamp);
-        }
-        if (book->is_reserved) {
-            cout << "Reserved by: " << book->reservation_id << endl;
-        }
-        if (show_return_time) {
-            time_t timestamp = return_time;
-            cout << "Returned on: " << ctime(&timestamp);
+    // Function to build the tables from the closed day numbers
+    void build(vector<long long> closed) {
+        clear();
+        if (closed.empty()) return;
+        sort(closed.begin(), closed.end());
+        closed.erase(unique(closed.begin(), closed.end()), closed.end());
+        first_day = closed.front();
+        long long days = closed.back() - first_day + 1;
+        open_before.assign(days + 1, 0);
+        size_t next = 0;
+        for (long long i = 0; i < days; i++) {
+            bool is_closed = closed[next] == first_day + i;
+            if (is_closed) {
+                next++;
+            } else {
+                open_days.push_back(i);
+            }
+            open_before[i + 1] = open_before[i] + !is_closed;
         }
-        cout << "----------------------------------------" << endl;
     }
 
-    // Function to display all books in library
-    void displayAllBooks() const {
-        if (books.empty()) {
-            cout << "No books in library" << endl;
-            return;
-        }
-        cout << "\nAll Books in Library:" << endl;
-        for (const auto& book : books) {
-            displayBook(&book);
-        }
+    // Function to count the open days before day, counted from first_day (negative for days before it)
+    long long openBefore(long long day) const {
+        if (day <= first_day) return day - first_day;
+        if (day >= first_day + span()) return open_before.back() + (day - first_day - span());
+        return open_before[day - first_day];
     }
 
-    // Function to clear the library
-    void clear() {
-        books.clear();
-        students.clear();
-        faculties.clear();
-        librarians.clear();
+    // Function to find the open day at a position counted by openBefore(); its inverse
+    long long openDay(long long position) const {
+        if (position < 0) return first_day + position;
+        if (position < (long long)open_days.size()) return first_day + open_days[position];
+        return first_day + span() + (position - (long long)open_days.size());
     }
 
-    // Friend Functions
-    friend void addBook(const Book& book);
-    friend void addstudent(Student* user);
-    friend void addFaculty(Faculty* user);
-    friend void addLibrarian(Librarian* user);
-    friend void removeBook(int book_id);
-    friend void removeStudent(int user_id);
-    friend void removeFaculty(int user_id);
-    friend void removeLibrarian(int user_id);
-    friend void studentreserveBook(int book_id, Student* user);
-    friend void studentcancelReservation(int book_id, Student* user);
-    friend void facultyreserveBook(int book_id, Faculty* user);
-    friend void facultycancelReservation(int book_id, Faculty* user);
-    friend void saveBooks();
-    friend void loadBooks();
-    friend void saveStudents();
-    friend void loadStudents();
-    friend void saveFaculties();
-    friend void loadFaculties();
-    friend void saveLibrarians();
-    friend void loadLibrarians();
-    friend void saveBorrowingHistory();
-    friend void loadBorrowingHistory();
-    friend void loadcurrentlyborrowed();
-    friend void savecurrentlyborrowed();
-    friend Book* getBook(int book_id);
-    friend Student* getStudent(int user_id);
-    friend Faculty* getFaculty(int user_id);
-    friend Librarian* getLibrarian(int user_id);
-    friend void saveReservedBooks();
-    friend void loadReservedBooks();
-};
+    // Function to count the open days a loan has run: the calendar days after the borrowing day up to and
+    // including today, less the closures among them. Counted in day numbers, like dueDay().
+    long long loanDays(long long borrowed_time, long long now) const {
+        long long borrowed_day = dayOf(borrowed_time), today = dayOf(now);
+        if (today <= borrowed_day || empty()) return today - borrowed_day;
+        return openBefore(today + 1) - openBefore(borrowed_day + 1);
+    }
 
-Library library;
+    // Function to count the open days a loan is past its loan period; 0 or less while it is not overdue
+    long long daysLate(long long borrowed_time, long long now, int loan_period) const {
+        return loanDays(borrowed_time, now) - loan_period;
+    }
 
-// Function to add a book to the library
-void addBook(const Book& book) {
-    if (find_if(library.books.begin(), library.books.end(), [book](const Book& b) { return b.book_id == book.book_id; }) != library.books.end()) {
-        cout << "Book already exists" << endl;
-        return;
+    // Function to get the day number of the last day a loan may be kept without becoming overdue:
+    // the day before the open day that takes it past its loan period, so daysLate() is 1 on the day after it
+    long long dueDay(long long borrowed_time, int loan_period) const {
+        return openDay(openBefore(dayOf(borrowed_time) + 1) + loan_period) - 1;
     }
-    library.books.push_back(book);
-    cout << "Book added successfully" << endl;
+};
+
+ClosureCalendar calendar;
+
+// MetricOp: Operations timed by the metrics surface
+enum class MetricOp { Borrow, Return, Reserve, Search, Login, Load, Save, Count };
+
+// Function to get the label an operation is exported under
+const char* metricOpName(MetricOp op) {
+    static const char* const names[] = {"borrow", "return", "reserve", "search", "login", "load", "save"};
+    return names[static_cast<int>(op)];
 }
 
-// Function to get a book by its id
-Book* getBook(int book_id) {
-    for (auto& book : library.books) {
-        if (book.book_id == book_id) {
-            return &book;
-        }
+// LatencyHistogram: HDR-style log-linear histogram of nanosecond latencies
+// Values below 8 ns get their own bucket; above that every power of two is split into 8 linear
+// sub-buckets, so a bucket's width is at most 1/8 of its lower bound (about 12% relative error).
+// Each histogram has a single writer (its thread); readers merge with relaxed loads and never lock.
+struct LatencyHistogram {
+    static constexpr int SUB_BITS = 3;
+    static constexpr int BUCKETS = (64 - SUB_BITS + 1) << SUB_BITS;
+    array<atomic<uint64_t>, BUCKETS> buckets{};
+    atomic<uint64_t> count{0};
+    atomic<uint64_t> sum_ns{0};
+    atomic<uint64_t> max_ns{0};
+
+    static int bucketOf(uint64_t ns) {
+        if (ns < (1u << SUB_BITS)) return ns;
+        int exponent = 63 - __builtin_clzll(ns);
+        return ((exponent - SUB_BITS + 1) << SUB_BITS) + ((ns >> (exponent - SUB_BITS)) & ((1u << SUB_BITS) - 1));
     }
-    return nullptr;
-}
 
-// Function to remove a book from the library
-void removeBook(int book_id)
-{
-    // First find the book to check if it is available
-    auto it = find_if(library.books.begin(), library.books.end(), 
-                     [book_id](const Book& b) { return b.book_id == book_id; });
-    
-    if (it == library.books.end()) {
-        cout << "Book not found" << endl;
-        return;
+    // Function to get the largest value that falls in a bucket
+    static uint64_t upperBound(int bucket) {
+        if (bucket < (1 << SUB_BITS)) return bucket;
+        int exponent = (bucket >> SUB_BITS) + SUB_BITS - 1;
+        uint64_t sub = bucket & ((1 << SUB_BITS) - 1);
+        return (((1ULL << SUB_BITS) + sub + 1) << (exponent - SUB_BITS)) - 1;
     }
-    
-    // Check if the book is currently borrowed
-    if (it->status != "Available") {
-        cout << "Cannot remove book - it is currently borrowed or reserved by user " << it->borrower_id << endl;
-        return;
+
+    void record(uint64_t ns) {
+        buckets[bucketOf(ns)].fetch_add(1, memory_order_relaxed);
+        count.fetch_add(1, memory_order_relaxed);
+        sum_ns.fetch_add(ns, memory_order_relaxed);
+        if (ns > max_ns.load(memory_order_relaxed)) max_ns.store(ns, memory_order_relaxed);
     }
-    
-    // If book is available, remove it
-    library.books.erase(it);
-    cout << "Book removed successfully" << endl;
-}
+};
 
-/* 
-Account Class: Manages user's borrowed books, history, and fines
-*/
-class Account {
-public:
-    int user_id;
-    vector<int> borrowed_books;
-    unordered_map<int, long long> borrowed_time;
-    vector<pair<Book*, long long>> borrowing_history;
-    int prev_fine = 0;
-    unordered_map<int, long long> reserved_books;
+// ThreadMetrics: One thread's histograms, linked into a global list that only ever grows
+// A slot is released when its thread exits and reused by the next new thread, so the counts it
+// holds are never lost and the list stays as long as the peak number of threads.
+struct ThreadMetrics {
+    array<LatencyHistogram, static_cast<int>(MetricOp::Count)> ops;
+    atomic<bool> in_use{true};
+    ThreadMetrics* next = nullptr;
+};
 
+atomic<ThreadMetrics*> metrics_threads{nullptr};
 
-    Account(int user_id) {
-        this->user_id = user_id;
+// Function to claim a free metrics slot or link a new one, without locking
+ThreadMetrics* acquireThreadMetrics() {
+    for (ThreadMetrics* slot = metrics_threads.load(memory_order_acquire); slot; slot = slot->next) {
+        bool expected = false;
+        if (slot->in_use.compare_exchange_strong(expected, true)) return slot;
     }
+    ThreadMetrics* slot = new ThreadMetrics;
+    slot->next = metrics_threads.load(memory_order_relaxed);
+    while (!metrics_threads.compare_exchange_weak(slot->next, slot, memory_order_release, memory_order_relaxed)) {}
+    return slot;
+}
 
-    // Function to view books currently borrowed
-    void view_books() {
-        if (borrowed_books.empty()) {
-            cout << "No books currently borrowed" << endl;
-            return;
-        }
-        cout << "\nCurrently Borrowed Books:" << endl;
-        for (int book_id : borrowed_books) {
-            Book* book = getBook(book_id);
-            if (book) {
-                Library::displayBook(book);
-            }
-        }
+// Function to get the calling thread's metrics slot
+ThreadMetrics& threadMetrics() {
+    struct Holder {
+        ThreadMetrics* slot = acquireThreadMetrics();
+        ~Holder() { slot->in_use.store(false, memory_order_release); }
+    };
+    thread_local Holder holder;
+    return *holder.slot;
+}
+
+// TraceEvent: One operation that took longer than the trace threshold
+struct TraceEvent {
+    const char* name;
+    long long start_ns;  // since the trace was started
+    long long duration_ns;
+    int user_id;
+    int book_id;
+    int thread;
+};
+
+// MpscRing Class: Bounded lock-free multi-producer, single-consumer queue
+// Every slot carries a sequence number: a producer claims a position with a CAS on head and publishes
+// the slot by advancing its sequence; the consumer drains slots in order. Producers never wait: push()
+// fails when the ring is full, and the caller decides whether to drop the item or try again.
+template <typename T, size_t CAPACITY>
+class MpscRing {
+    static_assert((CAPACITY & (CAPACITY - 1)) == 0, "capacity must be a power of two");
+public:
+    struct Slot {
+        atomic<size_t> sequence;
+        T item;
+    };
+    unique_ptr<Slot[]> slots;
+    alignas(64) atomic<size_t> head{0};
+    alignas(64) size_t tail = 0;  // only touched by the consumer
+
+    MpscRing() : slots(new Slot[CAPACITY]) {
+        for (size_t i = 0; i < CAPACITY; i++) slots[i].sequence.store(i, memory_order_relaxed);
     }
 
-    // Function to view reserved books
-    void view_reserved_books() {
-        if (reserved_books.empty()) {
-            cout << "No books currently reserved" << endl;
-            return;
-        }
-        cout << "\nCurrently Reserved Books:" << endl;
-        for (const auto& pair : reserved_books) {
-            int book_id = pair.first;
-            Book* book = getBook(book_id);
-            if (book) {
-                Library::displayBook(book);
+    bool push(const T& item) {
+        size_t position = head.load(memory_order_relaxed);
+        while (true) {
+            Slot& slot = slots[position & (CAPACITY - 1)];
+            size_t sequence = slot.sequence.load(memory_order_acquire);
+            if (sequence == position) {
+                if (head.compare_exchange_weak(position, position + 1, memory_order_relaxed)) {
+                    slot.item = item;
+                    slot.sequence.store(position + 1, memory_order_release);
+                    return true;
+                }
+            } else if (sequence < position) {
+                return false;
+            } else {
+                position = head.load(memory_order_relaxed);
             }
         }
     }
 
-    // Function to cancel a reservation
-    bool cancel_reservation(int book_id) {
-        if (reserved_books.find(book_id) != reserved_books.end()) {
-            reserved_books.erase(book_id);
-            return true;
-        }
-        return false;
+    bool pop(T& item) {
+        Slot& slot = slots[tail & (CAPACITY - 1)];
+        if (slot.sequence.load(memory_order_acquire) != tail + 1) return false;
+        item = slot.item;
+        slot.sequence.store(tail + CAPACITY, memory_order_release);
+        tail++;
+        return true;
     }
+};
 
-    // Function to check fine
-    int check_fine() {
-        long long current_time = getCurrentTime();
-        int curr_fine = 0;
-        for (auto& pair : borrowed_time) {
-            long long borrow_time = pair.second;
-            if ((current_time - borrow_time) / 86400 > 15) {
-                curr_fine += 10 * ((current_time - borrow_time) / 86400 - 15);
-            }
-        }
-        return curr_fine;
+// SpscRing Class: Bounded lock-free single-producer, single-consumer queue
+// Head and tail sit on their own cache lines, so the two sides only share a line when they meet.
+template <typename T, size_t CAPACITY>
+class SpscRing {
+    static_assert((CAPACITY & (CAPACITY - 1)) == 0, "capacity must be a power of two");
+public:
+    unique_ptr<T[]> items;
+    alignas(64) atomic<size_t> head{0};  // written by the producer
+    alignas(64) atomic<size_t> tail{0};  // written by the consumer
+
+    SpscRing() : items(new T[CAPACITY]) {}
+
+    bool push(const T& item) {
+        size_t position = head.load(memory_order_relaxed);
+        if (position - tail.load(memory_order_acquire) == CAPACITY) return false;
+        items[position & (CAPACITY - 1)] = item;
+        head.store(position + 1, memory_order_release);
+        return true;
     }
 
-    // Function to pay fine
-    void pay_fine() {
-        prev_fine = 0;
-        cout << "Fine paid successfully" << endl;
+    bool pop(T& item) {
+        size_t position = tail.load(memory_order_relaxed);
+        if (position == head.load(memory_order_acquire)) return false;
+        item = items[position & (CAPACITY - 1)];
+        tail.store(position + 1, memory_order_release);
+        return true;
     }
+};
 
-    // Function to check if the user has overdue books
-    bool hasOverdue(int limit) {
-        long long current_time = getCurrentTime();
-        int flag = 0;
-        for (auto& p: borrowed_time) {
-            int book_id = p.first;
-            long long borrow_time = p.second;
-            if ((current_time - borrow_time) / 86400 > limit) {
-                Book* book = getBook(book_id);
-                int amount = (current_time - borrow_time) / 86400 - limit;
-                cout<<"Overdue book: "<<book_id<<" "<<book->title<<" by "<<amount<<"days!!"<<endl;
-                flag=1;
-            }
-        }
-        if(flag==1){
-            return true;
+// TraceRing: Queue of spans between the threads being traced and the flusher
+using TraceRing = MpscRing<TraceEvent, 1 << 16>;
+
+// Tracer Class: Trace mode; spans slower than the threshold go through the ring to a background
+// flusher that appends them to a Chrome trace-event JSON file (chrome://tracing, Perfetto).
+// Enabled with LIBRARY_TRACE=<file> and optionally LIBRARY_TRACE_THRESHOLD_US (default 1000).
+class Tracer {
+public:
+    atomic<bool> enabled{false};
+    long long threshold_ns = 1000000;
+    chrono::steady_clock::time_point origin;
+    unique_ptr<TraceRing> ring;
+    atomic<uint64_t> dropped{0};  // spans lost because the ring was full
+    ofstream file;
+    size_t written = 0;
+    thread flusher;
+    mutex wake_mutex;
+    condition_variable wake;
+    bool stopping = false;
+    atomic<int> next_thread{1};
+    atomic<int> recording{0};  // record() calls between their enabled check and their push; stop() waits for them
+
+    // Function to open the trace file and start the flusher thread
+    bool start(const string& path, long long threshold_us) {
+        file.open(path, ios::trunc);
+        if (!file) {
+            cout << "Cannot open trace file " << path << endl;
+            return false;
         }
-        return false;
+        file << "{\"traceEvents\":[";
+        ring.reset(new TraceRing);
+        dropped.store(0);
+        written = 0;
+        threshold_ns = threshold_us * 1000;
+        origin = chrono::steady_clock::now();
+        stopping = false;
+        flusher = thread([this] {
+            unique_lock<mutex> lock(wake_mutex);
+            while (!stopping) {
+                wake.wait_for(lock, chrono::milliseconds(200));
+                lock.unlock();
+                drain();
+                lock.lock();
+            }
+        });
+        enabled.store(true, memory_order_release);
+        return true;
     }
 
-    // Function to view borrowing history
-    void view_borrowing_history() {
-        if (borrowing_history.empty()) {
-            cout << "No borrowing history" << endl;
-            return;
-        }
-        cout << "\nBorrowing History:" << endl;
-        for (const auto& pair : borrowing_history) {
-            Book* book = pair.first;
-            long long return_time = pair.second;
-            Library::displayBook(book, true, return_time);
+    // Function to write every queued span to the file (flusher thread, or after it has stopped)
+    void drain() {
+        TraceEvent event;
+        while (ring->pop(event)) {
+            file << (written++ ? ",\n" : "\n") << "{\"name\":\"" << event.name << "\",\"cat\":\"library\",\"ph\":\"X\",\"ts\":"
+                 << event.start_ns / 1000 << "." << setw(3) << setfill('0') << event.start_ns % 1000 << setfill(' ')
+                 << ",\"dur\":" << event.duration_ns / 1000 << "." << setw(3) << setfill('0') << event.duration_ns % 1000 << setfill(' ')
+                 << ",\"pid\":1,\"tid\":" << event.thread << ",\"args\":{";
+            if (event.user_id != -1) file << "\"user_id\":" << event.user_id << (event.book_id != -1 ? "," : "");
+            if (event.book_id != -1) file << "\"book_id\":" << event.book_id;
+            file << "}}";
         }
+        file.flush();
     }
 
-    // Function to add a book to borrowing history
-    void add_borrowing_history(Book* book, long long return_time) {
-        borrowing_history.push_back({book, return_time});
+    // Function to queue a span if it crossed the threshold
+    // The caller checked enabled when the span began; it is checked again once this call is counted in
+    // recording, so a span still open when stop() runs is either written before the file closes or dropped.
+    void record(const char* name, chrono::steady_clock::time_point start, long long duration_ns, int user_id, int book_id) {
+        if (duration_ns < threshold_ns) return;
+        recording.fetch_add(1, memory_order_seq_cst);
+        if (enabled.load(memory_order_seq_cst)) {
+            thread_local int thread_number = next_thread.fetch_add(1);
+            if (!ring->push({name, chrono::duration_cast<chrono::nanoseconds>(start - origin).count(), duration_ns, user_id, book_id, thread_number})) {
+                dropped.fetch_add(1, memory_order_relaxed);
+            }
+        }
+        recording.fetch_sub(1, memory_order_release);
     }
 
-    // Friend Functions
-    friend void saveBorrowingHistory();
-    friend void loadBorrowingHistory();
-    friend void loadcurrentlyborrowed();
-    friend void savecurrentlyborrowed();
+    // Function to stop the flusher, write the remaining spans and close the file
+    // Spans being queued when tracing is switched off are waited for, so none lands after the last drain.
+    void stop() {
+        if (!enabled.exchange(false, memory_order_seq_cst)) return;
+        while (recording.load(memory_order_acquire) != 0) this_thread::yield();
+        {
+            lock_guard<mutex> lock(wake_mutex);
+            stopping = true;
+        }
+        wake.notify_one();
+        flusher.join();
+        drain();
+        file << "\n],\"otherData\":{\"threshold_us\":" << threshold_ns / 1000 << ",\"dropped\":" << dropped.load() << "}}\n";
+        file.close();
+    }
 };
 
+Tracer tracer;
+
+// Function to start trace mode when LIBRARY_TRACE names an output file
+void startTraceFromEnvironment() {
+    const char* path = getenv("LIBRARY_TRACE");
+    if (!path || !*path) return;
+    const char* threshold = getenv("LIBRARY_TRACE_THRESHOLD_US");
+    tracer.start(path, threshold ? atoll(threshold) : 1000);
+}
+
+// TraceSpan: Times a scope for trace mode only; costs one flag check when tracing is off
+class TraceSpan {
+    const char* name;
+    int user_id, book_id;
+    bool active;
+    chrono::steady_clock::time_point start;
+public:
+    explicit TraceSpan(const char* name, int user_id = -1, int book_id = -1)
+        : name(name), user_id(user_id), book_id(book_id), active(tracer.enabled.load(memory_order_relaxed)) {
+        if (active) start = chrono::steady_clock::now();
+    }
+    ~TraceSpan() {
+        if (!active) return;
+        tracer.record(name, start, chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count(), user_id, book_id);
+    }
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+};
+
+// ScopedMetric: Counts one operation and records its latency when it goes out of scope
+// In trace mode a slow operation is also queued as a span with its user and book ids.
+class ScopedMetric {
+    MetricOp op;
+    int user_id, book_id;
+    chrono::steady_clock::time_point start;
+public:
+    explicit ScopedMetric(MetricOp op, int user_id = -1, int book_id = -1)
+        : op(op), user_id(user_id), book_id(book_id), start(chrono::steady_clock::now()) {}
+    ~ScopedMetric() {
+        auto ns = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+        threadMetrics().ops[static_cast<int>(op)].record(ns);
+        if (tracer.enabled.load(memory_order_relaxed)) tracer.record(metricOpName(op), start, ns, user_id, book_id);
+    }
+    ScopedMetric(const ScopedMetric&) = delete;
+    ScopedMetric& operator=(const ScopedMetric&) = delete;
+};
+
+// SessionOp: Operations captured by session recording
+enum class SessionOp { Borrow, Return, Checkout, ReturnBatch, Reserve, Cancel, PayFine, Query, AddBook, RemoveBook, Count };
+
+// Function to get the label an operation is reported under
+const char* sessionOpName(SessionOp op) {
+    static const char* const names[] = {"borrow", "return", "checkout", "return-n", "reserve", "cancel", "pay", "query", "add-book", "remove-book"};
+    return names[static_cast<int>(op)];
+}
+
+// SessionRecord: One operation in a session log with what it left behind
+// before and after summarise the user's account around the operation (see User::sessionState); for a query,
+// after is the number of matches and for a catalog change whether the copy exists. text holds the book ids of
+// a batch, the query filters or the new book's fields; lent lists the copies a borrow or checkout issued.
+struct SessionRecord {
+    int op = 0;
+    long long offset_us = 0;  // since recording started
+    long long time = 0;       // library clock when the operation started
+    int user_id = -1;
+    int book_id = -1;
+    string text;
+    string lent;
+    long long before = 0;
+    long long after = 0;
+    long long fine = 0;       // the user's fine balance afterwards
+};
+
+// SessionRecorder Class: Appends every user-facing operation to a compact binary log for replay
+// Rows are buffered and written in batches; nothing is recorded unless LIBRARY_RECORD names the log file.
+class SessionRecorder {
+public:
+    atomic<bool> enabled{false};
+    mutex write_mutex;
+    ofstream file;
+    string buffer;
+    size_t records = 0;
+    chrono::steady_clock::time_point origin;
+
+    bool start(const string& path) {
+        file.open(path, ios::binary | ios::trunc);
+        if (!file) {
+            cout << "Cannot open session log " << path << endl;
+            return false;
+        }
+        buffer.clear();
+        records = 0;
+        origin = chrono::steady_clock::now();
+        enabled.store(true, memory_order_release);
+        return true;
+    }
+
+    // Function to write the buffered rows
+    void flush() {
+        file.write(buffer.data(), buffer.size());
+        file.flush();
+        buffer.clear();
+    }
+
+    // Function to stop recording, write what is buffered and close the log
+    void stop() {
+        if (!enabled.exchange(false)) return;
+        lock_guard<mutex> lock(write_mutex);
+        flush();
+        file.close();
+    }
+};
+
+SessionRecorder session_recorder;
+
+// Forward declarations: the account summaries and the encoding need the classes defined further down
+void beginSessionRecord(SessionRecord& record);
+void endSessionRecord(SessionRecord& record);
+
+// Function to start session recording when LIBRARY_RECORD names a log file
+void startRecordingFromEnvironment() {
+    const char* path = getenv("LIBRARY_RECORD");
+    if (path && *path) session_recorder.start(path);
+}
+
+// RecordedOp: Logs one operation when it goes out of scope; costs one flag check when recording is off
+// Callers fill record.text only when active, so the arguments are never formatted for nothing.
+class RecordedOp {
+public:
+    SessionRecord record;
+    bool active;
+
+    explicit RecordedOp(SessionOp op, int user_id = -1, int book_id = -1) : active(session_recorder.enabled.load(memory_order_relaxed)) {
+        if (!active) return;
+        record.op = static_cast<int>(op);
+        record.user_id = user_id;
+        record.book_id = book_id;
+        beginSessionRecord(record);
+    }
+    ~RecordedOp() {
+        finish();
+    }
+
+    // Function to log the operation now, before a nested operation that is logged on its own
+    void finish() {
+        if (!active) return;
+        active = false;
+        endSessionRecord(record);
+    }
+    RecordedOp(const RecordedOp&) = delete;
+    RecordedOp& operator=(const RecordedOp&) = delete;
+};
+
+// MetricSnapshot: Totals of one operation merged over every thread
+struct MetricSnapshot {
+    vector<uint64_t> buckets = vector<uint64_t>(LatencyHistogram::BUCKETS);
+    uint64_t count = 0, sum_ns = 0, max_ns = 0;
+
+    // Function to merge one thread's histogram into the totals
+    void add(const LatencyHistogram& h) {
+        for (int b = 0; b < LatencyHistogram::BUCKETS; b++) buckets[b] += h.buckets[b].load(memory_order_relaxed);
+        count += h.count.load(memory_order_relaxed);
+        sum_ns += h.sum_ns.load(memory_order_relaxed);
+        max_ns = max(max_ns, h.max_ns.load(memory_order_relaxed));
+    }
+
+    // Function to get the latency below which a fraction q of the operations completed
+    uint64_t quantile(double q) const {
+        uint64_t rank = max<uint64_t>(1, (uint64_t)(q * count + 0.5)), seen = 0;
+        for (int b = 0; b < LatencyHistogram::BUCKETS; b++) {
+            seen += buckets[b];
+            if (seen >= rank) return min(LatencyHistogram::upperBound(b), max_ns);
+        }
+        return max_ns;
+    }
+};
+
+// Function to merge one operation's histograms from every thread
+MetricSnapshot snapshotMetric(MetricOp op) {
+    MetricSnapshot snapshot;
+    for (ThreadMetrics* slot = metrics_threads.load(memory_order_acquire); slot; slot = slot->next) {
+        snapshot.add(slot->ops[static_cast<int>(op)]);
+    }
+    return snapshot;
+}
+
+// Function to print a table of counts and latency percentiles for every operation
+void displayMetrics() {
+    ios::fmtflags flags = cout.flags();
+    streamsize precision = cout.precision();
+    cout << "\n+-------------------------------------------+" << endl;
+    cout << "| Operation Metrics (latency in us)         |" << endl;
+    cout << "+-------------------------------------------+" << endl;
+    cout << left << setw(9) << "Op" << right << setw(9) << "Count" << setw(10) << "p50" << setw(10) << "p90"
+         << setw(10) << "p99" << setw(12) << "Max" << endl;
+    cout << fixed << setprecision(1);
+    for (int op = 0; op < static_cast<int>(MetricOp::Count); op++) {
+        MetricSnapshot s = snapshotMetric(static_cast<MetricOp>(op));
+        cout << left << setw(9) << metricOpName(static_cast<MetricOp>(op)) << right << setw(9) << s.count;
+        if (s.count == 0) {
+            cout << setw(10) << "-" << setw(10) << "-" << setw(10) << "-" << setw(12) << "-" << endl;
+            continue;
+        }
+        cout << setw(10) << s.quantile(0.5) / 1e3 << setw(10) << s.quantile(0.9) / 1e3 << setw(10) << s.quantile(0.99) / 1e3
+             << setw(12) << s.max_ns / 1e3 << endl;
+    }
+    cout.flags(flags);
+    cout.precision(precision);
+}
+
+// Function to write every metric in the Prometheus text exposition format
+// Only bucket boundaries that hold observations are listed, which keeps the histogram cumulative and short.
+void writeMetrics(ostream& out) {
+    out << "# HELP library_operations_total Operations completed, by type.\n";
+    out << "# TYPE library_operations_total counter\n";
+    vector<MetricSnapshot> snapshots;
+    for (int op = 0; op < static_cast<int>(MetricOp::Count); op++) {
+        snapshots.push_back(snapshotMetric(static_cast<MetricOp>(op)));
+        out << "library_operations_total{op=\"" << metricOpName(static_cast<MetricOp>(op)) << "\"} " << snapshots.back().count << "\n";
+    }
+    out << "# HELP library_operation_duration_seconds Latency of each operation.\n";
+    out << "# TYPE library_operation_duration_seconds histogram\n";
+    for (int op = 0; op < static_cast<int>(MetricOp::Count); op++) {
+        const MetricSnapshot& s = snapshots[op];
+        const char* name = metricOpName(static_cast<MetricOp>(op));
+        uint64_t cumulative = 0;
+        for (int b = 0; b < LatencyHistogram::BUCKETS; b++) {
+            if (s.buckets[b] == 0) continue;
+            cumulative += s.buckets[b];
+            out << "library_operation_duration_seconds_bucket{op=\"" << name << "\",le=\"" << (LatencyHistogram::upperBound(b) + 1) / 1e9 << "\"} " << cumulative << "\n";
+        }
+        out << "library_operation_duration_seconds_bucket{op=\"" << name << "\",le=\"+Inf\"} " << s.count << "\n";
+        out << "library_operation_duration_seconds_sum{op=\"" << name << "\"} " << s.sum_ns / 1e9 << "\n";
+        out << "library_operation_duration_seconds_count{op=\"" << name << "\"} " << s.count << "\n";
+    }
+}
+
+// Function to write the metrics file at exit
+void saveMetrics(const string& path) {
+    ofstream file(path, ios::trunc);
+    writeMetrics(file);
+}
+
+// Character classes used by the validators; one table lookup per character, no locale or regex involved
+enum CharClass : unsigned char { CHAR_DIGIT = 1, CHAR_AT = 2, CHAR_DOT = 4, CHAR_SEPARATOR = 8 };
+
+constexpr array<unsigned char, 256> makeCharClasses() {
+    array<unsigned char, 256> classes{};
+    for (int c = '0'; c <= '9'; c++) classes[c] = CHAR_DIGIT;
+    classes['@'] = CHAR_AT;
+    classes['.'] = CHAR_DOT;
+    classes['|'] = classes['\n'] = classes['\r'] = CHAR_SEPARATOR;
+    return classes;
+}
+
+constexpr array<unsigned char, 256> char_classes = makeCharClasses();
+
+constexpr bool isDigitChar(char c) {
+    return char_classes[(unsigned char)c] & CHAR_DIGIT;
+}
+
+// isValidEmail(): Validates email format using basic checks in a single pass
+// Valid when the first '@' is not at the start and the first '.' comes at least two characters after it
+// and is not the last character.
+constexpr bool isValidEmail(string_view email) {
+    size_t atPos = string_view::npos;
+    for (size_t i = 0; i < email.size(); i++) {
+        unsigned char cls = char_classes[(unsigned char)email[i]];
+        if ((cls & CHAR_AT) && atPos == string_view::npos) {
+            atPos = i;
+        } else if (cls & CHAR_DOT) {
+            // The first dot decides the result
+            return atPos != string_view::npos && atPos > 0 && i > atPos + 1 && i < email.size() - 1;
+        }
+    }
+    return false;
+}
+
+// toLower(): Returns a lowercase copy of a string, used for case-insensitive catalog keys
+string toLower(const string& str) {
+    string lower = str;
+    transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) { return tolower(c); });
+    return lower;
+}
+
+// Input validation functions
+constexpr bool isValidBookInput(int book_id, int year) {
+    // Basic validation for book input
+    return book_id > 0 && year > 1000 && year <= 2025;
+}
+
+constexpr bool isValidPhone(string_view phone) {
+    // Check if phone number is 10 digits
+    if (phone.length() != 10) return false;
+    for (char c : phone) {
+        if (!isDigitChar(c)) return false;
+    }
+    return true;
+}
+
+// Function to check that text can be stored in a pipe-delimited table: no '|' and no line breaks
+constexpr bool isValidTextField(string_view text) {
+    for (char c : text) {
+        if (char_classes[(unsigned char)c] & CHAR_SEPARATOR) return false;
+    }
+    return true;
+}
+
+// Function to check if a string is numeric
+constexpr bool isNumeric(string_view str) {
+    for (char c : str) {
+        if (!isDigitChar(c)) return false;
+    }
+    return true;
+}
+
+// Function to validate and parse a non-empty id or year of at most 9 digits in one pass
+constexpr bool parseNumber(string_view str, int& value) {
+    if (str.empty() || str.size() > 9) return false;
+    int result = 0;
+    for (char c : str) {
+        if (!isDigitChar(c)) return false;
+        result = result * 10 + (c - '0');
+    }
+    value = result;
+    return true;
+}
+
+// Function to parse a whitespace separated list of ids; false if any entry is not a valid id
+bool parseIdList(const string& line, vector<int>& ids) {
+    istringstream in(line);
+    string token;
+    int value;
+    while (in >> token) {
+        if (!parseNumber(token, value)) return false;
+        ids.push_back(value);
+    }
+    return true;
+}
+
+// Function to write ids as the space separated list parseIdList reads
+string joinIds(const vector<int>& ids) {
+    string line;
+    for (int id : ids) {
+        if (!line.empty()) line += ' ';
+        line += to_string(id);
+    }
+    return line;
+}
+
+static_assert(isValidEmail("libgod@example.com") && !isValidEmail("a.b@example.com") && !isValidEmail("@example.com"));
+static_assert(isValidPhone("9999999999") && !isValidPhone("99999-9999") && isNumeric("") && !isNumeric("12a"));
+static_assert(isValidTextField("Title, Vol. 1") && !isValidTextField("A|B") && !isValidTextField("A\rB"));
+
+// BookStatus: Circulation state of a physical copy
+enum class BookStatus : unsigned char { Available, Borrowed };
+
+// Function to get the name used for a status on screen and in books.txt
+const char* statusName(BookStatus status) {
+    return status == BookStatus::Borrowed ? "Borrowed" : "Available";
+}
+
+// Function to parse a status name read from books.txt
+BookStatus parseStatus(const string& status) {
+    return status == "Borrowed" ? BookStatus::Borrowed : BookStatus::Available;
+}
+
+// Work Class: Bibliographic record shared by every physical copy of a title
+class Work {
+public:
+    int work_id;
+    string title, author, publisher, isbn;
+    int year;
+    vector<int> copies;       // ids of all copies of this title
+    vector<int> free_copies;  // ids of copies that anyone may borrow right now
+
+    Work(string title, string author, string publisher, string isbn, int year, int work_id = -1) {
+        this->work_id = work_id;
+        this->title = title;
+        this->author = author;
+        this->publisher = publisher;
+        this->isbn = isbn;
+        this->year = year;
+    }
+
+    // Function to check whether another record with this ISBN describes the same title
+    bool sameDetails(const string& other_title, const string& other_author, const string& other_publisher, int other_year) const {
+        return title == other_title && author == other_author && publisher == other_publisher && year == other_year;
+    }
+
+    bool sameDetails(const Work& other) const {
+        return sameDetails(other.title, other.author, other.publisher, other.year);
+    }
+};
+
+// Book Class: Represents one physical copy of a work with its circulation state
+class Book {
+public:
+    long long borrowed_time;
+    int book_id;
+    int work_id;
+    int borrower_id;
+    int reservation_id;
+    int free_slot;  // position in the work's free list, -1 when the copy is not free
+    BookStatus status;
+    bool is_reserved;
+
+    Book(int book_id, int work_id, BookStatus status = BookStatus::Available, int borrower_id = -1, long long borrowed_time = 0, bool is_reserved = false, int reservation_id = -1) {
+        this->book_id = book_id;
+        this->work_id = work_id;
+        this->status = status;
+        this->borrower_id = borrower_id;
+        this->borrowed_time = borrowed_time;
+        this->is_reserved = is_reserved;
+        this->reservation_id = reservation_id;
+        this->free_slot = -1;
+    }
+};
+
+// Bitmap Class: Dense bit set with one bit per catalog slot, used for instant availability queries
+class Bitmap {
+public:
+    vector<uint64_t> words;
+    size_t bits = 0;
+
+    // Function to grow or shrink the bitmap; bits past the new end are cleared
+    void resize(size_t n) {
+        words.resize((n + 63) / 64, 0);
+        if (n % 64 != 0) {
+            words.back() &= (uint64_t(1) << (n % 64)) - 1;
+        }
+        bits = n;
+    }
+
+    void set(size_t i, bool value) {
+        uint64_t mask = uint64_t(1) << (i % 64);
+        if (value) {
+            words[i / 64] |= mask;
+        } else {
+            words[i / 64] &= ~mask;
+        }
+    }
+
+    bool test(size_t i) const {
+        return (words[i / 64] >> (i % 64)) & 1;
+    }
+
+    // Function to keep only the bits also set in other
+    void andWith(const Bitmap& other) {
+        for (size_t w = 0; w < words.size(); w++) {
+            words[w] &= w < other.words.size() ? other.words[w] : 0;
+        }
+    }
+
+    // Function to keep only the bits not set in other
+    void andNotWith(const Bitmap& other) {
+        for (size_t w = 0; w < words.size() && w < other.words.size(); w++) {
+            words[w] &= ~other.words[w];
+        }
+    }
+
+    // Function to set every bit
+    void fill() {
+        for (uint64_t& word : words) {
+            word = ~uint64_t(0);
+        }
+        resize(bits);
+    }
+
+    // Function to count set bits with one popcount per 64 slots
+    size_t count() const {
+        size_t total = 0;
+        for (uint64_t word : words) {
+            total += __builtin_popcountll(word);
+        }
+        return total;
+    }
+
+    // Function to call f(slot) for every set bit, skipping empty 256-bit blocks at once
+    template <typename F>
+    void forEach(F f) const {
+        size_t n = words.size();
+        size_t w = 0;
+        for (; w + 4 <= n; w += 4) {
+#ifdef __AVX2__
+            __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&words[w]));
+            if (_mm256_testz_si256(block, block)) continue;
+#else
+            if ((words[w] | words[w + 1] | words[w + 2] | words[w + 3]) == 0) continue;
+#endif
+            for (size_t k = w; k < w + 4; k++) {
+                forEachInWord(k, f);
+            }
+        }
+        for (; w < n; w++) {
+            forEachInWord(w, f);
+        }
+    }
 
-// User Class: Base class for all user types with common functionality
-class User : public Library {
 private:
-    string password = "password"; // Default password
-protected:
+    template <typename F>
+    void forEachInWord(size_t w, F& f) const {
+        uint64_t word = words[w];
+        while (word) {
+            f(w * 64 + __builtin_ctzll(word));
+            word &= word - 1;
+        }
+    }
+};
+
+// CatalogQuery: Predicates combined by a catalog search; fields left at their defaults match everything
+struct CatalogQuery {
+    int year_min = INT_MIN;
+    int year_max = INT_MAX;
+    string status;     // "Available", "Borrowed" or empty
+    string publisher;  // matched case-insensitively
+    string author;     // matched case-insensitively
+    int reserved = -1; // -1 any, 0 not reserved, 1 reserved
+
+    // Function to set the status filter; false unless value is "Available", "Borrowed" or empty
+    bool setStatus(const string& value) {
+        if (!value.empty() && value != "Available" && value != "Borrowed") return false;
+        status = value;
+        return true;
+    }
+
+    // Function to set the reservation filter; false unless value is "yes", "no" or empty
+    bool setReserved(const string& value) {
+        if (!value.empty() && value != "yes" && value != "no") return false;
+        reserved = value.empty() ? -1 : value == "yes";
+        return true;
+    }
+};
+
+// UserRecord: A user's persisted fields, copied out so they can be written without touching the live object
+struct UserRecord {
     int user_id;
-    string email, phone, role;
-    Account account;
+    string name, email, phone, role, password;
+};
+
+// LoanRecord: One (user, book, time) row of currently_borrowed.txt or reserved_books.txt
+struct LoanRecord {
+    int user_id;
+    int book_id;
+    long long time;
+};
+
+// WorkChunks: Bibliographic records copied out in fixed-size chunks that snapshots and versions share
+// Works are only ever appended, so a full chunk never changes and only the last partial chunk is copied again.
+constexpr size_t WORK_CHUNK = 4096;
+using WorkChunks = vector<shared_ptr<const vector<Work>>>;
+
+// Forward declarations
+class Library;
+class User; 
+class Student;
+class Faculty;
+class Librarian;
+struct CirculationStats;
+struct LibrarySnapshot;
+struct FineBalance;
+class IntegrityChecker;
+Work* getWork(int work_id);
+
+
+// Library Class: Central management class that handles all library operations and data
+class Library {
+private:
+    vector<Work> works;
+    vector<Book> books;
+    unordered_map<int, size_t> book_index;  // book id -> position in books
+    unordered_map<string, int> isbn_index;  // isbn -> work id
+    Bitmap available_map;  // slot is on the shelf
+    Bitmap borrowed_map;   // slot is out on loan
+    Bitmap reserved_map;   // slot is held for a user
+    vector<pair<int, int>> year_index;  // (year, work id), sorted lazily before a query
+    bool year_index_dirty = false;
+    unordered_map<string, vector<int>> publisher_postings;  // lowercase publisher -> work ids
+    unordered_map<string, vector<int>> author_postings;     // lowercase author -> work ids
+    unordered_map<int, Student*> students;
+    unordered_map<int, Faculty*> faculties;
+    unordered_map<int, Librarian*> librarians;
+    size_t works_generation = 0;  // bumped whenever works are dropped, so snapshots know their cache is stale
+public:
+    friend class User;
+    friend class Student;
+    friend class Faculty;
+    friend class Librarian;
+
+    // Function to display book details
+    static void displayBook(const Book* book, bool show_return_time = false, long long return_time = 0) {
+        if (!book) {
+            cout << "Book not found" << endl;
+            return;
+        }
+        const Work* work = getWork(book->work_id);
+        printBook(*book, *work, work->free_copies.size(), work->copies.size(), show_return_time, return_time);
+    }
+
+    // Function to print one copy with its title and how many copies of the title are free
+    static void printBook(const Book& book, const Work& work, size_t free_copies, size_t copies, bool show_return_time = false, long long return_time = 0) {
+        cout << "----------------------------------------" << endl;
+        cout << "Book ID: " << book.book_id << endl;
+        cout << "Title: " << work.title << endl;
+        cout << "Author: " << work.author << endl;
+        cout << "Publisher: " << work.publisher << endl;
+        cout << "ISBN: " << work.isbn << endl;
+        cout << "Year: " << work.year << endl;
+        cout << "Status: " << statusName(book.status) << endl;
+        if (copies > 1) {
+            cout << "Copies Available: " << free_copies << "/" << copies << endl;
+        }
+        if (book.status == BookStatus::Borrowed) {
+            cout << "Borrower ID: " << book.borrower_id << endl;
+            time_t timestamp = book.borrowed_time;
+            cout << "Borrowed on: " << ctime(&timestamp);
+        }
+        if (book.is_reserved) {
+            cout << "Reserved by: " << book.reservation_id << endl;
+        }
+        if (show_return_time) {
+            time_t timestamp = return_time;
+            cout << "Returned on: " << ctime(&timestamp);
+        }
+        cout << "----------------------------------------" << endl;
+    }
+
+    // Function to display all books in library, read from the current catalog version
+    void displayAllBooks() const;
+
+    // Function to display every copy currently on the shelf
+    void displayAvailableBooks() const {
+        if (available_map.count() == 0) {
+            cout << "No books available" << endl;
+            return;
+        }
+        cout << "\nAvailable Books in Library:" << endl;
+        available_map.forEach([this](size_t slot) { displayBook(&books[slot]); });
+    }
+
+    // Function to count the copies on the shelf with one pass over the availability bitmap
+    size_t availableCount() const {
+        return available_map.count();
+    }
+
+    // Function to display how many copies are available, borrowed and reserved
+    void displayAvailabilityCount() const {
+        cout << "Total copies: " << books.size() << endl;
+        cout << "Available: " << availableCount() << endl;
+        cout << "Borrowed: " << borrowed_map.count() << endl;
+        cout << "Reserved: " << reserved_map.count() << endl;
+    }
+
+    // Function to clear the library
+    void clear() {
+        works.clear();
+        works_generation++;
+        books.clear();
+        book_index.clear();
+        isbn_index.clear();
+        available_map.resize(0);
+        borrowed_map.resize(0);
+        reserved_map.resize(0);
+        year_index.clear();
+        year_index_dirty = false;
+        publisher_postings.clear();
+        author_postings.clear();
+        students.clear();
+        faculties.clear();
+        librarians.clear();
+    }
+
+    // Friend Functions
+    friend void addBook(int book_id, const Work& details);
+    friend void addstudent(Student* user);
+    friend void addFaculty(Faculty* user);
+    friend void addLibrarian(Librarian* user);
+    friend void removeBook(int book_id);
+    friend void removeStudent(int user_id);
+    friend void removeFaculty(int user_id);
+    friend void removeLibrarian(int user_id);
+    friend void studentreserveBook(int book_id, Student* user);
+    friend void studentcancelReservation(int book_id, Student* user);
+    friend void facultyreserveBook(int book_id, Faculty* user);
+    friend void facultycancelReservation(int book_id, Faculty* user);
+    friend void saveBooks();
+    friend void loadBooks();
+    friend void saveStudents();
+    friend void loadStudents();
+    friend void saveFaculties();
+    friend void loadFaculties();
+    friend void saveLibrarians();
+    friend void loadLibrarians();
+    friend void saveBorrowingHistory();
+    friend void loadBorrowingHistory();
+    friend void loadcurrentlyborrowed();
+    friend void savecurrentlyborrowed();
+    friend Book* getBook(int book_id);
+    friend Work* getWork(int work_id);
+    friend int findOrAddWork(const Work& details);
+    friend void insertCopy(const Book& copy);
+    friend void unlinkFreeCopy(Work& work, Book* book);
+    friend void syncBookState(Book* book);
+    friend Book* findFreeCopy(int work_id);
+    friend vector<int> queryCatalog(const CatalogQuery& query);
+    friend void runCatalogQuery(const CatalogQuery& query, bool compact);
+    friend Student* getStudent(int user_id);
+    friend Faculty* getFaculty(int user_id);
+    friend Librarian* getLibrarian(int user_id);
+    friend void saveReservedBooks();
+    friend void loadReservedBooks();
+    friend CirculationStats computeCirculationStats();
+    friend LibrarySnapshot takeSnapshot();
+    friend vector<FineBalance> fineBalances();
+    friend void loadFineLedger();
+    friend WorkChunks captureWorkChunks();
+    friend class VersionStore;
+    friend class ShardedEngine;
+    friend class SemesterSimulator;
+    friend class IntegrityChecker;
+    friend void loadLibraryData();
+    friend bool importBooks(const string& path, const string& error_path);
+    friend bool enrolUsers(const string& path, const string& error_path);
+};
+
+Library library;
+
+// Function to get a work by its id
+Work* getWork(int work_id) {
+    if (work_id < 0 || work_id >= (int)library.works.size()) {
+        return nullptr;
+    }
+    return &library.works[work_id];
+}
+
+// Function to find the work with the given ISBN, registering a new one if there is none
+int findOrAddWork(const Work& details) {
+    auto it = library.isbn_index.find(details.isbn);
+    if (it != library.isbn_index.end()) {
+        return it->second;
+    }
+    int work_id = library.works.size();
+    library.works.push_back(Work(details.title, details.author, details.publisher, details.isbn, details.year, work_id));
+    library.isbn_index[details.isbn] = work_id;
+    library.year_index.push_back({details.year, work_id});
+    library.year_index_dirty = true;
+    library.publisher_postings[toLower(details.publisher)].push_back(work_id);
+    library.author_postings[toLower(details.author)].push_back(work_id);
+    return work_id;
+}
+
+// Work chunks captured last time, reused while the catalog has not been reloaded
+WorkChunks cached_work_chunks;
+size_t cached_works_generation = 0;
+
+// Function to copy the bibliographic records out in chunks, reusing every chunk that is already full
+// Called on the thread that changes the catalog.
+WorkChunks captureWorkChunks() {
+    if (cached_works_generation != library.works_generation) {
+        cached_work_chunks.clear();
+        cached_works_generation = library.works_generation;
+    }
+    size_t work_count = library.works.size();
+    size_t chunk_count = (work_count + WORK_CHUNK - 1) / WORK_CHUNK;
+    for (size_t c = 0; c < chunk_count; c++) {
+        size_t begin = c * WORK_CHUNK;
+        size_t end = min(work_count, begin + WORK_CHUNK);
+        if (c < cached_work_chunks.size() && cached_work_chunks[c]->size() == end - begin) continue;
+        auto chunk = make_shared<vector<Work>>();
+        chunk->reserve(end - begin);
+        for (size_t w = begin; w < end; w++) {
+            const Work& work = library.works[w];
+            chunk->push_back(Work(work.title, work.author, work.publisher, work.isbn, work.year, work.work_id));
+        }
+        cached_work_chunks.resize(max(cached_work_chunks.size(), c + 1));
+        cached_work_chunks[c] = chunk;
+    }
+    cached_work_chunks.resize(chunk_count);
+    return cached_work_chunks;
+}
+
+// AccountVersion: One account as the reports see it in a catalog version
+// The record is shared with older versions until the user's details change, so copying a chunk of
+// accounts copies no strings.
+struct AccountVersion {
+    const UserRecord* record = nullptr;  // nullptr once the user has been removed
+    int loans = 0;
+    int reservations = 0;
+    int prev_fine = 0;
+    bool active = false;  // false once the user has been removed
+};
+
+// CatalogVersion: Immutable point-in-time copy of the catalog and the accounts
+// Copies and accounts live in fixed-size chunks; a new version copies only the chunks a write touched
+// and shares the rest with the version before it, so publishing costs one chunk per changed slot.
+struct CatalogVersion {
+    static constexpr size_t BOOK_CHUNK = 256;
+    static constexpr size_t ACCOUNT_CHUNK = 64;
+    uint64_t number = 0;
+    size_t book_count = 0;
+    size_t account_count = 0;
+    size_t work_count = 0;
+    size_t works_generation = 0;
+    vector<const vector<Book>*> book_chunks;
+    vector<const vector<AccountVersion>*> account_chunks;
+    WorkChunks work_chunks;
+
+    const Book& book(size_t slot) const {
+        return (*book_chunks[slot / BOOK_CHUNK])[slot % BOOK_CHUNK];
+    }
+
+    const AccountVersion& account(size_t slot) const {
+        return (*account_chunks[slot / ACCOUNT_CHUNK])[slot % ACCOUNT_CHUNK];
+    }
+
+    const Work& work(int work_id) const {
+        return (*work_chunks[work_id / WORK_CHUNK])[work_id % WORK_CHUNK];
+    }
+};
+
+// EpochSlot: The epoch a reader thread pinned, 0 while it holds no version
+// Slots are linked into a list that only grows and are reused by later threads, like ThreadMetrics.
+struct EpochSlot {
+    atomic<uint64_t> epoch{0};
+    atomic<bool> in_use{true};
+    EpochSlot* next = nullptr;
+};
+
+AccountVersion accountVersion(int user_id, UserRecord& record);
+
+// VersionStore Class: Multi-version catalog for reports that run alongside circulation
+// Writers change the live library as before; syncBookState() and VersionedWrite note which copies and
+// accounts changed, and the outermost VersionedWrite publishes a new version with one atomic store.
+// Readers pin the current epoch and read the version they find without taking any lock, so a long
+// report never stalls a borrow or return. A replaced version (and the chunks only it used) is retired
+// with the epoch it was replaced in and freed once every pinned reader has moved past that epoch.
+// Writers are serialized by the caller, as circulation already is; readers may be on any thread.
+class VersionStore {
+public:
+    atomic<const CatalogVersion*> current{nullptr};
+    atomic<uint64_t> epoch{1};
+    atomic<EpochSlot*> readers{nullptr};
+    atomic<uint64_t> reclaimed{0};
+
+    ~VersionStore() {
+        for (Retired& entry : retired) release(entry);
+        const CatalogVersion* version = current.load();
+        if (version) {
+            Retired last = retireAll(version);
+            release(last);
+        }
+    }
+
+    // Function to note that a catalog slot changed; cheap enough to call on every state change
+    void markBook(size_t slot) {
+        if (!enabled || full_rebuild) return;
+        if (dirty_books.size() > library.books.size() / 8 + 64) {
+            full_rebuild = true;  // a bulk change; copying everything is cheaper than tracking it
+            return;
+        }
+        dirty_books.push_back(slot);
+    }
+
+    // Function to note that an account changed (or was added or removed)
+    void markUser(int user_id) {
+        if (enabled && user_id >= 0) dirty_users.push_back(user_id);
+    }
+
+    void beginWrite() {
+        write_depth++;
+    }
+
+    // Function to close a write; the outermost one publishes what changed
+    void endWrite() {
+        if (--write_depth == 0) publish();
+    }
+
+    // Function to publish a version built from scratch, starting version tracking on first use
+    void rebuild() {
+        enabled = true;
+        full_rebuild = false;
+        auto next = new CatalogVersion;
+        const CatalogVersion* old = current.load(memory_order_relaxed);
+        next->number = old ? old->number + 1 : 1;
+        account_slot.clear();
+        for (const auto& pair : library.students) account_slot.emplace(pair.first, account_slot.size());
+        for (const auto& pair : library.faculties) account_slot.emplace(pair.first, account_slot.size());
+        for (const auto& pair : library.librarians) account_slot.emplace(pair.first, account_slot.size());
+        dirty_books.clear();
+        dirty_users.clear();
+        for (const auto& pair : account_slot) dirty_users.push_back(pair.first);
+        copyBooks(*next, 0, (library.books.size() + CatalogVersion::BOOK_CHUNK - 1) / CatalogVersion::BOOK_CHUNK);
+        next->work_chunks = captureWorkChunks();
+        next->work_count = library.works.size();
+        next->works_generation = library.works_generation;
+        Retired entry = retireAll(old);
+        copyAccounts(*next, entry);
+        install(next, entry);
+    }
+
+    // Function to publish the changes noted since the last version
+    void publish() {
+        const CatalogVersion* old = current.load(memory_order_relaxed);
+        if (!enabled || !old) return;
+        if (full_rebuild || library.works_generation != old->works_generation) {
+            rebuild();
+            return;
+        }
+        size_t count = library.books.size();
+        if (dirty_books.empty() && dirty_users.empty() && count == old->book_count && library.works.size() == old->work_count) return;
+
+        auto next = new CatalogVersion(*old);
+        next->number = old->number + 1;
+        Retired entry{0, old, {}, {}, {}};
+        vector<size_t> chunks;
+        for (size_t slot : dirty_books) {
+            if (slot < count) chunks.push_back(slot / CatalogVersion::BOOK_CHUNK);
+        }
+        // A grown or shrunk catalog changes every chunk from the old end onwards
+        size_t chunk_count = (count + CatalogVersion::BOOK_CHUNK - 1) / CatalogVersion::BOOK_CHUNK;
+        if (count != old->book_count) {
+            for (size_t c = min(count, old->book_count) / CatalogVersion::BOOK_CHUNK; c < chunk_count; c++) chunks.push_back(c);
+        }
+        for (size_t c = chunk_count; c < next->book_chunks.size(); c++) entry.book_chunks.push_back(next->book_chunks[c]);
+        next->book_chunks.resize(chunk_count, nullptr);
+        sort(chunks.begin(), chunks.end());
+        chunks.erase(unique(chunks.begin(), chunks.end()), chunks.end());
+        for (size_t c : chunks) {
+            if (next->book_chunks[c]) entry.book_chunks.push_back(next->book_chunks[c]);
+            copyBooks(*next, c, c + 1);
+        }
+        next->book_count = count;
+        if (library.works.size() != old->work_count) {
+            next->work_chunks = captureWorkChunks();
+            next->work_count = library.works.size();
+        }
+        dirty_books.clear();
+        copyAccounts(*next, entry);
+        install(next, entry);
+    }
+
+    // Function to claim the calling thread's reader slot, linking a new one if none is free
+    EpochSlot* acquireReader() {
+        for (EpochSlot* slot = readers.load(memory_order_acquire); slot; slot = slot->next) {
+            bool expected = false;
+            if (slot->in_use.compare_exchange_strong(expected, true)) return slot;
+        }
+        EpochSlot* slot = new EpochSlot;
+        slot->next = readers.load(memory_order_relaxed);
+        while (!readers.compare_exchange_weak(slot->next, slot, memory_order_release, memory_order_relaxed)) {}
+        return slot;
+    }
+
+    // Function to get how many replaced versions are still waiting for readers to move on
+    size_t retiredCount() const {
+        return retired.size();
+    }
+
+private:
+    // Retired: A replaced version and the chunks and records no newer version shares, freed together
+    struct Retired {
+        uint64_t epoch;
+        const CatalogVersion* version;
+        vector<const vector<Book>*> book_chunks;
+        vector<const vector<AccountVersion>*> account_chunks;
+        vector<const UserRecord*> records;
+    };
+
+    bool enabled = false;
+    bool full_rebuild = false;
+    int write_depth = 0;
+    vector<size_t> dirty_books;
+    vector<int> dirty_users;
+    unordered_map<int, size_t> account_slot;  // user id -> position in the account chunks
+    vector<Retired> retired;
+
+    // Function to copy catalog chunks [first, last) out of the live library into a version
+    void copyBooks(CatalogVersion& version, size_t first, size_t last) {
+        size_t count = library.books.size();
+        version.book_chunks.resize(max(version.book_chunks.size(), last), nullptr);
+        for (size_t c = first; c < last; c++) {
+            size_t begin = c * CatalogVersion::BOOK_CHUNK;
+            size_t end = min(count, begin + CatalogVersion::BOOK_CHUNK);
+            version.book_chunks[c] = new vector<Book>(library.books.begin() + begin, library.books.begin() + end);
+        }
+        version.book_count = count;
+    }
+
+    // Function to retire a version together with everything it holds, when nothing of it is shared
+    static Retired retireAll(const CatalogVersion* version) {
+        Retired entry{0, version, {}, {}, {}};
+        if (!version) return entry;
+        entry.book_chunks = version->book_chunks;
+        entry.account_chunks = version->account_chunks;
+        for (size_t slot = 0; slot < version->account_count; slot++) {
+            if (version->account(slot).record) entry.records.push_back(version->account(slot).record);
+        }
+        return entry;
+    }
+
+    static bool sameRecord(const UserRecord& a, const UserRecord& b) {
+        return tie(a.user_id, a.name, a.email, a.phone, a.role, a.password) == tie(b.user_id, b.name, b.email, b.phone, b.role, b.password);
+    }
+
+    // Function to copy the noted accounts into fresh chunks of a version, retiring what they replace
+    // After a rebuild the version starts without chunks, so nothing is shared and the entry is left alone.
+    void copyAccounts(CatalogVersion& version, Retired& entry) {
+        if (dirty_users.empty()) return;
+        vector<pair<size_t, int>> slots;
+        for (int user_id : dirty_users) {
+            auto it = account_slot.emplace(user_id, account_slot.size()).first;
+            slots.push_back({it->second, user_id});
+        }
+        dirty_users.clear();
+        sort(slots.begin(), slots.end());
+        slots.erase(unique(slots.begin(), slots.end()), slots.end());
+        version.account_count = account_slot.size();
+        version.account_chunks.resize((version.account_count + CatalogVersion::ACCOUNT_CHUNK - 1) / CatalogVersion::ACCOUNT_CHUNK, nullptr);
+        for (size_t i = 0; i < slots.size();) {
+            size_t c = slots[i].first / CatalogVersion::ACCOUNT_CHUNK;
+            const vector<AccountVersion>* old = version.account_chunks[c];
+            auto chunk = old ? new vector<AccountVersion>(*old) : new vector<AccountVersion>();
+            chunk->resize(min(CatalogVersion::ACCOUNT_CHUNK, version.account_count - c * CatalogVersion::ACCOUNT_CHUNK));
+            for (; i < slots.size() && slots[i].first / CatalogVersion::ACCOUNT_CHUNK == c; i++) {
+                AccountVersion& account = (*chunk)[slots[i].first % CatalogVersion::ACCOUNT_CHUNK];
+                const UserRecord* old_record = account.record;
+                UserRecord record;
+                account = accountVersion(slots[i].second, record);
+                if (account.active && old_record && sameRecord(*old_record, record)) {
+                    account.record = old_record;
+                    continue;
+                }
+                if (account.active) account.record = new UserRecord(move(record));
+                if (old_record) entry.records.push_back(old_record);
+            }
+            if (old) entry.account_chunks.push_back(old);
+            version.account_chunks[c] = chunk;
+        }
+    }
+
+    // Function to make a version current, retire the one it replaces and free what no reader can see
+    void install(const CatalogVersion* next, Retired& entry) {
+        current.store(next, memory_order_seq_cst);
+        if (entry.version) {
+            entry.epoch = epoch.fetch_add(1, memory_order_seq_cst);
+            retired.push_back(move(entry));
+        }
+        reclaim();
+    }
+
+    // Function to free every retired version that was replaced before the oldest pinned epoch
+    void reclaim() {
+        uint64_t oldest = UINT64_MAX;
+        for (EpochSlot* slot = readers.load(memory_order_acquire); slot; slot = slot->next) {
+            uint64_t pinned = slot->epoch.load(memory_order_seq_cst);
+            if (pinned != 0) oldest = min(oldest, pinned);
+        }
+        size_t kept = 0;
+        for (Retired& entry : retired) {
+            if (entry.epoch < oldest) {
+                release(entry);
+            } else {
+                if (&retired[kept] != &entry) retired[kept] = move(entry);
+                kept++;
+            }
+        }
+        retired.resize(kept);
+    }
+
+    void release(Retired& entry) {
+        for (auto chunk : entry.book_chunks) delete chunk;
+        for (auto chunk : entry.account_chunks) delete chunk;
+        for (auto record : entry.records) delete record;
+        delete entry.version;
+        reclaimed.fetch_add(1, memory_order_relaxed);
+    }
+};
+
+VersionStore catalog_versions;
+
+// VersionView: Pins the current catalog version for as long as it lives
+// Views may nest; the outermost one keeps the epoch, which also protects any newer version.
+class VersionView {
+    EpochSlot* slot;
+    bool outermost;
+public:
+    const CatalogVersion* version;
+
+    VersionView() {
+        struct Holder {
+            EpochSlot* slot = catalog_versions.acquireReader();
+            ~Holder() { slot->in_use.store(false, memory_order_release); }
+        };
+        thread_local Holder holder;
+        slot = holder.slot;
+        outermost = slot->epoch.load(memory_order_relaxed) == 0;
+        if (outermost) slot->epoch.store(catalog_versions.epoch.load(memory_order_seq_cst), memory_order_seq_cst);
+        version = catalog_versions.current.load(memory_order_seq_cst);
+    }
+    ~VersionView() {
+        if (outermost) slot->epoch.store(0, memory_order_release);
+    }
+    VersionView(const VersionView&) = delete;
+    VersionView& operator=(const VersionView&) = delete;
+};
+
+// VersionPin: Holds the current catalog version until it is destroyed, on whichever thread that happens
+// Unlike VersionView it claims a reader slot of its own, so it can travel with a snapshot to the save thread.
+class VersionPin {
+    EpochSlot* slot;
+public:
+    const CatalogVersion* version;
+
+    VersionPin() : slot(catalog_versions.acquireReader()) {
+        slot->epoch.store(catalog_versions.epoch.load(memory_order_seq_cst), memory_order_seq_cst);
+        version = catalog_versions.current.load(memory_order_seq_cst);
+    }
+    ~VersionPin() {
+        slot->epoch.store(0, memory_order_release);
+        slot->in_use.store(false, memory_order_release);
+    }
+    VersionPin(const VersionPin&) = delete;
+    VersionPin& operator=(const VersionPin&) = delete;
+};
+
+// VersionedWrite: Marks a scope that changes the catalog or an account
+// The user's account is copied into the next version, which is published when the outermost scope ends.
+class VersionedWrite {
+public:
+    explicit VersionedWrite(int user_id = -1) {
+        catalog_versions.beginWrite();
+        catalog_versions.markUser(user_id);
+    }
+    ~VersionedWrite() {
+        catalog_versions.endWrite();
+    }
+    VersionedWrite(const VersionedWrite&) = delete;
+    VersionedWrite& operator=(const VersionedWrite&) = delete;
+};
+
+// Function to total the fines building up on each borrower's current loans in a version
+// Uses the same rule as Account::check_fine(): 10 a day once a loan is more than 15 open days old.
+unordered_map<int, long long> accruedFines(const CatalogVersion& version, long long now) {
+    unordered_map<int, long long> fines;
+    for (size_t slot = 0; slot < version.book_count; slot++) {
+        const Book& book = version.book(slot);
+        if (book.status != BookStatus::Borrowed) continue;
+        long long late = calendar.daysLate(book.borrowed_time, now, 15);
+        if (late > 0) fines[book.borrower_id] += 10 * late;
+    }
+    return fines;
+}
+
+// Function to display all books in library, read from the current catalog version
+// Copy counts come from the same version, so the listing holds together while books circulate.
+void Library::displayAllBooks() const {
+    VersionView view;
+    const CatalogVersion* version = view.version;
+    if (!version || version->book_count == 0) {
+        cout << "No books in library" << endl;
+        return;
+    }
+    vector<pair<uint32_t, uint32_t>> copies(version->work_count);  // (free, total) per work
+    for (size_t slot = 0; slot < version->book_count; slot++) {
+        const Book& book = version->book(slot);
+        copies[book.work_id].second++;
+        if (book.status == BookStatus::Available && !book.is_reserved) copies[book.work_id].first++;
+    }
+    cout << "\nAll Books in Library:" << endl;
+    for (size_t slot = 0; slot < version->book_count; slot++) {
+        const Book& book = version->book(slot);
+        printBook(book, version->work(book.work_id), copies[book.work_id].first, copies[book.work_id].second);
+    }
+}
+
+// Function to take a copy out of its work's free list in O(1) by swapping with the last entry
+void unlinkFreeCopy(Work& work, Book* book) {
+    int last_id = work.free_copies.back();
+    work.free_copies[book->free_slot] = last_id;
+    library.books[library.book_index[last_id]].free_slot = book->free_slot;
+    work.free_copies.pop_back();
+    book->free_slot = -1;
+}
+
+// Function to keep a copy's free list membership and availability bits in step with its status and reservation
+// The slot is also noted for the next catalog version.
+void syncBookState(Book* book) {
+    size_t slot = book - library.books.data();
+    catalog_versions.markBook(slot);
+    library.available_map.set(slot, book->status == BookStatus::Available);
+    library.borrowed_map.set(slot, book->status == BookStatus::Borrowed);
+    library.reserved_map.set(slot, book->is_reserved);
+
+    Work& work = library.works[book->work_id];
+    bool is_free = book->status == BookStatus::Available && !book->is_reserved;
+    if (is_free && book->free_slot < 0) {
+        book->free_slot = work.free_copies.size();
+        work.free_copies.push_back(book->book_id);
+    } else if (!is_free && book->free_slot >= 0) {
+        unlinkFreeCopy(work, book);
+    }
+}
+
+// Function to store a copy in the catalog and index it; the caller checks for duplicate ids
+void insertCopy(const Book& copy) {
+    library.book_index[copy.book_id] = library.books.size();
+    library.books.push_back(copy);
+    library.available_map.resize(library.books.size());
+    library.borrowed_map.resize(library.books.size());
+    library.reserved_map.resize(library.books.size());
+    Book* book = &library.books.back();
+    book->free_slot = -1;
+    library.works[book->work_id].copies.push_back(book->book_id);
+    syncBookState(book);
+}
+
+// Function to pick any free copy of a work in O(1), or nullptr if every copy is out
+Book* findFreeCopy(int work_id) {
+    Work* work = getWork(work_id);
+    if (!work || work->free_copies.empty()) {
+        return nullptr;
+    }
+    return &library.books[library.book_index[work->free_copies.back()]];
+}
+
+// Forward declarations: session log arguments are encoded with the binary codec defined further down
+string sessionArguments(const Work& details);
+string sessionArguments(const CatalogQuery& query);
+
+// Function to add a copy of a title to the library; copies sharing an ISBN share one work record
+void addBook(int book_id, const Work& details) {
+    RecordedOp recorded(SessionOp::AddBook, -1, book_id);
+    if (recorded.active) recorded.record.text = sessionArguments(details);
+    VersionedWrite write;
+    if (library.book_index.find(book_id) != library.book_index.end()) {
+        cout << "Book already exists" << endl;
+        return;
+    }
+    auto known = library.isbn_index.find(details.isbn);
+    if (known != library.isbn_index.end() && !library.works[known->second].sameDetails(details)) {
+        const Work& work = library.works[known->second];
+        cout << "ISBN " << details.isbn << " already belongs to \"" << work.title << "\" by " << work.author << "; book not added" << endl;
+        return;
+    }
+    insertCopy(Book(book_id, findOrAddWork(details)));
+    cout << "Book added successfully" << endl;
+}
+
+// Function to get a book by its id
+Book* getBook(int book_id) {
+    auto it = library.book_index.find(book_id);
+    if (it == library.book_index.end()) {
+        return nullptr;
+    }
+    return &library.books[it->second];
+}
+
+// Function to remove a book from the library
+void removeBook(int book_id)
+{
+    TraceSpan span("removeBook", -1, book_id);
+    RecordedOp recorded(SessionOp::RemoveBook, -1, book_id);
+    VersionedWrite write;
+    // First find the book to check if it is available
+    auto it = library.book_index.find(book_id);
+    
+    if (it == library.book_index.end()) {
+        cout << "Book not found" << endl;
+        return;
+    }
+    size_t pos = it->second;
+    Book* book = &library.books[pos];
+    
+    // Check if the book is currently borrowed
+    if (book->status != BookStatus::Available) {
+        cout << "Cannot remove book - it is currently borrowed or reserved by user " << book->borrower_id << endl;
+        return;
+    }
+    
+    // If book is available, detach it from its work and fill its slot with the last copy
+    Work& work = library.works[book->work_id];
+    if (book->free_slot >= 0) {
+        unlinkFreeCopy(work, book);
+    }
+    work.copies.erase(remove(work.copies.begin(), work.copies.end(), book_id), work.copies.end());
+    size_t last = library.books.size() - 1;
+    if (pos != last) {
+        library.books[pos] = library.books[last];
+        library.book_index[library.books[pos].book_id] = pos;
+        syncBookState(&library.books[pos]);
+    }
+    library.books.pop_back();
+    library.book_index.erase(book_id);
+    library.available_map.resize(last);
+    library.borrowed_map.resize(last);
+    library.reserved_map.resize(last);
+    cout << "Book removed successfully" << endl;
+}
+
+// Function to turn a posting list of work ids into a work bitmap
+Bitmap workBitmap(const vector<int>& work_ids, size_t work_count) {
+    Bitmap bitmap;
+    bitmap.resize(work_count);
+    for (int work_id : work_ids) {
+        bitmap.set(work_id, true);
+    }
+    return bitmap;
+}
+
+// Function to find the catalog slots matching every predicate of a query
+// Work-level predicates (year, publisher, author) are intersected on a work bitmap built from
+// the sorted year index and the postings, then expanded to copies and intersected with the
+// per-slot status and reservation bitmaps.
+vector<int> queryCatalog(const CatalogQuery& query) {
+    ScopedMetric metric(MetricOp::Search);
+    Bitmap slots;
+    slots.resize(library.books.size());
+
+    bool has_work_filter = query.year_min != INT_MIN || query.year_max != INT_MAX || !query.publisher.empty() || !query.author.empty();
+    if (has_work_filter) {
+        Bitmap works;
+        works.resize(library.works.size());
+        works.fill();
+        if (!query.publisher.empty()) {
+            auto it = library.publisher_postings.find(toLower(query.publisher));
+            works.andWith(it == library.publisher_postings.end() ? Bitmap() : workBitmap(it->second, library.works.size()));
+        }
+        if (!query.author.empty()) {
+            auto it = library.author_postings.find(toLower(query.author));
+            works.andWith(it == library.author_postings.end() ? Bitmap() : workBitmap(it->second, library.works.size()));
+        }
+        if (query.year_min != INT_MIN || query.year_max != INT_MAX) {
+            if (library.year_index_dirty) {
+                sort(library.year_index.begin(), library.year_index.end());
+                library.year_index_dirty = false;
+            }
+            auto lo = lower_bound(library.year_index.begin(), library.year_index.end(), make_pair(query.year_min, INT_MIN));
+            auto hi = upper_bound(library.year_index.begin(), library.year_index.end(), make_pair(query.year_max, INT_MAX));
+            Bitmap in_range;
+            in_range.resize(library.works.size());
+            for (auto it = lo; it != hi; ++it) {
+                in_range.set(it->second, true);
+            }
+            works.andWith(in_range);
+        }
+        works.forEach([&slots](size_t work_id) {
+            for (int book_id : library.works[work_id].copies) {
+                slots.set(library.book_index[book_id], true);
+            }
+        });
+    } else {
+        slots.fill();
+    }
+
+    if (query.status == "Available") {
+        slots.andWith(library.available_map);
+    } else if (query.status == "Borrowed") {
+        slots.andWith(library.borrowed_map);
+    }
+    if (query.reserved == 1) {
+        slots.andWith(library.reserved_map);
+    } else if (query.reserved == 0) {
+        slots.andNotWith(library.reserved_map);
+    }
+
+    vector<int> result;
+    result.reserve(slots.count());
+    slots.forEach([&result](size_t slot) { result.push_back(slot); });
+    return result;
+}
+
+// Function to run a catalog query and print the matches with the query latency
+void runCatalogQuery(const CatalogQuery& query, bool compact) {
+    RecordedOp recorded(SessionOp::Query);
+    auto start = chrono::steady_clock::now();
+    vector<int> result = queryCatalog(query);
+    auto elapsed = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+    if (recorded.active) {
+        recorded.record.text = sessionArguments(query);
+        recorded.record.after = result.size();
+    }
+
+    for (int slot : result) {
+        const Book& book = library.books[slot];
+        if (compact) {
+            const Work& work = library.works[book.work_id];
+            cout << book.book_id << "|" << work.title << "|" << work.author << "|" << work.publisher << "|" << work.year << "|" << statusName(book.status) << "|" << book.is_reserved << "\n";
+        } else {
+            Library::displayBook(&book);
+        }
+    }
+    cout << result.size() << " matching books found in " << elapsed << " us" << endl;
+}
+
+// HistoryEntry: One completed loan in a user's borrowing history
+struct HistoryEntry {
+    int book_id;
+    long long return_time;
+    long long borrowed_time;  // 0 for rows written before loans recorded it
+};
+
+// CRC-32 (IEEE) tables for slicing-by-8: table[0] is the byte table, table[k] advances it by k more bytes
+constexpr array<array<uint32_t, 256>, 8> makeCrcTables() {
+    array<array<uint32_t, 256>, 8> tables{};
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++) crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+        tables[0][i] = crc;
+    }
+    for (int k = 1; k < 8; k++) {
+        for (int i = 0; i < 256; i++) tables[k][i] = (tables[k - 1][i] >> 8) ^ tables[0][tables[k - 1][i] & 0xFF];
+    }
+    return tables;
+}
+
+constexpr array<array<uint32_t, 256>, 8> crc_tables = makeCrcTables();
+
+// Function to compute the CRC-32 of a buffer, eight bytes per step
+uint32_t crc32(string_view data) {
+    uint32_t crc = 0xFFFFFFFFu;
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(data.data());
+    size_t n = data.size();
+    for (; n >= 8; n -= 8, p += 8) {
+        uint32_t low = crc ^ (uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24);
+        crc = crc_tables[7][low & 0xFF] ^ crc_tables[6][(low >> 8) & 0xFF] ^ crc_tables[5][(low >> 16) & 0xFF] ^ crc_tables[4][low >> 24] ^
+              crc_tables[3][p[4]] ^ crc_tables[2][p[5]] ^ crc_tables[1][p[6]] ^ crc_tables[0][p[7]];
+    }
+    for (; n > 0; n--, p++) crc = (crc >> 8) ^ crc_tables[0][(crc ^ *p) & 0xFF];
+    return ~crc;
+}
+
+// Function to format the checksum trailer that ends every saved table: "#crc32=<hex> bytes=<n>"
+string checksumTrailer(string_view data) {
+    char trailer[64];
+    snprintf(trailer, sizeof(trailer), "#crc32=%08x bytes=%zu\n", crc32(data), data.size());
+    return trailer;
+}
+
+// Function to write a file and force it to disk before returning
+static bool writeDurably(const string& path, const string& data) {
+#ifdef _WIN32
+    ofstream file(path, ios::binary | ios::trunc);
+    file.write(data.data(), data.size());
+    file.flush();
+    return bool(file);
+#else
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return false;
+    size_t done = 0;
+    while (done < data.size()) {
+        ssize_t n = write(fd, data.data() + done, data.size() - done);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            close(fd);
+            return false;
+        }
+        done += n;
+    }
+    bool synced = fsync(fd) == 0;
+    return close(fd) == 0 && synced;
+#endif
+}
+
+// Function to force a directory entry change (rename, link) to disk
+static void syncDirectory(const string& path) {
+#ifndef _WIN32
+    string directory = filesystem::path(path).parent_path().string();
+    int fd = open(directory.empty() ? "." : directory.c_str(), O_RDONLY);
+    if (fd < 0) return;
+    fsync(fd);
+    close(fd);
+#else
+    (void)path;
+#endif
+}
+
+// Function to replace a data file crash-safely
+// The contents plus a checksum trailer are written and fsynced to path.tmp, the current file is kept as
+// path.prev (a hard link, so no data is copied), and path.tmp is renamed over path. Loaders skip the
+// '#' trailer line; verifyTableFile() checks it at startup.
+bool writeTableFile(const string& path, const string& data) {
+    string temp = path + ".tmp";
+    if (!writeDurably(temp, data + checksumTrailer(data))) {
+        cout << "Could not write " << temp << endl;
+        return false;
+    }
+    error_code ec;
+    string previous = path + ".prev";
+    if (filesystem::exists(path, ec)) {
+        filesystem::remove(previous, ec);
+        filesystem::create_hard_link(path, previous, ec);
+        if (ec) filesystem::copy_file(path, previous, filesystem::copy_options::overwrite_existing, ec);
+    }
+    filesystem::rename(temp, path, ec);
+    if (ec) {
+        cout << "Could not replace " << path << ": " << ec.message() << endl;
+        return false;
+    }
+    syncDirectory(path);
+    return true;
+}
+
+// Function to read a whole file into a string in one call
+bool readWholeFile(const string& path, string& data) {
+    ifstream file(path, ios::binary);
+    if (!file) return false;
+    file.seekg(0, ios::end);
+    data.resize(size_t(file.tellg()));
+    file.seekg(0);
+    file.read(&data[0], data.size());
+    return true;
+}
+
+// TableState: Result of checking a saved table against its checksum trailer
+enum class TableState { Missing, Valid, Unverified, Corrupt };
+
+// Function to check a table file; files without a trailer are written by older versions or by hand
+TableState verifyTableFile(const string& path) {
+    string data;
+    if (!readWholeFile(path, data)) return TableState::Missing;
+    size_t start = data.size() > 1 ? data.rfind('\n', data.size() - 2) : string::npos;
+    start = start == string::npos ? 0 : start + 1;
+    if (data.compare(start, 7, "#crc32=") != 0) return TableState::Unverified;
+    string_view body(data.data(), start);
+    return data.compare(start, string::npos, checksumTrailer(body)) == 0 ? TableState::Valid : TableState::Corrupt;
+}
+
+// Function to append to a file and force the new bytes to disk before returning
+static bool appendDurably(const string& path, const string& data) {
+#ifdef _WIN32
+    ofstream file(path, ios::binary | ios::app);
+    file.write(data.data(), data.size());
+    file.flush();
+    return bool(file);
+#else
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) return false;
+    size_t done = 0;
+    while (done < data.size()) {
+        ssize_t n = write(fd, data.data() + done, data.size() - done);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            close(fd);
+            return false;
+        }
+        done += n;
+    }
+    bool synced = fsync(fd) == 0;
+    return close(fd) == 0 && synced;
+#endif
+}
+
+// StorageBackend Class: Where the persisted tables live
+// Tables are named like "books", "students" or "history/2024-05" and stored as whole blobs in the
+// pipe-delimited row format; the load/save functions only ever see table contents, never paths.
+class StorageBackend {
+public:
+    virtual ~StorageBackend() = default;
+    virtual const char* name() const = 0;
+    // Function to read a whole table; false when it does not exist
+    virtual bool load(const string& table, string& data) = 0;
+    // Function to replace a whole table; false when the write failed
+    virtual bool store(const string& table, const string& data) = 0;
+    // Function to add rows to the end of a table, creating it if needed; false when the write failed
+    virtual bool append(const string& table, const string& data) = 0;
+    // Function to list the tables whose names start with prefix
+    virtual vector<string> list(const string& prefix) = 0;
+    // Function to check the stored tables before loading and repair what can be repaired
+    virtual void recover() {}
+    // Function to tell the save functions to encode rows with BinaryCodec rather than TextCodec
+    virtual bool binaryRows() const { return false; }
+};
+
+// TextFileBackend Class: One text file per table under a directory, saved crash-safely by writeTableFile()
+class TextFileBackend : public StorageBackend {
+public:
+    string directory;
+
+    explicit TextFileBackend(string directory = ".") : directory(move(directory)) {}
+
+    const char* name() const override { return "text"; }
+
+    string pathOf(const string& table) const {
+        return directory + "/" + table + ".txt";
+    }
+
+    bool load(const string& table, string& data) override {
+        return readWholeFile(pathOf(table), data);
+    }
+
+    bool store(const string& table, const string& data) override {
+        return writeTableFile(pathOf(table), data);
+    }
+
+    bool append(const string& table, const string& data) override {
+        string path = pathOf(table);
+        error_code ec;
+        filesystem::create_directories(filesystem::path(path).parent_path(), ec);
+        if (!appendDurably(path, data)) {
+            cout << "Could not append to " << path << endl;
+            return false;
+        }
+        return true;
+    }
+
+    vector<string> list(const string& prefix) override {
+        vector<string> tables;
+        size_t slash = prefix.rfind('/');
+        string folder = slash == string::npos ? "" : prefix.substr(0, slash + 1);
+        error_code ec;
+        for (const auto& file : filesystem::directory_iterator(directory + "/" + folder, ec)) {
+            if (file.path().extension() != ".txt") continue;
+            string table = folder + file.path().stem().string();
+            if (table.compare(0, prefix.size(), prefix) == 0) tables.push_back(table);
+        }
+        sort(tables.begin(), tables.end());
+        return tables;
+    }
+
+    // Function to fall back to the previous generation of every damaged table
+    // A table without a trailer next to a .prev file is treated as damaged: this program has saved here
+    // before, so the trailer can only be missing because the write was cut short.
+    // Appended tables (history and fine segments, the history index) have no trailer; a torn last line
+    // is cut back to the last complete row instead.
+    void recover() override {
+        static const char* const tables[] = {"books", "students", "faculties", "librarians", "currently_borrowed", "reserved_books", "fine_balances"};
+        error_code ec;
+        for (const char* prefix : {"history/", "fines/"}) {
+            for (const string& table : list(prefix)) trimTornLine(pathOf(table));
+        }
+        for (const char* table : tables) {
+            string path = pathOf(table), previous = path + ".prev";
+            filesystem::remove(path + ".tmp", ec);
+            TableState state = verifyTableFile(path);
+            bool has_previous = filesystem::exists(previous, ec);
+            if (state == TableState::Valid || (!has_previous && state != TableState::Corrupt)) continue;
+            if (has_previous && verifyTableFile(previous) == TableState::Valid) {
+                filesystem::copy_file(previous, path, filesystem::copy_options::overwrite_existing, ec);
+                cout << path << " failed its checksum; restored the previous generation from " << previous << endl;
+            } else {
+                cout << path << " failed its checksum and no valid previous generation exists; loading it as is" << endl;
+            }
+        }
+    }
+
+private:
+    // Function to cut an appended file back to its last complete line
+    static void trimTornLine(const string& path) {
+        string data;
+        if (!readWholeFile(path, data) || data.empty() || data.back() == '\n') return;
+        size_t keep = data.rfind('\n');
+        keep = keep == string::npos ? 0 : keep + 1;
+        error_code ec;
+        filesystem::resize_file(path, keep, ec);
+        if (ec) cout << "Could not trim " << path << ": " << ec.message() << endl;
+        else cout << path << ": discarded " << data.size() - keep << " bytes of an incomplete last row" << endl;
+    }
+};
+
+// MemoryBackend Class: Tables kept in memory only, for benchmarks and throwaway sessions
+class MemoryBackend : public StorageBackend {
+public:
+    map<string, string> tables;
+    mutex tables_mutex;
+
+    const char* name() const override { return "memory"; }
+    bool binaryRows() const override { return true; }
+
+    bool load(const string& table, string& data) override {
+        lock_guard<mutex> lock(tables_mutex);
+        auto it = tables.find(table);
+        if (it == tables.end()) return false;
+        data = it->second;
+        return true;
+    }
+
+    bool store(const string& table, const string& data) override {
+        lock_guard<mutex> lock(tables_mutex);
+        tables[table] = data;
+        return true;
+    }
+
+    bool append(const string& table, const string& data) override {
+        lock_guard<mutex> lock(tables_mutex);
+        tables[table] += data;
+        return true;
+    }
+
+    vector<string> list(const string& prefix) override {
+        lock_guard<mutex> lock(tables_mutex);
+        vector<string> names;
+        for (auto it = tables.lower_bound(prefix); it != tables.end() && it->first.compare(0, prefix.size(), prefix) == 0; ++it) {
+            names.push_back(it->first);
+        }
+        return names;
+    }
+};
+
+// JournalBackend Class: Every table in one append-only binary journal
+// Each store or append is one record: kind (1 byte, 1 = store, 2 = append), name length (4 bytes),
+// data length (8 bytes), name, data and a CRC-32 of everything before it, written with one fsynced
+// append. Opening the journal replays it into memory and cuts off a torn last record. When the journal
+// grows past twice the live data it is compacted into one store record per table and renamed into place.
+class JournalBackend : public MemoryBackend {
+public:
+    static constexpr unsigned char STORE = 1;
+    static constexpr unsigned char APPEND = 2;
+    string path;
+    size_t journal_bytes = 0;
+
+    explicit JournalBackend(string path = "library.journal") : path(move(path)) {
+        replay();
+    }
+
+    const char* name() const override { return "journal"; }
+
+    bool store(const string& table, const string& data) override {
+        lock_guard<mutex> lock(tables_mutex);
+        tables[table] = data;
+        return write(STORE, table, data);
+    }
+
+    bool append(const string& table, const string& data) override {
+        lock_guard<mutex> lock(tables_mutex);
+        tables[table] += data;
+        return write(APPEND, table, data);
+    }
+
+private:
+    static void encode(string& out, unsigned char kind, const string& table, const string& data) {
+        size_t start = out.size();
+        out += char(kind);
+        uint32_t name_size = table.size();
+        uint64_t data_size = data.size();
+        out.append(reinterpret_cast<const char*>(&name_size), sizeof(name_size));
+        out.append(reinterpret_cast<const char*>(&data_size), sizeof(data_size));
+        out += table;
+        out += data;
+        uint32_t crc = crc32(string_view(out).substr(start));
+        out.append(reinterpret_cast<const char*>(&crc), sizeof(crc));
+    }
+
+    // Function to log one change, compacting the journal when it has grown too large
+    bool write(unsigned char kind, const string& table, const string& data) {
+        string record;
+        encode(record, kind, table, data);
+        if (!appendDurably(path, record)) {
+            cout << "Could not write " << path << endl;
+            return false;
+        }
+        journal_bytes += record.size();
+        size_t live_bytes = 0;
+        for (const auto& entry : tables) live_bytes += entry.first.size() + entry.second.size() + 17;
+        if (journal_bytes > 2 * live_bytes + (1 << 20)) compact();
+        return true;
+    }
+
+    void compact() {
+        string image;
+        for (const auto& entry : tables) encode(image, STORE, entry.first, entry.second);
+        string temp = path + ".tmp";
+        error_code ec;
+        if (!writeDurably(temp, image)) return;
+        filesystem::rename(temp, path, ec);
+        if (ec) return;
+        syncDirectory(path);
+        journal_bytes = image.size();
+    }
+
+    void replay() {
+        string journal;
+        if (!readWholeFile(path, journal)) return;
+        size_t offset = 0;
+        const size_t header = 1 + sizeof(uint32_t) + sizeof(uint64_t);
+        while (journal.size() - offset >= header + sizeof(uint32_t)) {
+            unsigned char kind = journal[offset];
+            uint32_t name_size;
+            uint64_t data_size;
+            memcpy(&name_size, &journal[offset + 1], sizeof(name_size));
+            memcpy(&data_size, &journal[offset + 1 + sizeof(name_size)], sizeof(data_size));
+            size_t remaining = journal.size() - offset - header - sizeof(uint32_t);
+            if (name_size > remaining || data_size > remaining - name_size) break;
+            size_t body = header + name_size + data_size;
+            uint32_t crc;
+            memcpy(&crc, &journal[offset + body], sizeof(crc));
+            if ((kind != STORE && kind != APPEND) || crc != crc32(string_view(journal).substr(offset, body))) break;
+            string table = journal.substr(offset + header, name_size);
+            if (kind == STORE) tables[table].assign(journal, offset + header + name_size, data_size);
+            else tables[table].append(journal, offset + header + name_size, data_size);
+            offset += body + sizeof(crc);
+        }
+        journal_bytes = offset;
+        if (offset < journal.size()) {
+            cout << path << ": discarded " << journal.size() - offset << " bytes of an incomplete journal record" << endl;
+            error_code ec;
+            filesystem::resize_file(path, offset, ec);
+        }
+    }
+};
+
+unique_ptr<StorageBackend> storage(new TextFileBackend);
+
+// Function to switch the storage backend by name (text, memory or journal)
+bool selectStorage(const string& name) {
+    if (name == "text") storage.reset(new TextFileBackend);
+    else if (name == "memory") storage.reset(new MemoryBackend);
+    else if (name == "journal") storage.reset(new JournalBackend);
+    else return false;
+    return true;
+}
+
+// HistoryStore Class: Borrowing history kept as append-only monthly segment files (history/YYYY-MM.txt)
+// Only the most recent months are loaded into accounts at startup; older segments are streamed on demand,
+// and a sparse per-user index (history/index.txt) lists the months each user appears in.
+class HistoryStore {
+public:
+    string directory = "history";  // table prefix: segments are "history/YYYY-MM", the index is "history/index"
+    int eager_months = 3;  // current month and the two before it are kept in memory
+    string eager_from;     // first month loaded eagerly, "YYYY-MM"
+    unordered_map<int, vector<string>> user_segments;  // user id -> months with entries, ascending
+    vector<pair<int, string>> pending_index;           // index lines not yet appended to the index file
+    map<string, string> unwritten;                     // rows by month whose append failed, saved ahead of newer ones
+
+    // Function to get the "YYYY-MM" segment a timestamp falls in
+    static string monthOf(long long timestamp) {
+        time_t t = timestamp;
+        tm parts;
+        gmtime_r(&t, &parts);
+        char month[32];
+        snprintf(month, sizeof(month), "%04d-%02d", parts.tm_year + 1900, parts.tm_mon + 1);
+        return month;
+    }
+
+    string segmentTable(const string& month) const {
+        return directory + "/" + month;
+    }
+
+    string indexTable() const {
+        return directory + "/index";
+    }
+
+    // Function to work out the first eager month relative to now
+    void setEagerWindow(long long now) {
+        time_t t = now;
+        tm parts;
+        gmtime_r(&t, &parts);
+        int month = parts.tm_year * 12 + parts.tm_mon - (eager_months - 1);
+        char first[32];
+        snprintf(first, sizeof(first), "%04d-%02d", month / 12 + 1900, month % 12 + 1);
+        eager_from = first;
+    }
+
+    bool isEager(const string& month) const {
+        return month >= eager_from;
+    }
+
+    // Function to record that a user has entries in a segment
+    void noteEntry(int user_id, const string& month) {
+        vector<string>& months = user_segments[user_id];
+        if (!months.empty() && months.back() == month) return;
+        if (find(months.begin(), months.end(), month) != months.end()) return;
+        months.push_back(month);
+        sort(months.begin(), months.end());
+        pending_index.push_back({user_id, month});
+    }
+
+    // Function to load the per-user segment index
+    void loadIndex() {
+        user_segments.clear();
+        pending_index.clear();
+        unwritten.clear();
+        string data;
+        storage->load(indexTable(), data);
+        istringstream file(data);
+        string line;
+        size_t rejected = 0;
+        while (getline(file, line)) {
+            size_t bar = line.find('|');
+            int user_id;
+            string month = bar == string::npos ? "" : line.substr(bar + 1);
+            if (bar == string::npos || !parseNumber(string_view(line).substr(0, bar), user_id) || month.size() != 7 || month[4] != '-') {
+                rejected++;
+                continue;
+            }
+            user_segments[user_id].push_back(month);
+        }
+        // A month may be listed twice if an index append was retried, so duplicates are dropped
+        for (auto& pair : user_segments) {
+            sort(pair.second.begin(), pair.second.end());
+            pair.second.erase(unique(pair.second.begin(), pair.second.end()), pair.second.end());
+        }
+        if (rejected > 0) cout << "Skipped " << rejected << " unreadable lines in " << indexTable() << endl;
+    }
+
+    // Function to append new index lines to the index file; they stay pending if the append fails
+    bool flushIndex() {
+        if (pending_index.empty()) return true;
+        string lines;
+        for (const auto& entry : pending_index) {
+            lines += to_string(entry.first) + "|" + entry.second + "\n";
+        }
+        if (!storage->append(indexTable(), lines)) return false;
+        pending_index.clear();
+        return true;
+    }
+
+    // Function to parse one segment line: user_id|book_id|return_time|borrowed_time
+    static bool parseLine(string_view line, int& user_id, HistoryEntry& entry) {
+        const char* p = line.data();
+        const char* end = p + line.size();
+        auto field = [&p, end](auto& value) {
+            auto result = from_chars(p, end, value);
+            if (result.ec != errc()) return false;
+            p = result.ptr < end ? result.ptr + 1 : end;
+            return true;
+        };
+        if (!field(user_id) || !field(entry.book_id) || !field(entry.return_time)) return false;
+        if (!field(entry.borrowed_time)) entry.borrowed_time = 0;
+        return true;
+    }
+
+    // Function to call f(user_id, entry) for every readable line of some segment text
+    template <typename F>
+    static void forEachLine(string_view data, F f) {
+        int user_id;
+        HistoryEntry entry;
+        size_t begin = 0;
+        while (begin < data.size()) {
+            size_t end = data.find('\n', begin);
+            if (end == string_view::npos) end = data.size();
+            if (parseLine(data.substr(begin, end - begin), user_id, entry)) {
+                f(user_id, entry);
+            }
+            begin = end + 1;
+        }
+    }
+
+    // Function to call f(user_id, entry) for every line of a segment; the segment is read in one go
+    template <typename F>
+    void forEachInSegment(const string& month, F f) const {
+        string data;
+        if (!storage->load(segmentTable(month), data)) return;
+        forEachLine(data, f);
+    }
+
+    // Function to list the stored segments, oldest first
+    vector<string> segments() const {
+        vector<string> months;
+        for (const string& table : storage->list(directory + "/")) {
+            string name = table.substr(directory.size() + 1);
+            if (name.size() == 7 && name[4] == '-') {
+                months.push_back(name);
+            }
+        }
+        sort(months.begin(), months.end());
+        return months;
+    }
+
+    // Function to stream a user's entries from the segments that are not kept in memory
+    template <typename F>
+    void forEachArchived(int user_id, F f) const {
+        auto it = user_segments.find(user_id);
+        if (it == user_segments.end()) return;
+        for (const string& month : it->second) {
+            if (isEager(month)) break;
+            forEachInSegment(month, [&](int entry_user, const HistoryEntry& entry) {
+                if (entry_user == user_id) f(entry);
+            });
+        }
+    }
+};
+
+HistoryStore history_store;
+
+// HistoryRow: One (user, book, return time) history tuple as stored in the columnar archive
+struct HistoryRow {
+    long long return_time;
+    long long borrowed_time;  // 0 when unknown
+    int user_id;
+    int book_id;
+};
+
+// Function to append an unsigned LEB128 varint
+void putVarint(string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(char(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(char(value));
+}
+
+// Function to read an unsigned LEB128 varint and advance the cursor; false if it runs past end or 64 bits
+bool getVarint(const unsigned char*& p, const unsigned char* end, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        unsigned char byte = *p++;
+        value |= uint64_t(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+// Zigzag mapping so small negative deltas also encode in one or two bytes
+uint64_t zigzag(long long value) {
+    return (uint64_t(value) << 1) ^ uint64_t(value >> 63);
+}
+
+long long unzigzag(uint64_t value) {
+    return (long long)(value >> 1) ^ -(long long)(value & 1);
+}
+
+// BookRow: One row of the books table, a copy joined with its work's bibliographic record
+struct BookRow {
+    int book_id = 0;
+    string title, author, publisher, isbn;
+    int year = 0;
+    BookStatus status = BookStatus::Available;
+    int borrower_id = -1;
+    long long borrowed_time = 0;
+    bool is_reserved = false;
+    int reservation_id = -1;
+};
+
+// RecordFields: Compile-time list of the persisted members of each row type, in column order
+// Both serializers below are generated from these lists, so adding a column is a one-line change here.
+template <typename Record>
+struct RecordFields;
+
+template <>
+struct RecordFields<BookRow> {
+    static constexpr auto fields = make_tuple(&BookRow::book_id, &BookRow::title, &BookRow::author, &BookRow::publisher, &BookRow::isbn,
+                                              &BookRow::year, &BookRow::status, &BookRow::borrower_id, &BookRow::borrowed_time,
+                                              &BookRow::is_reserved, &BookRow::reservation_id);
+};
+
+template <>
+struct RecordFields<UserRecord> {
+    static constexpr auto fields = make_tuple(&UserRecord::user_id, &UserRecord::name, &UserRecord::email, &UserRecord::phone,
+                                              &UserRecord::role, &UserRecord::password);
+};
+
+template <>
+struct RecordFields<LoanRecord> {
+    static constexpr auto fields = make_tuple(&LoanRecord::user_id, &LoanRecord::book_id, &LoanRecord::time);
+};
+
+// History segments are written with these columns; HistoryStore::parseLine also accepts rows without borrowed_time
+template <>
+struct RecordFields<HistoryRow> {
+    static constexpr auto fields = make_tuple(&HistoryRow::user_id, &HistoryRow::book_id, &HistoryRow::return_time, &HistoryRow::borrowed_time);
+};
+
+// Function to call f(member pointer) for every field of a record type, in column order
+template <typename Record, typename F>
+void forEachField(F&& f) {
+    apply([&f](auto... members) { (f(members), ...); }, RecordFields<Record>::fields);
+}
+
+// TextCodec: Pipe-delimited rows, one per line ("1|Title|...|-1\n")
+// Numbers go through to_chars/from_chars; a trailing '\r' is ignored and lines starting with '#' are skipped.
+struct TextCodec {
+    template <typename T>
+    static void put(string& out, const T& value) {
+        char digits[24];
+        out.append(digits, to_chars(digits, digits + sizeof(digits), value).ptr);
+    }
+    static void put(string& out, const string& value) { out += value; }
+    static void put(string& out, bool value) { out += value ? '1' : '0'; }
+    static void put(string& out, BookStatus value) { out += statusName(value); }
+
+    template <typename T>
+    static bool get(string_view text, T& value) {
+        auto result = from_chars(text.data(), text.data() + text.size(), value);
+        return result.ec == errc() && result.ptr == text.data() + text.size();
+    }
+    static bool get(string_view text, string& value) { value.assign(text.data(), text.size()); return true; }
+    static bool get(string_view text, bool& value) { value = text == "1"; return true; }
+    static bool get(string_view text, BookStatus& value) { value = text == "Borrowed" ? BookStatus::Borrowed : BookStatus::Available; return true; }
+
+    template <typename Record>
+    static void write(string& out, const Record& row) {
+        bool first = true;
+        forEachField<Record>([&](auto member) {
+            if (!first) out += '|';
+            first = false;
+            put(out, row.*member);
+        });
+        out += '\n';
+    }
+
+    // Function to read the next row; false at the end of the data. Malformed lines are skipped.
+    template <typename Record>
+    static bool read(string_view& in, Record& row) {
+        while (!in.empty()) {
+            size_t end = in.find('\n');
+            string_view line = in.substr(0, end);
+            in.remove_prefix(end == string_view::npos ? in.size() : end + 1);
+            if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+            if (line.empty() || line[0] == '#') continue;
+            bool ok = true;
+            forEachField<Record>([&](auto member) {
+                size_t bar = line.find('|');
+                ok = ok && get(line.substr(0, bar), row.*member);
+                line.remove_prefix(bar == string_view::npos ? line.size() : bar + 1);
+            });
+            if (ok) return true;
+        }
+        return false;
+    }
+};
+
+// BinaryCodec: Compact rows for the memory and journal backends, after a 4-byte "LRB1" header
+// Integers are zigzag varints, strings a varint length followed by the bytes, bools and statuses one byte.
+struct BinaryCodec {
+    static constexpr char MAGIC[4] = {'L', 'R', 'B', '1'};
+
+    template <typename T>
+    static void put(string& out, const T& value) { putVarint(out, zigzag(value)); }
+    static void put(string& out, const string& value) { putVarint(out, value.size()); out += value; }
+    static void put(string& out, bool value) { out += char(value); }
+    static void put(string& out, BookStatus value) { out += char(value); }
+
+    static bool varint(string_view& in, uint64_t& value) {
+        value = 0;
+        for (int shift = 0; !in.empty() && shift < 64; shift += 7) {
+            unsigned char byte = in.front();
+            in.remove_prefix(1);
+            value |= uint64_t(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) return true;
+        }
+        return false;
+    }
+    template <typename T>
+    static bool get(string_view& in, T& value) {
+        uint64_t raw;
+        if (!varint(in, raw)) return false;
+        value = T(unzigzag(raw));
+        return true;
+    }
+    static bool get(string_view& in, string& value) {
+        uint64_t size;
+        if (!varint(in, size) || size > in.size()) return false;
+        value.assign(in.data(), size);
+        in.remove_prefix(size);
+        return true;
+    }
+    static bool get(string_view& in, bool& value) {
+        if (in.empty()) return false;
+        value = in.front() != 0;
+        in.remove_prefix(1);
+        return true;
+    }
+    static bool get(string_view& in, BookStatus& value) {
+        if (in.empty()) return false;
+        value = in.front() == char(BookStatus::Borrowed) ? BookStatus::Borrowed : BookStatus::Available;
+        in.remove_prefix(1);
+        return true;
+    }
+
+    template <typename Record>
+    static void write(string& out, const Record& row) {
+        if (out.empty()) out.append(MAGIC, sizeof(MAGIC));
+        forEachField<Record>([&](auto member) { put(out, row.*member); });
+    }
+
+    // Function to read the next row; false at the end of the data or at a truncated row
+    template <typename Record>
+    static bool read(string_view& in, Record& row) {
+        if (in.empty()) return false;
+        bool ok = true;
+        forEachField<Record>([&](auto member) { ok = ok && get(in, row.*member); });
+        return ok;
+    }
+};
+
+// Function to check whether a table blob was written by the binary codec
+inline bool isBinaryTable(string_view data) {
+    return data.size() >= 4 && data.compare(0, 4, string_view(BinaryCodec::MAGIC, 4)) == 0;
+}
+
+// Function to encode rows with either codec into one reusable buffer
+template <typename Record>
+void encodeRows(string& out, const vector<Record>& rows, bool binary) {
+    for (const Record& row : rows) {
+        if (binary) BinaryCodec::write(out, row);
+        else TextCodec::write(out, row);
+    }
+    if (binary && out.empty()) out.append(BinaryCodec::MAGIC, sizeof(BinaryCodec::MAGIC));
+}
+
+// Function to call f(row) for every row of a table blob, whichever codec wrote it
+// The same row object is reused for every call, so strings keep their capacity between rows.
+template <typename Record, typename F>
+void forEachRow(const string& data, F f) {
+    Record row;
+    string_view in(data);
+    if (isBinaryTable(in)) {
+        in.remove_prefix(sizeof(BinaryCodec::MAGIC));
+        while (BinaryCodec::read(in, row)) f(row);
+    } else {
+        while (TextCodec::read(in, row)) f(row);
+    }
+}
+
+// HistoryArchive Class: Columnar, compressed history file for analytics
+// Rows are sorted by return time and cut into blocks of BLOCK_ROWS. Each block stores a small header
+// (row count, min/max return time, min/max user id, payload size) followed by four varint columns:
+// return-time deltas, zigzag user-id deltas, zigzag book-id deltas and loan lengths (+1, 0 = unknown).
+// Scans read block headers first and skip the payload of blocks outside the requested time range.
+class HistoryArchive {
+public:
+    static constexpr uint32_t MAGIC = 0x31414c48;  // "HLA1"
+    static constexpr size_t BLOCK_ROWS = 65536;
+
+    struct BlockHeader {
+        uint32_t rows;
+        uint32_t payload_bytes;
+        long long min_time, max_time;
+        int min_user, max_user;
+    };
+
+    // Function to write sorted rows to an archive file; returns false if the file cannot be written
+    static bool write(const string& path, vector<HistoryRow>& rows) {
+        stable_sort(rows.begin(), rows.end(), [](const HistoryRow& a, const HistoryRow& b) { return a.return_time < b.return_time; });
+        ofstream file(path, ios::binary | ios::trunc);
+        if (!file) return false;
+        uint64_t total = rows.size();
+        file.write(reinterpret_cast<const char*>(&MAGIC), sizeof(MAGIC));
+        file.write(reinterpret_cast<const char*>(&total), sizeof(total));
+        string payload;
+        for (size_t begin = 0; begin < rows.size(); begin += BLOCK_ROWS) {
+            size_t end = min(rows.size(), begin + BLOCK_ROWS);
+            BlockHeader header{uint32_t(end - begin), 0, rows[begin].return_time, rows[end - 1].return_time, INT_MAX, INT_MIN};
+            payload.clear();
+            long long prev_time = 0;
+            for (size_t i = begin; i < end; i++) {
+                putVarint(payload, zigzag(rows[i].return_time - prev_time));
+                prev_time = rows[i].return_time;
+            }
+            int prev_user = 0;
+            for (size_t i = begin; i < end; i++) {
+                putVarint(payload, zigzag((long long)rows[i].user_id - prev_user));
+                prev_user = rows[i].user_id;
+                header.min_user = min(header.min_user, rows[i].user_id);
+                header.max_user = max(header.max_user, rows[i].user_id);
+            }
+            int prev_book = 0;
+            for (size_t i = begin; i < end; i++) {
+                putVarint(payload, zigzag((long long)rows[i].book_id - prev_book));
+                prev_book = rows[i].book_id;
+            }
+            for (size_t i = begin; i < end; i++) {
+                putVarint(payload, rows[i].borrowed_time > 0 ? zigzag(rows[i].return_time - rows[i].borrowed_time) + 1 : 0);
+            }
+            header.payload_bytes = payload.size();
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            file.write(payload.data(), payload.size());
+        }
+        return bool(file);
+    }
+
+    // Function to call f(row) for every row returned in [from, to]; returns false if the file is not an archive
+    // or a block is truncated or corrupt (rows of the blocks before it have already been passed to f).
+    // blocks_read and blocks_skipped report how much of the file the time range let the scan skip.
+    template <typename F>
+    static bool scan(const string& path, long long from, long long to, F f, size_t* blocks_read = nullptr, size_t* blocks_skipped = nullptr) {
+        ifstream file(path, ios::binary | ios::ate);
+        // seekg past the end does not fail, so a skipped block is checked against the file size instead
+        long long file_size = file ? (long long)file.tellg() : 0;
+        file.seekg(0);
+        uint32_t magic = 0;
+        uint64_t total = 0;
+        file.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+        file.read(reinterpret_cast<char*>(&total), sizeof(total));
+        if (!file || magic != MAGIC) return false;
+
+        BlockHeader header;
+        vector<unsigned char> payload;
+        vector<HistoryRow> block;
+        while (file.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+            // Every row takes at least one byte in each of the four columns
+            if (header.rows == 0 || header.rows > BLOCK_ROWS || header.payload_bytes < 4ull * header.rows) return false;
+            if (header.max_time < from || header.min_time > to) {
+                if ((long long)file.tellg() + header.payload_bytes > file_size) return false;
+                file.seekg(header.payload_bytes, ios::cur);
+                if (blocks_skipped) (*blocks_skipped)++;
+                continue;
+            }
+            if (blocks_read) (*blocks_read)++;
+            payload.resize(header.payload_bytes);
+            if (!file.read(reinterpret_cast<char*>(payload.data()), header.payload_bytes)) return false;
+            block.resize(header.rows);
+            const unsigned char* p = payload.data();
+            const unsigned char* end = p + payload.size();
+            uint64_t value;
+            long long time = 0;
+            for (auto& row : block) {
+                if (!getVarint(p, end, value)) return false;
+                time += unzigzag(value);
+                row.return_time = time;
+            }
+            long long user = 0;
+            for (auto& row : block) {
+                if (!getVarint(p, end, value)) return false;
+                user += unzigzag(value);
+                row.user_id = user;
+            }
+            long long book = 0;
+            for (auto& row : block) {
+                if (!getVarint(p, end, value)) return false;
+                book += unzigzag(value);
+                row.book_id = book;
+            }
+            for (auto& row : block) {
+                if (!getVarint(p, end, value)) return false;
+                row.borrowed_time = value == 0 ? 0 : row.return_time - unzigzag(value - 1);
+            }
+            if (p != end) return false;
+            for (const auto& row : block) {
+                if (row.return_time >= from && row.return_time <= to) f(row);
+            }
+        }
+        // A partial header left at the end means the file was cut short
+        return file.eof() && file.gcount() == 0;
+    }
+};
+
+// Function to read history rows from a pipe-delimited text file (borrowing_history.txt format)
+bool readHistoryText(const string& path, vector<HistoryRow>& rows) {
+    ifstream file(path);
+    if (!file) return false;
+    string line;
+    int user_id;
+    HistoryEntry entry;
+    while (getline(file, line)) {
+        if (HistoryStore::parseLine(line, user_id, entry)) {
+            rows.push_back({entry.return_time, entry.borrowed_time, user_id, entry.book_id});
+        }
+    }
+    return true;
+}
+
+// Function to read every history row from the monthly segments
+void readHistorySegments(vector<HistoryRow>& rows) {
+    for (const string& month : history_store.segments()) {
+        history_store.forEachInSegment(month, [&rows](int user_id, const HistoryEntry& entry) {
+            rows.push_back({entry.return_time, entry.borrowed_time, user_id, entry.book_id});
+        });
+    }
+}
+
+// Function to export history (a text file, or all segments when source is empty) to a columnar archive
+bool exportHistoryArchive(const string& source, const string& archive_path) {
+    auto start = chrono::steady_clock::now();
+    vector<HistoryRow> rows;
+    if (source.empty()) {
+        readHistorySegments(rows);
+    } else if (!readHistoryText(source, rows)) {
+        cout << "Cannot open " << source << endl;
+        return false;
+    }
+    if (!HistoryArchive::write(archive_path, rows)) {
+        cout << "Cannot write " << archive_path << endl;
+        return false;
+    }
+    auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+    error_code ec;
+    cout << "Exported " << rows.size() << " history rows to " << archive_path << " (" << filesystem::file_size(archive_path, ec) << " bytes) in " << elapsed << " ms" << endl;
+    return true;
+}
+
+// Function to import a columnar archive back into the pipe-delimited text format
+// Rows go to text_path.tmp, which replaces text_path only once the whole archive has decoded cleanly.
+bool importHistoryArchive(const string& archive_path, const string& text_path) {
+    string temp = text_path + ".tmp";
+    ofstream file(temp, ios::binary | ios::trunc);
+    if (!file) {
+        cout << "Cannot write " << temp << endl;
+        return false;
+    }
+    size_t count = 0;
+    bool ok = HistoryArchive::scan(archive_path, LLONG_MIN, LLONG_MAX, [&](const HistoryRow& row) {
+        file << row.user_id << "|" << row.book_id << "|" << row.return_time << "|" << row.borrowed_time << "\n";
+        count++;
+    });
+    file.close();
+    error_code ec;
+    if (!ok || !file) {
+        filesystem::remove(temp, ec);
+        cout << (ok ? "Cannot write " + temp : archive_path + " is not a valid history archive; " + text_path + " was left unchanged") << endl;
+        return false;
+    }
+    filesystem::rename(temp, text_path, ec);
+    if (ec) {
+        cout << "Could not replace " << text_path << ": " << ec.message() << endl;
+        return false;
+    }
+    cout << "Imported " << count << " history rows into " << text_path << endl;
+    return true;
+}
+
+// FineEntry: One row of the fine ledger; a positive amount is a fine charged for a late return (book_id is the
+// book returned), a negative amount is a payment (book_id is -1)
+struct FineEntry {
+    int user_id = 0;
+    int book_id = -1;
+    long long time = 0;
+    long long amount = 0;
+};
+
+template <>
+struct RecordFields<FineEntry> {
+    static constexpr auto fields = make_tuple(&FineEntry::user_id, &FineEntry::book_id, &FineEntry::time, &FineEntry::amount);
+};
+
+// FineBalance: A user's running balance as checkpointed in the fine_balances table
+struct FineBalance {
+    int user_id = 0;
+    long long balance = 0;
+};
+
+template <>
+struct RecordFields<FineBalance> {
+    static constexpr auto fields = make_tuple(&FineBalance::user_id, &FineBalance::balance);
+};
+
+// FineLedger Class: Append-only record of every fine charged and paid
+// Rows go to monthly segments fines/YYYY-MM, like the borrowing history, and are never rewritten. Each
+// Account::prev_fine is the cached running balance of its rows, so balance queries stay O(1); the balances are
+// checkpointed to fine_balances on every save and rebuilt from the segments only if that table is missing.
+class FineLedger {
+public:
+    string directory = "fines";
+    map<string, string> pending;  // rows not yet appended, by month, as text rows
+    size_t pending_rows = 0;
+
+    string segmentTable(const string& month) const {
+        return directory + "/" + month;
+    }
+
+    // Function to add a row; it reaches storage with the next save
+    void record(const FineEntry& entry) {
+        TextCodec::write(pending[HistoryStore::monthOf(entry.time)], entry);
+        pending_rows++;
+    }
+
+    // Function to hand the unsaved rows to a save, leaving none pending
+    map<string, string> takePending() {
+        map<string, string> rows;
+        rows.swap(pending);
+        pending_rows = 0;
+        return rows;
+    }
+
+    // Function to put rows whose append failed back ahead of the rows recorded since
+    void requeue(const map<string, string>& rows) {
+        for (const auto& month : rows) {
+            pending[month.first].insert(0, month.second);
+            pending_rows += count(month.second.begin(), month.second.end(), '\n');
+        }
+    }
+
+    // Function to list the months with rows, stored or pending, in order
+    vector<string> months() const {
+        vector<string> result;
+        for (const string& table : storage->list(directory + "/")) result.push_back(table.substr(directory.size() + 1));
+        for (const auto& month : pending) result.push_back(month.first);
+        sort(result.begin(), result.end());
+        result.erase(unique(result.begin(), result.end()), result.end());
+        return result;
+    }
+
+    // Function to call f(row) for every row in order, one month in memory at a time
+    template <typename F>
+    void forEachEntry(F f) const {
+        string data;
+        for (const string& month : months()) {
+            if (storage->load(segmentTable(month), data)) forEachRow<FineEntry>(data, f);
+            auto it = pending.find(month);
+            if (it != pending.end()) forEachRow<FineEntry>(it->second, f);
+        }
+    }
+};
+
+FineLedger fine_ledger;
+
+// Function to append ledger rows to their monthly segments
+// Written months are removed from segments, so after a failure it holds only the rows still to save.
+bool appendFineLedger(map<string, string>& segments) {
+    for (auto it = segments.begin(); it != segments.end(); it = segments.erase(it)) {
+        if (!storage->append(fine_ledger.segmentTable(it->first), it->second)) return false;
+    }
+    return true;
+}
+
+/* 
+Account Class: Manages user's borrowed books, history, and fines
+*/
+class Account {
+public:
+    int user_id;
+    vector<int> borrowed_books;
+    unordered_map<int, long long> borrowed_time;
+    vector<HistoryEntry> borrowing_history;  // entries from the eager segments and this session
+    size_t saved_history = 0;                // leading entries already written to a segment
+    int prev_fine = 0;
+    unordered_map<int, long long> reserved_books;
+
+
+    Account(int user_id) {
+        this->user_id = user_id;
+    }
+
+    // Function to view books currently borrowed, with the due date of each loan when the loan period is given
+    void view_books(int loan_period = 0) {
+        if (borrowed_books.empty()) {
+            cout << "No books currently borrowed" << endl;
+            return;
+        }
+        cout << "\nCurrently Borrowed Books:" << endl;
+        for (int book_id : borrowed_books) {
+            Book* book = getBook(book_id);
+            if (book) {
+                Library::displayBook(book);
+                if (loan_period > 0) {
+                    cout << "Due on: " << formatDay(calendar.dueDay(borrowed_time[book_id], loan_period)) << endl;
+                }
+            }
+        }
+    }
+
+    // Function to view reserved books
+    void view_reserved_books() {
+        if (reserved_books.empty()) {
+            cout << "No books currently reserved" << endl;
+            return;
+        }
+        cout << "\nCurrently Reserved Books:" << endl;
+        for (const auto& pair : reserved_books) {
+            int book_id = pair.first;
+            Book* book = getBook(book_id);
+            if (book) {
+                Library::displayBook(book);
+            }
+        }
+    }
+
+    // Function to cancel a reservation
+    bool cancel_reservation(int book_id) {
+        if (reserved_books.find(book_id) != reserved_books.end()) {
+            reserved_books.erase(book_id);
+            return true;
+        }
+        return false;
+    }
+
+    // Function to check fine
+    int check_fine() {
+        long long current_time = getCurrentTime();
+        int curr_fine = 0;
+        for (auto& pair : borrowed_time) {
+            long long late = calendar.daysLate(pair.second, current_time, 15);
+            if (late > 0) {
+                curr_fine += 10 * late;
+            }
+        }
+        return curr_fine;
+    }
+
+    // Function to charge a fine for a late return, recording it in the ledger
+    void charge_fine(int book_id, int amount, long long time) {
+        prev_fine += amount;
+        fine_ledger.record({user_id, book_id, time, amount});
+    }
+
+    // Function to pay fine, recording the payment in the ledger
+    void pay_fine() {
+        if (prev_fine > 0) fine_ledger.record({user_id, -1, getCurrentTime(), -(long long)prev_fine});
+        prev_fine = 0;
+        cout << "Fine paid successfully" << endl;
+    }
+
+    // Function to check if the user has overdue books
+    bool hasOverdue(int limit) {
+        TraceSpan span("hasOverdue", user_id);
+        long long current_time = getCurrentTime();
+        int flag = 0;
+        for (auto& p: borrowed_time) {
+            int book_id = p.first;
+            long long borrow_time = p.second;
+            long long amount = calendar.daysLate(borrow_time, current_time, limit);
+            if (amount > 0) {
+                Book* book = getBook(book_id);
+                cout<<"Overdue book: "<<book_id<<" "<<(book ? getWork(book->work_id)->title : "")<<" by "<<amount<<"days!!"<<endl;
+                flag=1;
+            }
+        }
+        if(flag==1){
+            return true;
+        }
+        return false;
+    }
+
+    // Function to display one history entry; the book may since have left the catalog
+    static void displayHistoryEntry(const HistoryEntry& entry) {
+        Book* book = getBook(entry.book_id);
+        if (book) {
+            Library::displayBook(book, true, entry.return_time);
+        } else {
+            time_t timestamp = entry.return_time;
+            cout << "----------------------------------------" << endl;
+            cout << "Book ID: " << entry.book_id << " (no longer in the library)" << endl;
+            cout << "Returned on: " << ctime(&timestamp);
+            cout << "----------------------------------------" << endl;
+        }
+    }
+
+    // Function to view borrowing history, streaming older months from disk before the recent ones in memory
+    void view_borrowing_history() {
+        bool found = false;
+        history_store.forEachArchived(user_id, [&found](const HistoryEntry& entry) {
+            if (!found) cout << "\nBorrowing History:" << endl;
+            found = true;
+            displayHistoryEntry(entry);
+        });
+        if (!found && borrowing_history.empty()) {
+            cout << "No borrowing history" << endl;
+            return;
+        }
+        if (!found) cout << "\nBorrowing History:" << endl;
+        for (const auto& entry : borrowing_history) {
+            displayHistoryEntry(entry);
+        }
+    }
+
+    // Function to add a book to borrowing history
+    void add_borrowing_history(int book_id, long long borrowed_time, long long return_time) {
+        borrowing_history.push_back({book_id, return_time, borrowed_time});
+    }
+
+    // Friend Functions
+    friend void saveBorrowingHistory();
+    friend void loadBorrowingHistory();
+    friend void loadcurrentlyborrowed();
+    friend void savecurrentlyborrowed();
+};
+
+
+// User Class: Base class for all user types with common functionality
+class User : public Library {
+private:
+    string password = "password"; // Default password
+protected:
+    int user_id;
+    string email, phone, role;
+    Account account;
+
+public:
+    string name;
+    User(int user_id, string name, string email, string phone, string role, string password = "password") 
+        : account(user_id) {
+        this->user_id = user_id;
+        this->name = name;
+        this->email = email;
+        this->phone = phone;
+        this->role = role;
+        this->password = password;
+    }
+
+    virtual void borrowBook(int book_id) = 0;
+    virtual void returnBook(int book_id) = 0;
+
+    // Loan rules of the role: books allowed at once, days before a loan is overdue, and whether late returns and
+    // unpaid fines are charged. A limit of 0 means the role cannot borrow.
+    virtual int loanLimit() const { return 0; }
+    virtual int loanDays() const { return 0; }
+    virtual bool paysLateFines() const { return false; }
+
+    // Function to borrow several books as one transaction: either every copy is issued or none is
+    // The limit, overdue loans and unpaid fine are checked once for the whole set, and a copy that is out is
+    // replaced by a free copy of the same title. A title the account already has on loan, or one asked for
+    // twice, refuses the checkout. Returns the ids issued, empty if the checkout was refused.
+    vector<int> checkoutBooks(const vector<int>& book_ids) {
+        ScopedMetric metric(MetricOp::Borrow, user_id);
+        RecordedOp recorded(SessionOp::Checkout, user_id);
+        if (recorded.active) recorded.record.text = joinIds(book_ids);
+        VersionedWrite write(user_id);
+        if (loanLimit() == 0) {
+            cout << "Librarians cannot borrow books." << endl;
+            return {};
+        }
+        if (book_ids.empty()) {
+            cout << "No books requested" << endl;
+            return {};
+        }
+        if (account.borrowed_books.size() + book_ids.size() > (size_t)loanLimit()) {
+            cout << "Limit reached: " << loanLimit() << " books (" << account.borrowed_books.size() << " already borrowed)" << endl;
+            return {};
+        }
+        if (account.hasOverdue(loanDays())) {
+            cout << "Overdue books detected" << endl;
+            return {};
+        }
+        if (paysLateFines() && account.prev_fine > 0) {
+            cout << "Pending fine detected" << endl;
+            return {};
+        }
+
+        // Validate: pick one copy per requested title before anything changes
+        vector<Book*> picked;
+        picked.reserve(book_ids.size());
+        for (int book_id : book_ids) {
+            Book* book = getBook(book_id);
+            if (!book) {
+                cout << "Book " << book_id << " not found; no books were issued" << endl;
+                return {};
+            }
+            if (hasTitleOnLoan(book->work_id)) {
+                cout << "You already have a copy of book " << book_id << "; no books were issued" << endl;
+                return {};
+            }
+            for (const Book* other : picked) {
+                if (other->work_id == book->work_id) {
+                    cout << "Book " << book_id << " is a copy of a title already requested; no books were issued" << endl;
+                    return {};
+                }
+            }
+            if (book->status != BookStatus::Available || (book->is_reserved && book->reservation_id != user_id)) {
+                Book* copy = findFreeCopy(book->work_id);
+                if (!copy) {
+                    cout << "Book " << book_id << " is not available; no books were issued" << endl;
+                    return {};
+                }
+                cout << "Copy " << book_id << " is not available, issuing copy " << copy->book_id << " of the same title" << endl;
+                book = copy;
+            }
+            picked.push_back(book);
+        }
+
+        // Apply: every check has passed, so each picked copy is lent without any further refusal
+        long long now = getCurrentTime();
+        vector<int> issued;
+        issued.reserve(picked.size());
+        account.borrowed_books.reserve(account.borrowed_books.size() + picked.size());
+        for (Book* book : picked) {
+            book->status = BookStatus::Borrowed;
+            book->borrower_id = user_id;
+            book->borrowed_time = now;
+            book->is_reserved = false;
+            book->reservation_id = -1;
+            account.borrowed_books.push_back(book->book_id);
+            account.borrowed_time[book->book_id] = now;
+            account.reserved_books.erase(book->book_id);
+            syncBookState(book);
+            issued.push_back(book->book_id);
+        }
+        if (recorded.active) recorded.record.lent = joinIds(issued);
+        cout << issued.size() << " books borrowed successfully" << endl;
+        for (Book* book : picked) Library::displayBook(book);
+        return issued;
+    }
+
+    // Function to return several books as one transaction: either every book is returned or none is
+    // Each late book gets its own ledger charge once every book is back. Returns false if the return was refused.
+    bool returnBooks(const vector<int>& book_ids) {
+        ScopedMetric metric(MetricOp::Return, user_id);
+        RecordedOp recorded(SessionOp::ReturnBatch, user_id);
+        if (recorded.active) recorded.record.text = joinIds(book_ids);
+        VersionedWrite write(user_id);
+        if (loanLimit() == 0) {
+            cout << "Librarians cannot return books." << endl;
+            return false;
+        }
+        if (book_ids.empty()) {
+            cout << "No books given" << endl;
+            return false;
+        }
+        // Validate: every id must be a distinct copy on loan to this account before anything changes
+        vector<Book*> picked;
+        picked.reserve(book_ids.size());
+        for (int book_id : book_ids) {
+            Book* book = getBook(book_id);
+            if (!book || book->borrower_id != user_id || find(picked.begin(), picked.end(), book) != picked.end()) {
+                cout << "Invalid return request for book " << book_id << "; no books were returned" << endl;
+                return false;
+            }
+            picked.push_back(book);
+        }
+
+        // Apply: every check has passed, so each copy goes back without any further refusal
+        vector<pair<int, int>> fines;  // (book id, amount)
+        int fine = 0;
+        long long now = getCurrentTime();
+        for (Book* book : picked) {
+            long long borrowed = account.borrowed_time[book->book_id];
+            account.add_borrowing_history(book->book_id, borrowed, now);
+            book->status = BookStatus::Available;
+            book->borrower_id = -1;
+            syncBookState(book);
+            account.borrowed_books.erase(remove(account.borrowed_books.begin(), account.borrowed_books.end(), book->book_id), account.borrowed_books.end());
+            account.borrowed_time.erase(book->book_id);
+            long long extra_days = calendar.daysLate(borrowed, now, loanDays());
+            if (paysLateFines() && extra_days > 0) {
+                fines.push_back({book->book_id, int(10 * extra_days)});
+                fine += 10 * extra_days;
+            }
+        }
+        for (const auto& charge : fines) account.charge_fine(charge.first, charge.second, now);
+        if (fine > 0) {
+            cout << picked.size() << " books returned with fine: " << fine << endl;
+        } else {
+            cout << picked.size() << " books returned successfully" << endl;
+        }
+        return true;
+    }
+
+    // Function to check if the user id and password are correct
+    bool check_credentials(int user_id, string password) {
+        return this->user_id == user_id && this->password == password;
+    }
+
+    // Function to change password
+    void changePassword(string new_password) {
+        VersionedWrite write(user_id);
+        password = new_password;
+    }
+    
+    // Function to check fine
+    int check_fine(){
+        return account.check_fine();
+    }
+
+    // Function to pay fine
+    void payFine() {
+        RecordedOp recorded(SessionOp::PayFine, user_id);
+        VersionedWrite write(user_id);
+        account.pay_fine();
+    }
+
+    // Function to cancel the user's reservation of a book; false if the user does not hold one
+    bool cancelReservation(int book_id) {
+        RecordedOp recorded(SessionOp::Cancel, user_id, book_id);
+        VersionedWrite write(user_id);
+        if (!account.cancel_reservation(book_id)) return false;
+        Book* book = getBook(book_id);
+        if (!book || book->reservation_id != user_id) return false;
+        book->is_reserved = false;
+        book->reservation_id = -1;
+        syncBookState(book);
+        return true;
+    }
+    
+    //Function to view password
+    string view_password(){
+        return password;
+    }
+
+    // Function to view books currently borrowed
+    void view_books(){
+        account.view_books(loanDays());
+    }
+    
+    // Function to view borrowing history
+    void view_borrowing_history(){
+        account.view_borrowing_history();
+    }
+    
+    // Function to check if the user has overdue books
+    bool checkOverdue(int limit){
+        if(account.hasOverdue(limit)){
+           return true;
+        }
+        return false;
+    }
+
+    // Function to check if user has any borrowed books
+    bool hasBorrowedBooks() const {
+        return !account.borrowed_books.empty();
+    }
+
+    // Function to check if user already has a copy of a title on loan
+    bool hasTitleOnLoan(int work_id) const {
+        for (int book_id : account.borrowed_books) {
+            Book* book = getBook(book_id);
+            if (book && book->work_id == work_id) return true;
+        }
+        return false;
+    }
+
+    // Function to copy out the fields saved in the user tables
+    UserRecord record() const {
+        return {user_id, name, email, phone, role, password};
+    }
+
+    // Function to summarise the account for the session log: loans in bits 0-7, reservations in bits 8-23, then
+    // whether book_id is lent to (bit 24) or reserved for (bit 25) this user
+    long long sessionState(int book_id) const {
+        long long state = min<size_t>(account.borrowed_books.size(), 0xFF) | min<size_t>(account.reserved_books.size(), 0xFFFF) << 8;
+        Book* book = book_id >= 0 ? getBook(book_id) : nullptr;
+        if (book && book->borrower_id == user_id) state |= 1LL << 24;
+        if (book && book->is_reserved && book->reservation_id == user_id) state |= 1LL << 25;
+        return state;
+    }
+
+    int fineBalance() const {
+        return account.prev_fine;
+    }
+
+    // Function to copy out what the reports show of this account
+    AccountVersion accountVersion() const {
+        return {nullptr, (int)account.borrowed_books.size(), (int)account.reserved_books.size(), account.prev_fine, true};
+    }
+
+    // Function to copy out the user's current loans and reservations
+    void collectLoans(vector<LoanRecord>& loans, vector<LoanRecord>& reservations) const {
+        for (int book_id : account.borrowed_books) {
+            auto it = account.borrowed_time.find(book_id);
+            loans.push_back({user_id, book_id, it != account.borrowed_time.end() ? it->second : 0});
+        }
+        for (const auto& reserved : account.reserved_books) {
+            reservations.push_back({user_id, reserved.first, reserved.second});
+        }
+    }
+
+    // Friend Functions
+    friend void addBook(int book_id, const Work& details);
+    friend void addstudent(Student* user);
+    friend void addFaculty(Faculty* user);
+    friend void addLibrarian(Librarian* user);
+    friend void removeBook(int book_id);
+    friend void removeStudent(int user_id);
+    friend void removeFaculty(int user_id);
+    friend void removeLibrarian(int user_id);
+    friend void studentreserveBook(int book_id, Student* user);
+    friend void studentcancelReservation(int book_id, Student* user);
+    friend void facultyreserveBook(int book_id, Faculty* user);
+    friend void facultycancelReservation(int book_id, Faculty* user);
+    friend void saveBooks();
+    friend void loadBooks();
+    friend void saveStudents();
+    friend void loadStudents();
+    friend void saveFaculties();
+    friend void loadFaculties();
+    friend void saveLibrarians();
+    friend void loadLibrarians();
+    friend void saveBorrowingHistory();
+    friend void loadBorrowingHistory();
+    friend void loadcurrentlyborrowed();
+    friend void savecurrentlyborrowed();
+    friend Book* getBook(int book_id);
+    friend Student* getStudent(int user_id);
+    friend Faculty* getFaculty(int user_id);
+    friend Librarian* getLibrarian(int user_id);
+    friend void saveReservedBooks();
+    friend void loadReservedBooks();
+    friend CirculationStats computeCirculationStats();
+    friend LibrarySnapshot takeSnapshot();
+    friend vector<FineBalance> fineBalances();
+    friend void loadFineLedger();
+    friend class ShardedEngine;
+    friend class IntegrityChecker;
+
+    // AVirtual Mwthod Defined to Display User Details
+    virtual void displayUserDetails() {
+        printUserRecord(record());
+    }
+
+    // Function to print the details box of a user record
+    static void printUserRecord(const UserRecord& record) {
+        cout << "\n+-------------------------------------------+" << endl;
+        cout << "| User Details                              |" << endl;
+        cout << "+-------------------------------------------+" << endl;
+        cout << "User ID: " << record.user_id << endl;
+        cout << "Name: " << record.name << endl;
+        cout << "Email: " << record.email << endl;
+        cout << "Phone: " << record.phone << endl;
+        cout << "Role: " << record.role << endl;
+        cout << "+-------------------------------------------+" << endl;
+    }
+};
+
+// Class to represent a student. It contains a user id, name, email, phone, role, password and an account.
+class Student : public User {
+public:
+    int roll_number;  // Add roll number attribute as specific to this class
+    Student(int user_id, string name, string email, string phone, int roll_number, string password = "password") 
+        : User(user_id, name, email, phone, "Student", password), roll_number(roll_number) {}
+
+    int loanLimit() const override { return 3; }
+    int loanDays() const override { return 15; }
+    bool paysLateFines() const override { return true; }
+
+    // Function to borrow a book    
+    void borrowBook(int book_id) override {
+        ScopedMetric metric(MetricOp::Borrow, user_id, book_id);
+        RecordedOp recorded(SessionOp::Borrow, user_id, book_id);
+        VersionedWrite write(user_id);
+        Book* book = getBook(book_id);
+
+        // Check if the book exists
+        if (!book) {
+            cout << "Book not found" << endl;
+            return;
+        }
+
+        // Check if the student has already borrowed this book or another copy of its title
+        if (hasTitleOnLoan(book->work_id)) {
+            cout << "You already have this book." << endl;
+            return;
+        }
+
+        // Another copy of the same title may be free even if the requested one is not
+        if (book->status != BookStatus::Available || (book->is_reserved && book->reservation_id != user_id)) {
+            Book* copy = findFreeCopy(book->work_id);
+            if (copy) {
+                cout << "Copy " << book_id << " is not available, issuing copy " << copy->book_id << " of the same title" << endl;
+                book = copy;
+                book_id = copy->book_id;
+            }
+        }
+
+        // Check if the student has borrowed 3 books
+        if (account.borrowed_books.size() >= 3) {
+            cout << "Limit reached: 3 books" << endl;
+            return;
+        }
+
+        // Check if the student has overdue books
+        if (account.hasOverdue(15)) {
+            cout << "Overdue books detected" << endl;
+            return;
+        }
+        
+        // Check if the student has pending fine
+        if (account.prev_fine > 0) {
+            cout << "Pending fine detected" << endl;
+            return;
+        }
+
+        // Check if the book is available
+        if (book->status == BookStatus::Available) {
+            // Check if the book is reserved by the same user or not reserved
+            if ((book->is_reserved && book->reservation_id == user_id) || !book->is_reserved) {
+                book->status = BookStatus::Borrowed;
+                book->borrower_id = user_id;
+                book->borrowed_time = getCurrentTime();
+                account.borrowed_books.push_back(book_id);
+                account.borrowed_time[book_id] = getCurrentTime();
+                cout << "Book borrowed successfully" << endl;
+                // Clear reservation
+                book->is_reserved = false;
+                book->reservation_id = -1;
+                account.reserved_books.erase(book_id);
+                syncBookState(book);
+                if (recorded.active) recorded.record.lent = to_string(book_id);
+                Library::displayBook(book);                
+            } else if (book->is_reserved) {
+                cout << "Book is already reserved by another user." << endl;
+            } else {
+                cout << "Book is available but not reserved by you." << endl;
+            }
+        } else if (book->status == BookStatus::Borrowed) {
+            if (book->is_reserved) {
+                cout << "Book is already reserved by another user." << endl;
+            } else {
+                cout << "Book is currently borrowed. Would you like to reserve it? (yes/no)" << endl;
+                string response;
+                cin >> response;
+                if (response == "yes") {
+                    // The reservation is its own operation; the borrow is logged first, without it
+                    recorded.finish();
+                    studentreserveBook(book_id, this);
+                }
+            }
+        } else {
+            cout << "Book is not available" << endl;
+        }
+    }
+
+    // Function to return a book
+    void returnBook(int book_id) override {
+        ScopedMetric metric(MetricOp::Return, user_id, book_id);
+        RecordedOp recorded(SessionOp::Return, user_id, book_id);
+        VersionedWrite write(user_id);
+        Book* book = getBook(book_id);
+
+        // Check if the book exists and is borrowed by the student
+        if (!book || book->borrower_id != user_id) {
+            cout << "Invalid return request" << endl;
+            return;
+        }
+
+        account.add_borrowing_history(book_id, account.borrowed_time[book_id], getCurrentTime());
+        book->status = BookStatus::Available;
+        book->borrower_id = -1;
+        syncBookState(book);
+        account.borrowed_books.erase(remove(account.borrowed_books.begin(), account.borrowed_books.end(), book_id), account.borrowed_books.end());
+
+        // Calculate fine if the book is returned after 15 open days
+        long long extra_days = calendar.daysLate(account.borrowed_time[book_id], getCurrentTime(), 15);
+        if (extra_days > 0) {
+            account.charge_fine(book_id, 10 * extra_days, getCurrentTime());
+            cout << "Returned with fine: " << 10 * extra_days << endl;
+        } else {
+            cout << "Book returned successfully" << endl;
+        }
+        account.borrowed_time.erase(book_id);
+    }
+
+    void displayUserDetails() override {
+        User::displayUserDetails();
+        cout << "Books Currently Borrowed: " << account.borrowed_books.size() << "/3" << endl;
+        cout << "Current Fine: $" << check_fine() << endl;
+        cout << "+-------------------------------------------+" << endl;
+    }
+
+    void cancelReservation() {
+        account.view_reserved_books();
+        if (account.reserved_books.empty()) {
+            return;
+        }
+        cout << "Enter book ID to cancel reservation: ";
+        int book_id;
+        cin >> book_id;
+        if (User::cancelReservation(book_id)) {
+            cout << "Reservation cancelled successfully" << endl;
+        } else {
+            cout << "Invalid book ID or reservation not found" << endl;
+        }
+    }
+};
+
+// Class to represent a faculty. It contains a user id, name, email, phone, role, password and an account.
+class Faculty : public User {
+public:
+    Faculty(int user_id, string name, string email, string phone, string password = "password") 
+        : User(user_id, name, email, phone, "Faculty",password) {}
+
+    int loanLimit() const override { return 5; }
+    int loanDays() const override { return 60; }
+
+    // Function to borrow a book
+    void borrowBook(int book_id) override {
+        ScopedMetric metric(MetricOp::Borrow, user_id, book_id);
+        RecordedOp recorded(SessionOp::Borrow, user_id, book_id);
+        VersionedWrite write(user_id);
+        Book* book = getBook(book_id);
+
+        // Check if the book exists
+        if (!book) {
+            cout << "Book not found" << endl;
+            return;
+        }
+
+        // Check if the faculty has already borrowed this book or another copy of its title
+        if (hasTitleOnLoan(book->work_id)) {
+            cout << "You already have this book." << endl;
+            return;
+        }
+
+        // Another copy of the same title may be free even if the requested one is not
+        if (book->status != BookStatus::Available || (book->is_reserved && book->reservation_id != user_id)) {
+            Book* copy = findFreeCopy(book->work_id);
+            if (copy) {
+                cout << "Copy " << book_id << " is not available, issuing copy " << copy->book_id << " of the same title" << endl;
+                book = copy;
+                book_id = copy->book_id;
+            }
+        }
+
+        // Check if the faculty has borrowed 5 books
+        if (account.borrowed_books.size() >= 5) {
+            cout << "Limit reached: 5 books" << endl;
+            return;
+        }
+
+        // Check if the faculty has overdue books
+        if (account.hasOverdue(60)) {
+            cout << "Overdue books detected" << endl;
+            return;
+        }
+
+        // Check if the book is available
+        if (book->status == BookStatus::Available) {
+            // Check if the book is reserved by the same user
+            if ((book->is_reserved && book->reservation_id == user_id) || !book->is_reserved) {
+                book->status = BookStatus::Borrowed;
+                book->borrower_id = user_id;
+                book->borrowed_time = getCurrentTime();
+                account.borrowed_books.push_back(book_id);
+                account.borrowed_time[book_id] = getCurrentTime();
+                cout << "Book borrowed successfully" << endl;
+                // Clear reservation
+                book->is_reserved = false;
+                book->reservation_id = -1;
+                account.reserved_books.erase(book_id);
+                syncBookState(book);
+                if (recorded.active) recorded.record.lent = to_string(book_id);
+                Library::displayBook(book);
+            } else if (book->is_reserved) {
+                cout << "Book is already reserved by another user." << endl;
+            } else {
+                cout << "Book is available but not reserved by you." << endl;
+            }
+        } else if (book->status == BookStatus::Borrowed) {
+            if (book->is_reserved) {
+                cout << "Book is already reserved by another user." << endl;
+            } else {
+                cout << "Book is currently borrowed. Would you like to reserve it? (yes/no)" << endl;
+                string response;
+                cin >> response;
+                if (response == "yes") {
+                    // The reservation is its own operation; the borrow is logged first, without it
+                    recorded.finish();
+                    facultyreserveBook(book_id, this);
+                }
+            }
+        } else {
+            cout << "Book is not available" << endl;
+        }
+    }
+
+    // Function to return a book
+    void returnBook(int book_id) override {
+        ScopedMetric metric(MetricOp::Return, user_id, book_id);
+        RecordedOp recorded(SessionOp::Return, user_id, book_id);
+        VersionedWrite write(user_id);
+        Book* book = getBook(book_id);
+
+        // Check if the book exists and is borrowed by the faculty
+        if (!book || book->borrower_id != user_id) {
+            cout << "Invalid return request" << endl;
+            return;
+        }
+        
+        // Add book to borrowing history
+        account.add_borrowing_history(book_id, account.borrowed_time[book_id], getCurrentTime());
+
+        //tO return the book
+        book->status = BookStatus::Available;
+        book->borrower_id = -1;
+        syncBookState(book);
+        account.borrowed_books.erase(remove(account.borrowed_books.begin(), account.borrowed_books.end(), book_id), account.borrowed_books.end());
+        cout << "Book returned successfully" << endl;
+        account.borrowed_time.erase(book_id);
+    }
+
+    void displayUserDetails() override {
+        User::displayUserDetails();
+        cout << "Books Currently Borrowed: " << account.borrowed_books.size() << "/5" << endl;
+        cout << "+-------------------------------------------+" << endl;
+    }
+
+    void cancelReservation() {
+        account.view_reserved_books();
+        if (account.reserved_books.empty()) {
+            return;
+        }
+        cout << "Enter book ID to cancel reservation: ";
+        int book_id;
+        cin >> book_id;
+        if (User::cancelReservation(book_id)) {
+            cout << "Reservation cancelled successfully" << endl;
+        } else {
+            cout << "Invalid book ID or reservation not found" << endl;
+        }
+    }
+};
+
+//These Function are defined afterwards as they use the classes defined above. (Student, Faculty)
+//Forward Declarations
+Student* getStudent(int user_id);
+Faculty* getFaculty(int user_id);
+// Function to add a student to the library
+void addstudent(Student* user) {
+    VersionedWrite write(user->user_id);
+    if(library.students.find(user->user_id) != library.students.end() || library.faculties.find(user->user_id) != library.faculties.end() || user->user_id==1){
+        cout << "User ID already exists. Details of the existing user:" << endl;
+        if (library.students.find(user->user_id) != library.students.end()) {
+            getStudent(user->user_id)->displayUserDetails();
+        } else if(library.faculties.find(user->user_id) != library.faculties.end()){
+            getFaculty(user->user_id)->displayUserDetails();
+        }
+        else{
+            cout<<"User ID 1 is reserved for Librarian!!"<<endl;
+        }
+        return;
+    }
+    library.students[user->user_id] = user;
+    cout << "Student added successfully" << endl;
+}
+
+// Function to add a faculty to the library
+void addFaculty(Faculty* user) {
+    VersionedWrite write(user->user_id);
+    if(library.faculties.find(user->user_id) != library.faculties.end() || library.students.find(user->user_id) != library.students.end() || user->user_id==1){
+        cout << "User ID already exists. Details of the existing user:" << endl;
+        if (library.faculties.find(user->user_id) != library.faculties.end()) {
+            getFaculty(user->user_id)->displayUserDetails();    
+        } else if(library.students.find(user->user_id) != library.students.end()){
+            getStudent(user->user_id)->displayUserDetails();
+        }
+        else{
+            cout<<"User ID 1 is reserved for Librarian!!"<<endl;
+        }
+        return;
+    }
+    library.faculties[user->user_id] = user;
+    cout << "Faculty added successfully" << endl;
+}
+
+// Function to remove a student from the library
+void removeStudent(int user_id) {
+    TraceSpan span("removeStudent", user_id);
+    VersionedWrite write(user_id);
+    if(library.students.erase(user_id)){
+        cout << "Student removed successfully" << endl;
+    } else {
+        cout << "Student not found" << endl;
+    }
+}
+
+// Function to remove a faculty from the library
+void removeFaculty(int user_id) {
+    TraceSpan span("removeFaculty", user_id);
+    VersionedWrite write(user_id);
+    if(library.faculties.erase(user_id)){
+        cout << "Faculty removed successfully" << endl;
+    } else {
+        cout << "Faculty not found" << endl;
+    }
+}
+
+// Function to reserve a book
+void studentreserveBook(int book_id, Student* user) {
+    ScopedMetric metric(MetricOp::Reserve, user->user_id, book_id);
+    RecordedOp recorded(SessionOp::Reserve, user->user_id, book_id);
+    VersionedWrite write(user->user_id);
+    Book* book = getBook(book_id);
+    if (!book) {
+        cout << "Book not found" << endl;
+        return;
+    }
+    if (book->is_reserved) {
+        cout << "Book is already reserved" << endl;
+        return;
+    }
+    book->is_reserved = true;
+    book->reservation_id = user->user_id;
+    syncBookState(book);
+    user->account.reserved_books[book_id] = getCurrentTime();
+    cout << "Book reserved successfully" << endl;
+}
+
+// Function to cancel a reservation
+void studentcancelReservation(int book_id, Student* user) {
+    VersionedWrite write(user->user_id);
+    Book* book = getBook(book_id);
+    if (!book) {
+        cout << "Book not found" << endl;
+        return;
+    }
+    if (!book->is_reserved || book->reservation_id != user->user_id) {
+        cout << "Invalid reservation" << endl;
+        return;
+    }
+    book->is_reserved = false;
+    book->reservation_id = -1;
+    syncBookState(book);
+    cout << "Reservation cancelled successfully" << endl;
+}
+
+// Function to reserve a book
+void facultyreserveBook(int book_id, Faculty* user) {
+    ScopedMetric metric(MetricOp::Reserve, user->user_id, book_id);
+    RecordedOp recorded(SessionOp::Reserve, user->user_id, book_id);
+    VersionedWrite write(user->user_id);
+    Book* book = getBook(book_id);
+    if (!book) {
+        cout << "Book not found" << endl;
+        return;
+    }
+    if (book->is_reserved) {
+        cout << "Book is already reserved" << endl;
+        return;
+    }
+    book->is_reserved = true;
+    book->reservation_id = user->user_id;
+    syncBookState(book);
+    user->account.reserved_books[book_id] = getCurrentTime();
+    cout << "Book reserved successfully" << endl;
+}
+
+// Function to cancel a reservation
+void facultycancelReservation(int book_id, Faculty* user) {
+    VersionedWrite write(user->user_id);
+    Book* book = getBook(book_id);
+    if (!book) {
+        cout << "Book not found" << endl;
+        return;
+    }
+    if (!book->is_reserved || book->reservation_id != user->user_id) {
+        cout << "Invalid reservation" << endl;
+        return;
+    }
+    book->is_reserved = false;
+    book->reservation_id = -1;
+    syncBookState(book);
+    cout << "Reservation cancelled successfully" << endl;
+}
+
+// Class to represent a librarian. It contains a user id, name, email, phone, role, password and an account.
+class Librarian : public User {
+public:
+    Librarian(int user_id, string name, string email, string phone, string password = "password") 
+        : User(user_id, name, email, phone, "Librarian",password) {}
+
+    //Below Two Functions are Dummy Functions as Librarian cannot borrow or return books
+    // Function to borrow a book    
+    void borrowBook(int book_id) override {
+        cout << "Librarians cannot borrow books." <<book_id<< endl;
+    }
+
+    // Function to return a book
+    void returnBook(int book_id) override {
+        cout << "Librarians cannot return books." <<book_id<< endl;
+    }
+
+    //Main Functions for Librarian
+    // Function to add a book to the library
+    void add_Book_to_Lib(int book_id, const Work& details) {
+        addBook(book_id, details);
+    }
+
+    // Function to remove a book from the library
+    void remove_Book_from_Lib(int book_id) {
+        removeBook(book_id);
+    }
+
+    // Function to add a student to the library
+    void add_student_to_Lib(Student*user) {
+        addstudent(user);
+    }
+
+    // Function to add a faculty to the library
+    void add_faculty_to_Lib(Faculty*user) {
+        addFaculty(user);
+    }
+
+    // Function to remove a student from the library
+    void remove_student_from_Lib(int user_id) {
+        removeStudent(user_id);
+    }
+
+    // Function to remove a faculty from the library
+    void remove_faculty_from_Lib(int user_id) {
+        removeFaculty(user_id);
+    }
+
+    void displayUserDetails() override {
+        User::displayUserDetails();
+        cout << "+-------------------------------------------+" << endl;
+    }
+
+    // Add new methods to view all students and faculty
+    // Both read one catalog version, so the listing never holds up circulation.
+    void viewAllStudents() {
+        cout << "\n+-------------------------------------------+" << endl;
+        cout << "| All Registered Students                   |" << endl;
+        cout << "+-------------------------------------------+" << endl;
+        if (!displayAccounts("Student")) {
+            cout << "No students registered in the system." << endl;
+        }
+    }
+
+    void viewAllFaculty() {
+        cout << "\n+-------------------------------------------+" << endl;
+        cout << "| All Registered Faculty Members            |" << endl;
+        cout << "+-------------------------------------------+" << endl;
+        if (!displayAccounts("Faculty")) {
+            cout << "No faculty members registered in the system." << endl;
+        }
+    }
+
+    // Function to display every account with the given role in the current version; false if there is none
+    static bool displayAccounts(const string& role) {
+        VersionView view;
+        const CatalogVersion* version = view.version;
+        if (!version) return false;
+        unordered_map<int, long long> accrued;
+        if (role == "Student") accrued = accruedFines(*version, getCurrentTime());
+        bool found = false;
+        for (size_t slot = 0; slot < version->account_count; slot++) {
+            const AccountVersion& account = version->account(slot);
+            if (!account.active || account.record->role != role) continue;
+            found = true;
+            printUserRecord(*account.record);
+            cout << "Books Currently Borrowed: " << account.loans << (role == "Student" ? "/3" : "/5") << endl;
+            if (role == "Student") {
+                auto it = accrued.find(account.record->user_id);
+                cout << "Current Fine: $" << (it != accrued.end() ? it->second : 0) << endl;
+            }
+            cout << "+-------------------------------------------+" << endl;
+            cout << endl;
+        }
+        return found;
+    }
+};
+
+
+//These could be used further but are not used in the current implementation as I assumed that there will be only one librarian!!
+// Function to add a librarian to the library
+void addLibrarian(Librarian* user) {
+    VersionedWrite write(user->user_id);
+    if(library.librarians.find(user->user_id) != library.librarians.end()){
+        cout << "User already exists" << endl;
+        return;
+    }
+    library.librarians[user->user_id] = user;
+    cout << "Librarian added successfully" << endl;
+}
+
+// Function to remove a librarian from the library
+void removeLibrarian(int user_id) {
+    VersionedWrite write(user_id);
+    if (library.librarians.erase(user_id)) {
+        cout << "User removed successfully" << endl;
+    } else {
+        cout << "User not found" << endl;
+    }
+}
+
+// Function to get a student by its id
+Student* getStudent(int user_id) {
+    auto it = library.students.find(user_id);
+    if (it != library.students.end()) {
+        return it->second;
+    }
+    return nullptr;
+}
+
+// Function to get a faculty by its id
+Faculty* getFaculty(int user_id) {
+    auto it = library.faculties.find(user_id);
+    if (it != library.faculties.end()) {
+        return it->second;
+    }
+    return nullptr;
+}
+
+// Function to get a librarian by its id
+Librarian* getLibrarian(int user_id) {
+    auto it = library.librarians.find(user_id);
+    if (it != library.librarians.end()) {
+        return it->second;
+    }
+    return nullptr;
+}
+
+// Function to log a user in: the id lookup, name check and password check are timed together as one Login
+// find is getStudent, getFaculty or getLibrarian; nullptr if any check fails.
+template <typename T>
+T* logIn(T* (*find)(int), int user_id, const string& name, const string& password) {
+    ScopedMetric metric(MetricOp::Login, user_id);
+    T* user = find(user_id);
+    if (!user || user->name != name || !user->check_credentials(user_id, password)) return nullptr;
+    return user;
+}
+
+// Function to copy one account out for the next catalog version; a removed user comes back inactive
+AccountVersion accountVersion(int user_id, UserRecord& record) {
+    User* user = getStudent(user_id);
+    if (!user) user = getFaculty(user_id);
+    if (!user) user = getLibrarian(user_id);
+    if (!user) return AccountVersion();
+    record = user->record();
+    return user->accountVersion();
+}
+
+template <>
+struct RecordFields<SessionRecord> {
+    static constexpr auto fields = make_tuple(&SessionRecord::op, &SessionRecord::offset_us, &SessionRecord::time, &SessionRecord::user_id,
+                                              &SessionRecord::book_id, &SessionRecord::text, &SessionRecord::lent, &SessionRecord::before, &SessionRecord::after,
+                                              &SessionRecord::fine);
+};
+
+// Function to find the student or faculty member a session record belongs to
+User* sessionUser(int user_id) {
+    User* user = getStudent(user_id);
+    return user ? user : getFaculty(user_id);
+}
+
+// Function to summarise what an operation depends on and changes: the user's account, or for a catalog change
+// whether the copy exists (1) and is lent (2). Queries carry their match count instead.
+long long sessionState(const SessionRecord& record) {
+    SessionOp op = static_cast<SessionOp>(record.op);
+    if (op == SessionOp::AddBook || op == SessionOp::RemoveBook) {
+        Book* book = getBook(record.book_id);
+        return book ? (book->status == BookStatus::Borrowed ? 2 : 1) : 0;
+    }
+    User* user = sessionUser(record.user_id);
+    return user ? user->sessionState(record.book_id) : -1;
+}
+
+// Function to stamp an operation as it starts
+void beginSessionRecord(SessionRecord& record) {
+    record.offset_us = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - session_recorder.origin).count();
+    record.time = getCurrentTime();
+    if (record.op != static_cast<int>(SessionOp::Query)) record.before = sessionState(record);
+}
+
+// Function to fill in what an operation left behind, the same way when recording and when replaying
+void settleSessionRecord(SessionRecord& record) {
+    if (record.op != static_cast<int>(SessionOp::Query)) record.after = sessionState(record);
+    User* user = sessionUser(record.user_id);
+    record.fine = user ? user->fineBalance() : 0;
+}
+
+// Function to settle a finished operation and append it to the session log
+void endSessionRecord(SessionRecord& record) {
+    settleSessionRecord(record);
+    lock_guard<mutex> lock(session_recorder.write_mutex);
+    if (!session_recorder.file.is_open()) return;
+    if (session_recorder.records++ == 0) session_recorder.buffer.append(BinaryCodec::MAGIC, sizeof(BinaryCodec::MAGIC));
+    forEachField<SessionRecord>([&record](auto member) { BinaryCodec::put(session_recorder.buffer, record.*member); });
+    if (session_recorder.buffer.size() >= (1 << 16)) session_recorder.flush();
+}
+
+// Function to encode the books table; book(slot) returns the copy in a catalog slot and work(id) the
+// bibliographic record of a work
+template <typename BookLookup, typename WorkLookup>
+string formatBooks(size_t book_count, BookLookup book_at, WorkLookup work, bool binary) {
+    string out;
+    out.reserve(book_count * (binary ? 64 : 96));
+    BookRow row;
+    for (size_t slot = 0; slot < book_count; slot++) {
+        const Book& book = book_at(slot);
+        const Work& details = work(book.work_id);
+        row.book_id = book.book_id;
+        row.title = details.title;
+        row.author = details.author;
+        row.publisher = details.publisher;
+        row.isbn = details.isbn;
+        row.year = details.year;
+        row.status = book.status;
+        row.borrower_id = book.borrower_id;
+        row.borrowed_time = book.borrowed_time;
+        row.is_reserved = book.is_reserved;
+        row.reservation_id = book.reservation_id;
+        if (binary) BinaryCodec::write(out, row);
+        else TextCodec::write(out, row);
+    }
+    if (binary && out.empty()) out.append(BinaryCodec::MAGIC, sizeof(BinaryCodec::MAGIC));
+    return out;
+}
+
+// Function to encode a user table
+string formatUsers(const vector<UserRecord>& users, bool binary) {
+    string out;
+    encodeRows(out, users, binary);
+    return out;
+}
+
+// Function to encode currently_borrowed or reserved_books
+string formatLoans(const vector<LoanRecord>& loans, bool binary) {
+    string out;
+    encodeRows(out, loans, binary);
+    return out;
+}
+
+// Function to copy out the records of every user in a table
+template <typename UserMap>
+vector<UserRecord> userRecords(const UserMap& users) {
+    vector<UserRecord> records;
+    records.reserve(users.size());
+    for (const auto& pair : users) {
+        records.push_back(pair.second->record());
+    }
+    return records;
+}
+
+// Function to copy out the loans and reservations of every user in a table
+template <typename UserMap>
+void collectLoans(const UserMap& users, vector<LoanRecord>& loans, vector<LoanRecord>& reservations) {
+    for (const auto& pair : users) {
+        pair.second->collectLoans(loans, reservations);
+    }
+}
+
+// Function to append history rows to their monthly segments, then the new lines to the segment index
+// Whatever was written is removed from segments and index_lines, so after a failure they hold only what is
+// still to save.
+bool appendHistory(map<string, string>& segments, vector<pair<int, string>>& index_lines) {
+    for (auto it = segments.begin(); it != segments.end(); it = segments.erase(it)) {
+        if (!storage->append(history_store.segmentTable(it->first), it->second)) return false;
+    }
+    if (index_lines.empty()) return true;
+    string index;
+    for (const auto& line : index_lines) {
+        index += to_string(line.first) + "|" + line.second + "\n";
+    }
+    if (!storage->append(history_store.indexTable(), index)) return false;
+    index_lines.clear();
+    return true;
+}
+
+// Function to save books to a file
+void saveBooks() {
+    TraceSpan span("saveBooks");
+    storage->store("books", formatBooks(library.books.size(), [](size_t slot) -> const Book& { return library.books[slot]; },
+                                        [](int work_id) -> const Work& { return library.works[work_id]; }, storage->binaryRows()));
+}
+
+// Function to load books from a file
+void loadBooks() {
+    TraceSpan span("loadBooks");
+    string data;
+    if (!storage->load("books", data)) return;
+
+    library.works.clear();
+    library.works_generation++;
+    library.books.clear();
+    library.book_index.clear();
+    library.isbn_index.clear();
+    library.available_map.resize(0);
+    library.borrowed_map.resize(0);
+    library.reserved_map.resize(0);
+    library.year_index.clear();
+    library.publisher_postings.clear();
+    library.author_postings.clear();
+    // Rows sharing an ISBN become copies of one work; a row whose title, author, publisher or year disagrees with
+    // the first row of its ISBN is still loaded as a copy (it may be on loan) but is reported, since the next
+    // save writes it with the first row's details
+    vector<int> conflicts;
+    forEachRow<BookRow>(data, [&conflicts](const BookRow& row) {
+        if (library.book_index.find(row.book_id) != library.book_index.end()) return;
+        Work details(row.title, row.author, row.publisher, row.isbn, row.year);
+        auto known = library.isbn_index.find(row.isbn);
+        int work_id;
+        if (known != library.isbn_index.end()) {
+            work_id = known->second;
+            if (!library.works[work_id].sameDetails(details)) conflicts.push_back(row.book_id);
+        } else {
+            work_id = findOrAddWork(details);
+        }
+        insertCopy(Book(row.book_id, work_id, row.status, row.borrower_id, row.borrowed_time, row.is_reserved, row.reservation_id));
+    });
+    if (!conflicts.empty()) {
+        cout << conflicts.size() << " book rows disagree with the title, author, publisher or year of an earlier row with the same ISBN"
+             << " and were loaded as copies of that title:";
+        for (size_t i = 0; i < conflicts.size() && i < 5; i++) cout << " " << conflicts[i];
+        cout << (conflicts.size() > 5 ? " ..." : "") << endl;
+    }
+}
+
+// Function to save students to a file
+void saveStudents() {
+    TraceSpan span("saveStudents");
+    storage->store("students", formatUsers(userRecords(library.students), storage->binaryRows()));
+}
+
+// Function to load students from a file
+void loadStudents() {
+    TraceSpan span("loadStudents");
+    string data;
+    if (!storage->load("students", data)) return;
+
+    library.students.clear();
+    forEachRow<UserRecord>(data, [](const UserRecord& user) {
+        library.students[user.user_id] = new Student(user.user_id, user.name, user.email, user.phone, 0, user.password);
+    });
+}
+
+// Function to save faculties to a file
+void saveFaculties() {
+    TraceSpan span("saveFaculties");
+    storage->store("faculties", formatUsers(userRecords(library.faculties), storage->binaryRows()));
+}
+
+// Function to load faculties from a file
+void loadFaculties() {
+    TraceSpan span("loadFaculties");
+    string data;
+    if (!storage->load("faculties", data)) return;
+
+    library.faculties.clear();
+    forEachRow<UserRecord>(data, [](const UserRecord& user) {
+        library.faculties[user.user_id] = new Faculty(user.user_id, user.name, user.email, user.phone, user.password);
+    });
+}
+
+// Function to save librarians to a file
+void saveLibrarians() {
+    TraceSpan span("saveLibrarians");
+    storage->store("librarians", formatUsers(userRecords(library.librarians), storage->binaryRows()));
+}
+
+// Function to load librarians from a file
+void loadLibrarians() {
+    TraceSpan span("loadLibrarians");
+    string data;
+    if (!storage->load("librarians", data)) return;
+
+    library.librarians.clear();
+    forEachRow<UserRecord>(data, [](const UserRecord& user) {
+        library.librarians[user.user_id] = new Librarian(user.user_id, user.name, user.email, user.phone, user.password);
+    });
+}
+
+// Function to append one account's unsaved history entries to the segment buffers
+static void collectUnsavedHistory(int user_id, Account& account, map<string, string>& segments) {
+    for (size_t i = account.saved_history; i < account.borrowing_history.size(); i++) {
+        const HistoryEntry& entry = account.borrowing_history[i];
+        string month = HistoryStore::monthOf(entry.return_time);
+        TextCodec::write(segments[month], HistoryRow{entry.return_time, entry.borrowed_time, user_id, entry.book_id});
+        history_store.noteEntry(user_id, month);
+    }
+    account.saved_history = account.borrowing_history.size();
+}
+
+// Function to save borrowing history; new entries are appended to their monthly segments
+void saveBorrowingHistory() {
+    TraceSpan span("saveBorrowingHistory");
+    map<string, string> segments;
+    segments.swap(history_store.unwritten);
+    for (const auto& pair: library.students) {
+        Student* user = pair.second;
+        collectUnsavedHistory(user->user_id, user->account, segments);
+    }
+    for (const auto& pair: library.faculties) {
+        Faculty* user = pair.second;
+        collectUnsavedHistory(user->user_id, user->account, segments);
+    }
+    if (!appendHistory(segments, history_store.pending_index)) history_store.unwritten.swap(segments);
+}
+
+// Function to copy out every non-zero fine balance
+vector<FineBalance> fineBalances() {
+    vector<FineBalance> balances;
+    for (const auto& pair : library.students) {
+        if (pair.second->account.prev_fine != 0) balances.push_back({pair.first, pair.second->account.prev_fine});
+    }
+    for (const auto& pair : library.faculties) {
+        if (pair.second->account.prev_fine != 0) balances.push_back({pair.first, pair.second->account.prev_fine});
+    }
+    return balances;
+}
 
-public:
-    string name;
-    User(int user_id, string name, string email, string phone, string role, string password = "password") 
-        : account(user_id) {
-        this->user_id = user_id;
-        this->name = name;
-        this->email = email;
-        this->phone = phone;
-        this->role = role;
-        this->password = password;
+// Function to take ledger rows that are not in the segments back out of the balances
+// A checkpoint written after a failed append then matches the stored ledger instead of counting charges it lacks.
+vector<FineBalance> storedBalances(const vector<FineBalance>& balances, const map<string, string>& unsaved) {
+    if (unsaved.empty()) return balances;
+    map<int, long long> totals;
+    for (const FineBalance& row : balances) totals[row.user_id] += row.balance;
+    for (const auto& month : unsaved) {
+        forEachRow<FineEntry>(month.second, [&totals](const FineEntry& entry) { totals[entry.user_id] -= entry.amount; });
     }
+    vector<FineBalance> stored;
+    for (const auto& total : totals) {
+        if (total.second != 0) stored.push_back({total.first, total.second});
+    }
+    return stored;
+}
 
-    virtual void borrowBook(int book_id) = 0;
-    virtual void returnBook(int book_id) = 0;
+// Function to save the fine ledger: new rows are appended to their monthly segments and the balances checkpointed
+void saveFineLedger() {
+    TraceSpan span("saveFineLedger");
+    map<string, string> rows = fine_ledger.takePending();
+    if (!appendFineLedger(rows)) fine_ledger.requeue(rows);
+    string data;
+    encodeRows(data, storedBalances(fineBalances(), rows), storage->binaryRows());
+    storage->store("fine_balances", data);
+}
 
-    // Function to check if the user id and password are correct
-    bool check_credentials(int user_id, string password) {
-        return this->user_id == user_id && this->password == password;
+// Function to load the fine balances into the accounts
+// The checkpoint is read when present; otherwise the ledger segments are replayed one month at a time.
+void loadFineLedger() {
+    TraceSpan span("loadFineLedger");
+    fine_ledger.takePending();
+    auto apply = [](int user_id, long long amount) {
+        auto student = library.students.find(user_id);
+        if (student != library.students.end()) student->second->account.prev_fine += amount;
+        auto faculty = library.faculties.find(user_id);
+        if (faculty != library.faculties.end()) faculty->second->account.prev_fine += amount;
+    };
+    string data;
+    if (storage->load("fine_balances", data)) {
+        forEachRow<FineBalance>(data, [&apply](const FineBalance& row) { apply(row.user_id, row.balance); });
+    } else {
+        fine_ledger.forEachEntry([&apply](const FineEntry& entry) { apply(entry.user_id, entry.amount); });
     }
+}
 
-    // Function to change password
-    void changePassword(string new_password) {
-        password = new_password;
+// Function to split a legacy borrowing_history.txt into monthly segments
+// Restartable: rows a cut-short earlier run already appended to a segment are not appended again, and the
+// legacy file is renamed to .migrated, which marks the migration done, only once every segment and the
+// index are written. Until then it is retried at every start.
+// The legacy file is always read from and renamed on disk, whatever storage backend is selected; only the
+// segments and the index go through the backend.
+static void migrateLegacyHistory() {
+    ifstream file("borrowing_history.txt");
+    if (!file || file.peek() == ifstream::traits_type::eof()) return;
+    map<string, string> segments;
+    string line;
+    int user_id;
+    HistoryEntry entry;
+    while (getline(file, line)) {
+        if (!HistoryStore::parseLine(line, user_id, entry)) continue;
+        string month = HistoryStore::monthOf(entry.return_time);
+        segments[month] += to_string(user_id) + "|" + to_string(entry.book_id) + "|" + to_string(entry.return_time) + "|" + to_string(entry.borrowed_time) + "\n";
+        history_store.noteEntry(user_id, month);
     }
-    
-    // Function to check fine
-    int check_fine(){
-        return account.check_fine();
+    file.close();
+    bool migrated = true;
+    for (const auto& segment : segments) {
+        // Count the rows already in the segment, then skip that many copies of each
+        string existing;
+        unordered_map<string_view, int> present;
+        if (storage->load(history_store.segmentTable(segment.first), existing)) {
+            for (size_t begin = 0, end; begin < existing.size(); begin = end + 1) {
+                end = existing.find('\n', begin);
+                if (end == string::npos) end = existing.size();
+                present[string_view(existing).substr(begin, end - begin)]++;
+            }
+        }
+        string missing;
+        for (size_t begin = 0, end; begin < segment.second.size(); begin = end + 1) {
+            end = segment.second.find('\n', begin);
+            string_view row = string_view(segment.second).substr(begin, end - begin);
+            auto it = present.find(row);
+            if (it != present.end() && it->second > 0) it->second--;
+            else missing.append(row.data(), row.size() + 1);
+        }
+        if (!missing.empty() && !storage->append(history_store.segmentTable(segment.first), missing)) migrated = false;
     }
-
-    // Function to pay fine
-    void payFine() {
-        account.pay_fine();
+    if (!history_store.flushIndex()) migrated = false;
+    if (!migrated) {
+        cout << "borrowing_history.txt was not fully migrated; the migration will be retried at the next start" << endl;
+        return;
     }
-    
-    //Function to view password
-    string view_password(){
-        return password;
+    error_code error;
+    filesystem::rename("borrowing_history.txt", "borrowing_history.txt.migrated", error);
+    if (error) {
+        cout << "borrowing_history.txt was migrated but could not be renamed (" << error.message()
+             << "); the migration will be retried at the next start" << endl;
     }
+}
 
-    // Function to view books currently borrowed
-    void view_books(){
-        account.view_books();
+// Function to load borrowing history; only the recent segments are read, older ones are streamed on demand
+void loadBorrowingHistory() {
+    TraceSpan span("loadBorrowingHistory");
+    history_store.loadIndex();
+    migrateLegacyHistory();
+    history_store.setEagerWindow(getCurrentTime());
+
+    for (const string& month : history_store.segments()) {
+        if (!history_store.isEager(month)) continue;
+        history_store.forEachInSegment(month, [](int user_id, const HistoryEntry& entry) {
+            if (library.students.find(user_id) != library.students.end()) {
+                library.students[user_id]->account.borrowing_history.push_back(entry);
+            }
+            if (library.faculties.find(user_id) != library.faculties.end()) {
+                library.faculties[user_id]->account.borrowing_history.push_back(entry);
+            }
+        });
     }
-    
-    // Function to view borrowing history
-    void view_borrowing_history(){
-        account.view_borrowing_history();
+    for (const auto& pair : library.students) {
+        pair.second->account.saved_history = pair.second->account.borrowing_history.size();
     }
-    
-    // Function to check if the user has overdue books
-    bool checkOverdue(int limit){
-        if(account.hasOverdue(limit)){
-           return true;
+    for (const auto& pair : library.faculties) {
+        pair.second->account.saved_history = pair.second->account.borrowing_history.size();
+    }
+}
+
+// Function to save currently borrowed books to a file
+void savecurrentlyborrowed() {
+    TraceSpan span("savecurrentlyborrowed");
+    vector<LoanRecord> loans, reservations;
+    collectLoans(library.students, loans, reservations);
+    collectLoans(library.faculties, loans, reservations);
+    storage->store("currently_borrowed", formatLoans(loans, storage->binaryRows()));
+}
+
+// Function to load currently borrowed books from a file
+void loadcurrentlyborrowed() {
+    TraceSpan span("loadcurrentlyborrowed");
+    string data;
+    if (!storage->load("currently_borrowed", data)) return;
+
+    forEachRow<LoanRecord>(data, [](const LoanRecord& loan) {
+        if (library.students.find(loan.user_id) != library.students.end()) {
+            library.students[loan.user_id]->account.borrowed_books.push_back(loan.book_id);
+            library.students[loan.user_id]->account.borrowed_time[loan.book_id] = loan.time;
+        }
+        if (library.faculties.find(loan.user_id) != library.faculties.end()) {
+            library.faculties[loan.user_id]->account.borrowed_books.push_back(loan.book_id);
+            library.faculties[loan.user_id]->account.borrowed_time[loan.book_id] = loan.time;
+        }
+    });
+}
+
+bool isValidUserId(int user_id) {
+    return user_id > 0;
+}
+
+// Function to save reserved books to a file
+void saveReservedBooks() {
+    TraceSpan span("saveReservedBooks");
+    vector<LoanRecord> loans, reservations;
+    collectLoans(library.students, loans, reservations);
+    collectLoans(library.faculties, loans, reservations);
+    storage->store("reserved_books", formatLoans(reservations, storage->binaryRows()));
+}
+
+// Function to load reserved books from a file
+void loadReservedBooks() {
+    TraceSpan span("loadReservedBooks");
+    string data;
+    if (!storage->load("reserved_books", data)) return;
+
+    forEachRow<LoanRecord>(data, [](const LoanRecord& reservation) {
+        if (library.students.find(reservation.user_id) != library.students.end()) {
+            library.students[reservation.user_id]->account.reserved_books[reservation.book_id] = reservation.time;
+        }
+        if (library.faculties.find(reservation.user_id) != library.faculties.end()) {
+            library.faculties[reservation.user_id]->account.reserved_books[reservation.book_id] = reservation.time;
+        }
+    });
+}
+
+// Function to parse a YYYY-MM-DD date into a day number
+bool parseDay(string_view text, long long& day) {
+    int year, month, date;
+    if (text.size() != 10 || text[4] != '-' || text[7] != '-') return false;
+    if (!parseNumber(text.substr(0, 4), year) || !parseNumber(text.substr(5, 2), month) || !parseNumber(text.substr(8, 2), date)) return false;
+    if (year < 1970 || year > 2200 || month < 1 || month > 12 || date < 1 || date > 31) return false;
+    day = daysFromCivil(year, month, date);
+    return formatDay(day) == text;  // rejects dates such as 2025-02-30
+}
+
+// Function to load the closure calendar from the closures table (closures.txt), which is edited by hand
+// One closed day per line as YYYY-MM-DD, or an inclusive range as YYYY-MM-DD|YYYY-MM-DD, optionally followed
+// by |reason. Blank lines and lines starting with # are skipped. Without the table every day is open.
+void loadClosures() {
+    TraceSpan span("loadClosures");
+    string data;
+    vector<long long> closed;
+    size_t rejected = 0;
+    if (storage->load("closures", data)) {
+        istringstream in(data);
+        string line;
+        while (getline(in, line)) {
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (line.empty() || line[0] == '#') continue;
+            string_view fields(line);
+            size_t bar = fields.find('|');
+            long long first, last;
+            if (!parseDay(fields.substr(0, bar), first)) {
+                rejected++;
+                continue;
+            }
+            // The second field is the end of a range when it is a date, otherwise the reason
+            last = first;
+            string_view until = bar == string_view::npos ? string_view() : fields.substr(bar + 1);
+            until = until.substr(0, until.find('|'));
+            bool is_date = until.size() == 10 && isDigitChar(until[0]) && until[4] == '-';
+            if (is_date && (!parseDay(until, last) || last < first)) {
+                rejected++;
+                continue;
+            }
+            for (long long day = first; day <= last; day++) closed.push_back(day);
         }
-        return false;
     }
+    calendar.build(move(closed));
+    if (rejected > 0) cout << "Skipped " << rejected << " unreadable lines in closures.txt" << endl;
+}
 
-    // Function to check if user has any borrowed books
-    bool hasBorrowedBooks() const {
-        return !account.borrowed_books.empty();
+// LibrarySnapshot: Everything saveLibraryData() writes, captured from the live structures
+// Copies, bibliographic records and user details are read from a pinned catalog version, whose chunks are
+// shared with the live catalog versions rather than copied. History and fine ledger rows are moved in.
+struct LibrarySnapshot {
+    unique_ptr<VersionPin> catalog;
+    vector<LoanRecord> loans, reservations;
+    map<string, string> history_segments;      // unsaved history rows by month
+    vector<pair<int, string>> history_index;   // index lines not yet in history/index.txt
+    map<string, string> fine_segments;         // unsaved fine ledger rows by month
+    vector<FineBalance> fine_balances;
+
+    // Function to check whether any appended rows are still waiting to be written
+    bool hasAppendedRows() const {
+        return !history_segments.empty() || !history_index.empty() || !fine_segments.empty();
     }
+};
 
-    // Friend Functions
-    friend void addBook(const Book& book);
-    friend void addstudent(Student* user);
-    friend void addFaculty(Faculty* user);
-    friend void addLibrarian(Librarian* user);
-    friend void removeBook(int book_id);
-    friend void removeStudent(int user_id);
-    friend void removeFaculty(int user_id);
-    friend void removeLibrarian(int user_id);
-    friend void studentreserveBook(int book_id, Student* user);
-    friend void studentcancelReservation(int book_id, Student* user);
-    friend void facultyreserveBook(int book_id, Faculty* user);
-    friend void facultycancelReservation(int book_id, Faculty* user);
-    friend void saveBooks();
-    friend void loadBooks();
-    friend void saveStudents();
-    friend void loadStudents();
-    friend void saveFaculties();
-    friend void loadFaculties();
-    friend void saveLibrarians();
-    friend void loadLibrarians();
-    friend void saveBorrowingHistory();
-    friend void loadBorrowingHistory();
-    friend void loadcurrentlyborrowed();
-    friend void savecurrentlyborrowed();
-    friend Book* getBook(int book_id);
-    friend Student* getStudent(int user_id);
-    friend Faculty* getFaculty(int user_id);
-    friend Librarian* getLibrarian(int user_id);
-    friend void saveReservedBooks();
-    friend void loadReservedBooks();
+// Function to capture a consistent snapshot of the library on the calling thread
+// Unsaved history is moved into the snapshot; if the write fails, the worker carries it into the next one.
+LibrarySnapshot takeSnapshot() {
+    LibrarySnapshot snapshot;
+    if (!catalog_versions.current.load()) catalog_versions.rebuild();
+    catalog_versions.publish();
+    snapshot.catalog.reset(new VersionPin);
+    collectLoans(library.students, snapshot.loans, snapshot.reservations);
+    collectLoans(library.faculties, snapshot.loans, snapshot.reservations);
+    snapshot.history_segments.swap(history_store.unwritten);
+    for (const auto& pair : library.students) {
+        collectUnsavedHistory(pair.first, pair.second->account, snapshot.history_segments);
+    }
+    for (const auto& pair : library.faculties) {
+        collectUnsavedHistory(pair.first, pair.second->account, snapshot.history_segments);
+    }
+    snapshot.history_index.swap(history_store.pending_index);
+    snapshot.fine_segments = fine_ledger.takePending();
+    snapshot.fine_balances = fineBalances();
+    return snapshot;
+}
 
-    // AVirtual Mwthod Defined to Display User Details
-    virtual void displayUserDetails() {
-        cout << "\n+-------------------------------------------+" << endl;
-        cout << "| User Details                              |" << endl;
-        cout << "+-------------------------------------------+" << endl;
-        cout << "User ID: " << user_id << endl;
-        cout << "Name: " << name << endl;
-        cout << "Email: " << email << endl;
-        cout << "Phone: " << phone << endl;
-        cout << "Role: " << role << endl;
-        cout << "+-------------------------------------------+" << endl;
+// Function to write a snapshot to the data files; safe to call from any thread
+// Appended rows are removed from the snapshot as they are written, so after a failure it holds what is left.
+bool writeSnapshot(LibrarySnapshot& snapshot) {
+    TraceSpan span("writeSnapshot");
+    const CatalogVersion& version = *snapshot.catalog->version;
+    bool saved = storage->store("books", formatBooks(version.book_count, [&version](size_t slot) -> const Book& { return version.book(slot); },
+                                                     [&version](int work_id) -> const Work& { return version.work(work_id); }, storage->binaryRows()));
+    vector<UserRecord> users[3];
+    for (size_t slot = 0; slot < version.account_count; slot++) {
+        const AccountVersion& account = version.account(slot);
+        if (!account.active || !account.record) continue;
+        const string& role = account.record->role;
+        users[role == "Student" ? 0 : role == "Faculty" ? 1 : 2].push_back(*account.record);
     }
-};
+    saved = storage->store("students", formatUsers(users[0], storage->binaryRows())) && saved;
+    saved = storage->store("faculties", formatUsers(users[1], storage->binaryRows())) && saved;
+    saved = storage->store("librarians", formatUsers(users[2], storage->binaryRows())) && saved;
+    saved = storage->store("currently_borrowed", formatLoans(snapshot.loans, storage->binaryRows())) && saved;
+    saved = appendHistory(snapshot.history_segments, snapshot.history_index) && saved;
+    saved = storage->store("reserved_books", formatLoans(snapshot.reservations, storage->binaryRows())) && saved;
+    saved = appendFineLedger(snapshot.fine_segments) && saved;
+    string balances;
+    encodeRows(balances, storedBalances(snapshot.fine_balances, snapshot.fine_segments), storage->binaryRows());
+    return storage->store("fine_balances", balances) && saved;
+}
 
-// Class to represent a student. It contains a user id, name, email, phone, role, password and an account.
-class Student : public User {
+// PersistenceWorker Class: Background thread that writes snapshots so saving never blocks the menus
+// Only the newest waiting snapshot is kept; the history and fine ledger rows of a superseded one are carried
+// into it, since those are appended rather than rewritten. Rows a failed write left behind are carried into
+// the next snapshot the same way, or handed back to the history store and fine ledger by requeueUnwritten().
+class PersistenceWorker {
 public:
-    int roll_number;  // Add roll number attribute as specific to this class
-    Student(int user_id, string name, string email, string phone, int roll_number, string password = "password") 
-        : User(user_id, name, email, phone, "Student", password), roll_number(roll_number) {}
-
-    // Function to borrow a book    
-    void borrowBook(int book_id) override {
-        Book* book = getBook(book_id);
+    thread worker;
+    mutex state_mutex;
+    condition_variable wake, idle;
+    unique_ptr<LibrarySnapshot> pending;
+    LibrarySnapshot unwritten;  // appended rows of failed writes, not yet carried anywhere
+    bool busy = false;
+    bool stopping = false;
+    size_t written = 0;
+    size_t failed = 0;
+
+    ~PersistenceWorker() {
+        stop();
+    }
 
-        // Check if the book exists
-        if (!book) {
-            cout << "Book not found" << endl;
-            return;
+    // Function to queue a snapshot for writing, starting the thread on first use
+    void submit(LibrarySnapshot snapshot) {
+        lock_guard<mutex> lock(state_mutex);
+        if (!worker.joinable()) {
+            stopping = false;
+            worker = thread([this] { run(); });
         }
+        if (pending) carryAppended(*pending, snapshot);
+        carryAppended(unwritten, snapshot);
+        pending.reset(new LibrarySnapshot(move(snapshot)));
+        wake.notify_one();
+    }
 
-        // Check if the student has already borrowed the book
-        if (find(account.borrowed_books.begin(), account.borrowed_books.end(), book_id) != account.borrowed_books.end()) {
-            cout << "You already have this book." << endl;
-            return;
+    // Function to wait until every queued snapshot is on disk
+    void wait() {
+        unique_lock<mutex> lock(state_mutex);
+        idle.wait(lock, [this] { return !pending && !busy; });
+    }
+
+    // Function to check whether every queued snapshot has been written, without waiting
+    bool isIdle() {
+        lock_guard<mutex> lock(state_mutex);
+        return !pending && !busy;
+    }
+
+    // Function to give rows that failed to save back to the history store and fine ledger, ahead of newer rows
+    // Called on the thread that owns them, once the worker is idle, so a synchronous save writes them.
+    void requeueUnwritten() {
+        lock_guard<mutex> lock(state_mutex);
+        for (auto& segment : unwritten.history_segments) {
+            history_store.unwritten[segment.first].insert(0, segment.second);
         }
+        history_store.pending_index.insert(history_store.pending_index.begin(), unwritten.history_index.begin(), unwritten.history_index.end());
+        fine_ledger.requeue(unwritten.fine_segments);
+        unwritten.history_segments.clear();
+        unwritten.history_index.clear();
+        unwritten.fine_segments.clear();
+    }
 
-        // Check if the student has borrowed 3 books
-        if (account.borrowed_books.size() >= 3) {
-            cout << "Limit reached: 3 books" << endl;
-            return;
+    // Function to finish the queued writes and stop the thread
+    // Returns false when the writes left history or fine ledger rows behind; they are handed back to the
+    // history store and fine ledger, and only a later save puts them on disk.
+    bool stop() {
+        {
+            unique_lock<mutex> lock(state_mutex);
+            if (!worker.joinable()) return true;
+            stopping = true;
         }
+        wake.notify_one();
+        worker.join();
+        if (!unwritten.hasAppendedRows()) return true;
+        cout << "Some history or fine ledger rows could not be saved in the background" << endl;
+        requeueUnwritten();
+        return false;
+    }
 
-        // Check if the student has overdue books
-        if (account.hasOverdue(15)) {
-            cout << "Overdue books detected" << endl;
-            return;
+private:
+    // Function to put the appended rows of an older snapshot ahead of those of a newer one, emptying the older
+    static void carryAppended(LibrarySnapshot& older, LibrarySnapshot& newer) {
+        for (auto& segment : newer.history_segments) {
+            older.history_segments[segment.first] += segment.second;
         }
-        
-        // Check if the student has pending fine
-        if (account.prev_fine > 0) {
-            cout << "Pending fine detected" << endl;
-            return;
+        newer.history_segments.swap(older.history_segments);
+        older.history_segments.clear();
+        older.history_index.insert(older.history_index.end(), newer.history_index.begin(), newer.history_index.end());
+        newer.history_index.swap(older.history_index);
+        older.history_index.clear();
+        for (auto& segment : newer.fine_segments) {
+            older.fine_segments[segment.first] += segment.second;
         }
+        newer.fine_segments.swap(older.fine_segments);
+        older.fine_segments.clear();
+    }
 
-        // Check if the book is available
-        if (book->status == "Available") {
-            // Check if the book is reserved by the same user or not reserved
-            if ((book->is_reserved && book->reservation_id == user_id) || !book->is_reserved) {
-                book->status = "Borrowed";
-                book->borrower_id = user_id;
-                book->borrowed_time = getCurrentTime();
-                account.borrowed_books.push_back(book_id);
-                account.borrowed_time[book_id] = getCurrentTime();
-                cout << "Book borrowed successfully" << endl;
-                // Clear reservation
-                book->is_reserved = false;
-                book->reservation_id = -1;
-                account.reserved_books.erase(book_id);
-                Library::displayBook(book);                
-            } else if (book->is_reserved) {
-                cout << "Book is already reserved by another user." << endl;
+    void run() {
+        unique_lock<mutex> lock(state_mutex);
+        while (true) {
+            wake.wait(lock, [this] { return pending || stopping; });
+            if (!pending) break;
+            unique_ptr<LibrarySnapshot> snapshot = move(pending);
+            busy = true;
+            lock.unlock();
+            bool saved = writeSnapshot(*snapshot);
+            lock.lock();
+            if (saved) {
+                written++;
             } else {
-                cout << "Book is available but not reserved by you." << endl;
-            }
-        } else if (book->status == "Borrowed") {
-            if (book->is_reserved) {
-                cout << "Book is already reserved by another user." << endl;
-            } else {
-                cout << "Book is currently borrowed. Would you like to reserve it? (yes/no)" << endl;
-                string response;
-                cin >> response;
-                if (response == "yes") {
-                    studentreserveBook(book_id, this);
-                }
+                failed++;
+                carryAppended(*snapshot, pending ? *pending : unwritten);
             }
-        } else {
-            cout << "Book is not available" << endl;
+            busy = false;
+            idle.notify_all();
         }
+        idle.notify_all();
     }
+};
 
-    // Function to return a book
-    void returnBook(int book_id) override {
-        Book* book = getBook(book_id);
+PersistenceWorker persistence;
+
+// EngineStatus: Outcome of one operation in the sharded engine
+enum class EngineStatus : unsigned char { Ok, NotFound, Unavailable, AlreadyBorrowed, LimitReached, Overdue, FineDue, NotBorrower, UnknownUser };
+
+// EngineOp: Messages exchanged by clients, shards and the coordinator
+enum class EngineOp : unsigned char {
+    Borrow,    // client -> coordinator: admit one more loan for the user, then pass it to the book's shard
+    Lend,      // coordinator -> shard: the user was admitted, lend the copy if it is free
+    Return,    // client -> shard
+    Reserve,   // client -> coordinator: check the user is enrolled, then pass it to the book's shard
+    Hold,      // coordinator -> shard: the user is enrolled, reserve the copy if it is not taken
+    Lent,      // shard -> coordinator: the loan went through at time
+    Refused,   // shard -> coordinator: the loan did not go through, give the admitted slot back
+    Returned   // shard -> coordinator: the loan that started at time ended at return_time
+};
 
-        // Check if the book exists and is borrowed by the student
-        if (!book || book->borrower_id != user_id) {
-            cout << "Invalid return request" << endl;
-            return;
-        }
+// EngineMessage: One message in a shard's or the coordinator's inbox
+struct EngineMessage {
+    EngineOp op;
+    uint16_t client;
+    uint32_t cookie;  // the client's tag, echoed in the reply
+    int user_id;
+    int book_id;
+    long long time;
+    long long return_time;
+};
 
-        account.add_borrowing_history(book, getCurrentTime());
-        book->status = "Available";
-        book->borrower_id = -1;
-        account.borrowed_books.erase(remove(account.borrowed_books.begin(), account.borrowed_books.end(), book_id), account.borrowed_books.end());
+// EngineReply: The answer to one client operation
+struct EngineReply {
+    uint32_t cookie;
+    EngineStatus status;
+};
 
-        // Calculate fine if the book is returned after 15 days
-        int extra_days = (getCurrentTime() - account.borrowed_time[book_id]) / 86400 - 15;
-        if (extra_days > 0) {
-            account.prev_fine += 10 * extra_days;
-            cout << "Returned with fine: " << 10 * extra_days << endl;
+// Backoff: Spins, then yields, then sleeps while a queue stays empty
+struct Backoff {
+    unsigned polls = 0;
+
+    void idle() {
+        if (++polls < 64) return;
+        if (polls < 4096) {
+            this_thread::yield();
         } else {
-            cout << "Book returned successfully" << endl;
+            this_thread::sleep_for(chrono::microseconds(50));
         }
-        account.borrowed_time.erase(book_id);
     }
+};
 
-    void displayUserDetails() override {
-        User::displayUserDetails();
-        cout << "Books Currently Borrowed: " << account.borrowed_books.size() << "/3" << endl;
-        cout << "Current Fine: $" << check_fine() << endl;
-        cout << "+-------------------------------------------+" << endl;
+// ShardedEngine Class: Shared-nothing circulation engine partitioned by book id
+// Between start() and stop() the engine owns the loan and reservation state: shard book_id % N holds its
+// copies and runs on its own thread, and a coordinator thread holds what spans shards, the accounts'
+// loan counts, loan times and unpaid fines. Threads share no data; they talk through lock-free queues:
+// - a borrow goes client -> coordinator (limit, overdue, fine and one-copy-per-title checks) -> shard -> client
+// - a reservation goes client -> coordinator (the user is enrolled) -> shard -> client
+// - a return goes client -> shard -> client, and the shard tells the coordinator
+// Replies travel on one SPSC ring per (client, sender) pair. A client has at most WINDOW operations in
+// flight, and every operation has at most two messages queued at once, so the inboxes never fill.
+// stop() writes the state back into the library, with the returns added to the borrowing history.
+// A borrow lends exactly the copy asked for; finding another free copy of the title would span shards.
+class ShardedEngine {
+public:
+    static constexpr size_t INBOX = 1 << 14;
+    static constexpr size_t WINDOW = 64;
+    static constexpr size_t MAX_CLIENTS = 64;
+    static_assert(INBOX >= 2 * MAX_CLIENTS * WINDOW, "an inbox must hold every message that can be in flight");
+    using Inbox = MpscRing<EngineMessage, INBOX>;
+    using ReplyRing = SpscRing<EngineReply, WINDOW>;
+
+    // ShardBook: A copy's circulation state inside its shard
+    struct ShardBook {
+        long long borrowed_time = 0;
+        long long reserved_time = 0;
+        int borrower_id = -1;
+        int reservation_id = -1;
+    };
+
+    // Shard: The copies one thread owns and the returns it has seen
+    struct Shard {
+        Inbox inbox;
+        unordered_map<int, ShardBook> books;
+        vector<HistoryRow> returns;
+        thread worker;
+    };
+
+    // EngineAccount: What the coordinator knows of one account
+    struct EngineAccount {
+        int user_id;
+        int limit;         // 3 for students, 5 for faculty
+        int overdue_days;  // 15 for students, 60 for faculty
+        bool fined;        // students pay for late returns and cannot borrow with a fine due
+        vector<int> admitted;  // copies admitted but not yet confirmed or refused by a shard
+        int prev_fine = 0;
+        vector<pair<int, long long>> loans;  // (book id, borrowed time)
+    };
+
+    vector<unique_ptr<Shard>> shards;
+    unique_ptr<Inbox> coordinator_inbox;
+    vector<EngineAccount> accounts;
+    unordered_map<int, size_t> account_slot;  // user id -> position in accounts
+    unordered_map<int, int> work_of;          // book id -> work id, the coordinator's copy of the catalog
+    vector<unique_ptr<ReplyRing[]>> replies;  // replies[client][sender]: senders are the shards, then the coordinator
+    thread coordinator;
+    atomic<bool> shards_stopping{false};
+    atomic<bool> coordinator_stopping{false};
+    bool running = false;
+
+    ~ShardedEngine() {
+        stop();
     }
 
-    void cancelReservation() {
-        account.view_reserved_books();
-        if (account.reserved_books.empty()) {
-            return;
-        }
-        cout << "Enter book ID to cancel reservation: ";
-        int book_id;
-        cin >> book_id;
-        if (account.cancel_reservation(book_id)) {
-            Book* book = getBook(book_id);
-            if (book && book->reservation_id == user_id) {
-                book->is_reserved = false;
-                book->reservation_id = -1;
-                cout << "Reservation cancelled successfully" << endl;
-            } else {
-                cout << "Invalid book ID or reservation not found" << endl;
+    size_t shardOf(int book_id) const {
+        return (unsigned)book_id % shards.size();
+    }
+
+    // Function to partition the library across shard_count shard threads and start the coordinator
+    void start(size_t shard_count, size_t client_count) {
+        stop();
+        shard_count = max<size_t>(1, shard_count);
+        client_count = min(max<size_t>(1, client_count), MAX_CLIENTS);
+        shards.clear();
+        for (size_t s = 0; s < shard_count; s++) shards.emplace_back(new Shard);
+        work_of.clear();
+        for (const Book& book : library.books) {
+            work_of[book.book_id] = book.work_id;
+            ShardBook& state = shards[shardOf(book.book_id)]->books[book.book_id];
+            if (book.status == BookStatus::Borrowed) {
+                state.borrower_id = book.borrower_id;
+                state.borrowed_time = book.borrowed_time;
             }
-        } else {
-            cout << "Invalid book ID or reservation not found" << endl;
+            if (book.is_reserved) {
+                state.reservation_id = book.reservation_id;
+            }
+        }
+        accounts.clear();
+        account_slot.clear();
+        for (const auto& pair : library.students) addAccount(pair.second, 3, 15, true);
+        for (const auto& pair : library.faculties) addAccount(pair.second, 5, 60, false);
+        // Reservation times live in the accounts
+        for (const EngineAccount& account : accounts) {
+            for (const auto& reserved : userOf(account.user_id)->account.reserved_books) {
+                ShardBook* state = findBook(reserved.first);
+                if (state && state->reservation_id == account.user_id) state->reserved_time = reserved.second;
+            }
+        }
+        coordinator_inbox.reset(new Inbox);
+        replies.clear();
+        for (size_t c = 0; c < client_count; c++) replies.emplace_back(new ReplyRing[shard_count + 1]);
+        shards_stopping.store(false);
+        coordinator_stopping.store(false);
+        for (size_t s = 0; s < shard_count; s++) {
+            shards[s]->worker = thread([this, s] { runShard(s); });
         }
+        coordinator = thread([this] { runCoordinator(); });
+        running = true;
     }
-};
 
-// Class to represent a faculty. It contains a user id, name, email, phone, role, password and an account.
-class Faculty : public User {
-public:
-    Faculty(int user_id, string name, string email, string phone, string password = "password") 
-        : User(user_id, name, email, phone, "Faculty",password) {}
+    // Function to stop the threads once every client has its replies, and write the state back
+    // With no client operation in flight the shard inboxes are empty; the coordinator is stopped after
+    // the shards, since their notices may still be queued for it.
+    void stop() {
+        if (!running) return;
+        running = false;
+        shards_stopping.store(true, memory_order_release);
+        for (auto& shard : shards) shard->worker.join();
+        coordinator_stopping.store(true, memory_order_release);
+        coordinator.join();
+        writeBack();
+    }
 
-    // Function to borrow a book
-    void borrowBook(int book_id) override {
-        Book* book = getBook(book_id);
+    // Function to queue a message, waiting for room (which the window guarantees)
+    static void send(Inbox& inbox, const EngineMessage& message) {
+        Backoff backoff;
+        while (!inbox.push(message)) backoff.idle();
+    }
 
-        // Check if the book exists
-        if (!book) {
-            cout << "Book not found" << endl;
-            return;
-        }
+private:
+    User* userOf(int user_id) {
+        auto student = library.students.find(user_id);
+        if (student != library.students.end()) return student->second;
+        auto faculty = library.faculties.find(user_id);
+        return faculty != library.faculties.end() ? faculty->second : nullptr;
+    }
 
-        // Check if the faculty has already borrowed the book
-        if (find(account.borrowed_books.begin(), account.borrowed_books.end(), book_id) != account.borrowed_books.end()) {
-            cout << "You already have this book." << endl;
-            return;
-        }
+    ShardBook* findBook(int book_id) {
+        auto& books = shards[shardOf(book_id)]->books;
+        auto it = books.find(book_id);
+        return it != books.end() ? &it->second : nullptr;
+    }
 
-        // Check if the faculty has borrowed 5 books
-        if (account.borrowed_books.size() >= 5) {
-            cout << "Limit reached: 5 books" << endl;
-            return;
+    void addAccount(User* user, int limit, int overdue_days, bool fined) {
+        EngineAccount account;
+        account.user_id = user->user_id;
+        account.limit = limit;
+        account.overdue_days = overdue_days;
+        account.fined = fined;
+        account.prev_fine = user->account.prev_fine;
+        for (int book_id : user->account.borrowed_books) {
+            auto it = user->account.borrowed_time.find(book_id);
+            account.loans.push_back({book_id, it != user->account.borrowed_time.end() ? it->second : 0});
         }
+        account_slot[user->user_id] = accounts.size();
+        accounts.push_back(move(account));
+    }
 
-        // Check if the faculty has overdue books
-        if (account.hasOverdue(60)) {
-            cout << "Overdue books detected" << endl;
-            return;
-        }
+    void reply(const EngineMessage& message, size_t sender, EngineStatus status) {
+        replies[message.client][sender].push({message.cookie, status});
+    }
 
-        // Check if the book is available
-        if (book->status == "Available") {
-            // Check if the book is reserved by the same user
-            if ((book->is_reserved && book->reservation_id == user_id) || !book->is_reserved) {
-                book->status = "Borrowed";
-                book->borrower_id = user_id;
-                book->borrowed_time = getCurrentTime();
-                account.borrowed_books.push_back(book_id);
-                account.borrowed_time[book_id] = getCurrentTime();
-                cout << "Book borrowed successfully" << endl;
-                // Clear reservation
-                book->is_reserved = false;
-                book->reservation_id = -1;
-                account.reserved_books.erase(book_id);
-                Library::displayBook(book);
-            } else if (book->is_reserved) {
-                cout << "Book is already reserved by another user." << endl;
-            } else {
-                cout << "Book is available but not reserved by you." << endl;
+    // Function to run one shard: lend, take back and reserve the copies it owns
+    void runShard(size_t index) {
+        Shard& shard = *shards[index];
+        EngineMessage message;
+        Backoff backoff;
+        while (true) {
+            if (!shard.inbox.pop(message)) {
+                if (shards_stopping.load(memory_order_acquire)) break;
+                backoff.idle();
+                continue;
             }
-        } else if (book->status == "Borrowed") {
-            if (book->is_reserved) {
-                cout << "Book is already reserved by another user." << endl;
-            } else {
-                cout << "Book is currently borrowed. Would you like to reserve it? (yes/no)" << endl;
-                string response;
-                cin >> response;
-                if (response == "yes") {
-                    facultyreserveBook(book_id, this);
+            backoff.polls = 0;
+            auto it = shard.books.find(message.book_id);
+            ShardBook* book = it != shard.books.end() ? &it->second : nullptr;
+            if (message.op == EngineOp::Lend) {
+                EngineStatus status = EngineStatus::Ok;
+                if (!book) status = EngineStatus::NotFound;
+                else if (book->borrower_id == message.user_id) status = EngineStatus::AlreadyBorrowed;
+                else if (book->borrower_id != -1) status = EngineStatus::Unavailable;
+                else if (book->reservation_id != -1 && book->reservation_id != message.user_id) status = EngineStatus::Unavailable;
+                if (status == EngineStatus::Ok) {
+                    book->borrower_id = message.user_id;
+                    book->borrowed_time = message.time;
+                    book->reservation_id = -1;
+                    book->reserved_time = 0;
+                }
+                EngineMessage notice = message;
+                notice.op = status == EngineStatus::Ok ? EngineOp::Lent : EngineOp::Refused;
+                send(*coordinator_inbox, notice);
+                reply(message, index, status);
+            } else if (message.op == EngineOp::Return) {
+                if (!book || book->borrower_id != message.user_id) {
+                    reply(message, index, EngineStatus::NotBorrower);
+                    continue;
                 }
+                shard.returns.push_back({message.time, book->borrowed_time, message.user_id, message.book_id});
+                EngineMessage notice = message;
+                notice.op = EngineOp::Returned;
+                notice.return_time = message.time;
+                notice.time = book->borrowed_time;
+                book->borrower_id = -1;
+                book->borrowed_time = 0;
+                send(*coordinator_inbox, notice);
+                reply(message, index, EngineStatus::Ok);
+            } else if (message.op == EngineOp::Hold) {
+                EngineStatus status = EngineStatus::Ok;
+                if (!book) status = EngineStatus::NotFound;
+                else if (book->borrower_id == message.user_id) status = EngineStatus::AlreadyBorrowed;
+                else if (book->reservation_id != -1) status = EngineStatus::Unavailable;
+                if (status == EngineStatus::Ok) {
+                    book->reservation_id = message.user_id;
+                    book->reserved_time = message.time;
+                }
+                reply(message, index, status);
             }
-        } else {
-            cout << "Book is not available" << endl;
         }
     }
 
-    // Function to return a book
-    void returnBook(int book_id) override {
-        Book* book = getBook(book_id);
-
-        // Check if the book exists and is borrowed by the faculty
-        if (!book || book->borrower_id != user_id) {
-            cout << "Invalid return request" << endl;
-            return;
+    // Function to check whether an account has, or has been admitted for, a copy of the same title as book_id
+    bool holdsTitle(const EngineAccount& account, int book_id) const {
+        auto work = work_of.find(book_id);
+        if (work == work_of.end()) return false;
+        auto sameTitle = [this, work](int other) {
+            auto it = work_of.find(other);
+            return it != work_of.end() && it->second == work->second;
+        };
+        for (const auto& loan : account.loans) {
+            if (sameTitle(loan.first)) return true;
         }
-        
-        // Add book to borrowing history
-        account.add_borrowing_history(book, getCurrentTime());
+        return any_of(account.admitted.begin(), account.admitted.end(), sameTitle);
+    }
 
-        //tO return the book
-        book->status = "Available";
-        book->borrower_id = -1;
-        account.borrowed_books.erase(remove(account.borrowed_books.begin(), account.borrowed_books.end(), book_id), account.borrowed_books.end());
-        cout << "Book returned successfully" << endl;
-        account.borrowed_time.erase(book_id);
+    // Function to drop one admitted copy once its shard has answered
+    static void unadmit(EngineAccount& account, int book_id) {
+        auto it = find(account.admitted.begin(), account.admitted.end(), book_id);
+        if (it != account.admitted.end()) account.admitted.erase(it);
     }
 
-    void displayUserDetails() override {
-        User::displayUserDetails();
-        cout << "Books Currently Borrowed: " << account.borrowed_books.size() << "/5" << endl;
-        cout << "+-------------------------------------------+" << endl;
+    // Function to run the coordinator: admit borrows against the account limits and track loans and fines
+    void runCoordinator() {
+        EngineMessage message;
+        Backoff backoff;
+        size_t sender = shards.size();
+        while (true) {
+            if (!coordinator_inbox->pop(message)) {
+                if (coordinator_stopping.load(memory_order_acquire)) break;
+                backoff.idle();
+                continue;
+            }
+            backoff.polls = 0;
+            auto slot = account_slot.find(message.user_id);
+            if (slot == account_slot.end()) {
+                if (message.op == EngineOp::Borrow || message.op == EngineOp::Reserve) reply(message, sender, EngineStatus::UnknownUser);
+                continue;
+            }
+            EngineAccount& account = accounts[slot->second];
+            if (message.op == EngineOp::Reserve) {
+                EngineMessage hold = message;
+                hold.op = EngineOp::Hold;
+                send(shards[shardOf(message.book_id)]->inbox, hold);
+            } else if (message.op == EngineOp::Borrow) {
+                EngineStatus status = EngineStatus::Ok;
+                if (account.loans.size() + account.admitted.size() >= (size_t)account.limit) status = EngineStatus::LimitReached;
+                for (const auto& loan : account.loans) {
+                    if (status == EngineStatus::Ok && calendar.daysLate(loan.second, message.time, account.overdue_days) > 0) status = EngineStatus::Overdue;
+                }
+                // One copy of a title per user, as in borrowBook(); admitted copies count as on loan
+                if (status == EngineStatus::Ok && holdsTitle(account, message.book_id)) status = EngineStatus::AlreadyBorrowed;
+                if (status == EngineStatus::Ok && account.fined && account.prev_fine > 0) status = EngineStatus::FineDue;
+                if (status != EngineStatus::Ok) {
+                    reply(message, sender, status);
+                    continue;
+                }
+                account.admitted.push_back(message.book_id);
+                EngineMessage lend = message;
+                lend.op = EngineOp::Lend;
+                send(shards[shardOf(message.book_id)]->inbox, lend);
+            } else if (message.op == EngineOp::Lent) {
+                unadmit(account, message.book_id);
+                account.loans.push_back({message.book_id, message.time});
+            } else if (message.op == EngineOp::Refused) {
+                unadmit(account, message.book_id);
+            } else if (message.op == EngineOp::Returned) {
+                for (size_t i = 0; i < account.loans.size(); i++) {
+                    if (account.loans[i].first != message.book_id) continue;
+                    account.loans[i] = account.loans.back();
+                    account.loans.pop_back();
+                    break;
+                }
+                long long extra_days = calendar.daysLate(message.time, message.return_time, 15);
+                if (account.fined && extra_days > 0) account.prev_fine += 10 * extra_days;
+            }
+        }
     }
 
-    void cancelReservation() {
-        account.view_reserved_books();
-        if (account.reserved_books.empty()) {
-            return;
+    // Function to copy the engine's state back into the library and the accounts
+    void writeBack() {
+        VersionedWrite write;
+        for (auto& shard : shards) {
+            for (const auto& pair : shard->books) {
+                Book* book = getBook(pair.first);
+                if (!book) continue;
+                const ShardBook& state = pair.second;
+                book->status = state.borrower_id != -1 ? BookStatus::Borrowed : BookStatus::Available;
+                book->borrower_id = state.borrower_id;
+                book->borrowed_time = state.borrowed_time;
+                book->is_reserved = state.reservation_id != -1;
+                book->reservation_id = state.reservation_id;
+                syncBookState(book);
+            }
         }
-        cout << "Enter book ID to cancel reservation: ";
-        int book_id;
-        cin >> book_id;
-        if (account.cancel_reservation(book_id)) {
-            Book* book = getBook(book_id);
-            if (book && book->reservation_id == user_id) {
-                book->is_reserved = false;
-                book->reservation_id = -1;
-                cout << "Reservation cancelled successfully" << endl;
-            } else {
-                cout << "Invalid book ID or reservation not found" << endl;
+        for (const EngineAccount& engine_account : accounts) {
+            User* user = userOf(engine_account.user_id);
+            catalog_versions.markUser(engine_account.user_id);
+            Account& account = user->account;
+            account.borrowed_books.clear();
+            account.borrowed_time.clear();
+            account.reserved_books.clear();
+            for (const auto& loan : engine_account.loans) {
+                account.borrowed_books.push_back(loan.first);
+                account.borrowed_time[loan.first] = loan.second;
             }
-        } else {
-            cout << "Invalid book ID or reservation not found" << endl;
+        }
+        for (auto& shard : shards) {
+            for (const auto& pair : shard->books) {
+                if (pair.second.reservation_id == -1) continue;
+                User* user = userOf(pair.second.reservation_id);
+                if (user) user->account.reserved_books[pair.first] = pair.second.reserved_time;
+            }
+            for (const HistoryRow& row : shard->returns) {
+                User* user = userOf(row.user_id);
+                if (!user) continue;
+                user->account.add_borrowing_history(row.book_id, row.borrowed_time, row.return_time);
+                // The coordinator applied the same charge to its copy of the balance; the ledger gets the row
+                long long extra_days = calendar.daysLate(row.borrowed_time, row.return_time, 15);
+                if (user->paysLateFines() && extra_days > 0) user->account.charge_fine(row.book_id, 10 * extra_days, row.return_time);
+            }
+            shard->returns.clear();
         }
     }
 };
 
-//These Function are defined afterwards as they use the classes defined above. (Student, Faculty)
-//Forward Declarations
-Student* getStudent(int user_id);
-Faculty* getFaculty(int user_id);
-// Function to add a student to the library
-void addstudent(Student* user) {
-    if(library.students.find(user->user_id) != library.students.end() || library.faculties.find(user->user_id) != library.faculties.end() || user->user_id==1){
-        cout << "User ID already exists. Details of the existing user:" << endl;
-        if (library.students.find(user->user_id) != library.students.end()) {
-            getStudent(user->user_id)->displayUserDetails();
-        } else if(library.faculties.find(user->user_id) != library.faculties.end()){
-            getFaculty(user->user_id)->displayUserDetails();
-        }
-        else{
-            cout<<"User ID 1 is reserved for Librarian!!"<<endl;
-        }
-        return;
+// EngineClient Class: One thread's connection to the sharded engine
+// Each client id must be used by one thread at a time; its replies arrive on rings only it reads.
+class EngineClient {
+public:
+    ShardedEngine& engine;
+    size_t id;
+    size_t in_flight = 0;
+
+    EngineClient(ShardedEngine& engine, size_t id) : engine(engine), id(id) {}
+
+    // Function to send an operation tagged with cookie; false when WINDOW operations are already in flight
+    bool submit(EngineOp op, int user_id, int book_id, uint32_t cookie) {
+        if (in_flight == ShardedEngine::WINDOW) return false;
+        EngineMessage message{op, (uint16_t)id, cookie, user_id, book_id, getCurrentTime(), 0};
+        bool coordinated = op == EngineOp::Borrow || op == EngineOp::Reserve;
+        ShardedEngine::send(coordinated ? *engine.coordinator_inbox : engine.shards[engine.shardOf(book_id)]->inbox, message);
+        in_flight++;
+        return true;
     }
-    library.students[user->user_id] = user;
-    cout << "Student added successfully" << endl;
-}
 
-// Function to add a faculty to the library
-void addFaculty(Faculty* user) {
-    if(library.faculties.find(user->user_id) != library.faculties.end() || library.students.find(user->user_id) != library.students.end() || user->user_id==1){
-        cout << "User ID already exists. Details of the existing user:" << endl;
-        if (library.faculties.find(user->user_id) != library.faculties.end()) {
-            getFaculty(user->user_id)->displayUserDetails();    
-        } else if(library.students.find(user->user_id) != library.students.end()){
-            getStudent(user->user_id)->displayUserDetails();
-        }
-        else{
-            cout<<"User ID 1 is reserved for Librarian!!"<<endl;
+    // Function to hand every waiting reply to f and return how many there were
+    template <typename F>
+    size_t poll(F f) {
+        size_t received = 0;
+        EngineReply reply;
+        for (size_t sender = 0; sender <= engine.shards.size(); sender++) {
+            while (engine.replies[id][sender].pop(reply)) {
+                in_flight--;
+                received++;
+                f(reply);
+            }
         }
-        return;
+        return received;
     }
-    library.faculties[user->user_id] = user;
-    cout << "Faculty added successfully" << endl;
-}
 
-// Function to remove a student from the library
-void removeStudent(int user_id) {
-    if(library.students.erase(user_id)){
-        cout << "Student removed successfully" << endl;
-    } else {
-        cout << "Student not found" << endl;
+    // Function to run one operation and wait for its result; nothing else may be in flight
+    EngineStatus call(EngineOp op, int user_id, int book_id) {
+        submit(op, user_id, book_id, 0);
+        EngineStatus status = EngineStatus::Ok;
+        Backoff backoff;
+        while (!poll([&status](const EngineReply& reply) { status = reply.status; })) backoff.idle();
+        return status;
     }
-}
+};
 
-// Function to remove a faculty from the library
-void removeFaculty(int user_id) {
-    if(library.faculties.erase(user_id)){
-        cout << "Faculty removed successfully" << endl;
-    } else {
-        cout << "Faculty not found" << endl;
+// Function to run f(begin, end) over [0, n) split into contiguous ranges, one per hardware thread
+template <typename F>
+void parallelRanges(size_t n, F f) {
+    size_t workers = max(1u, thread::hardware_concurrency());
+    workers = max<size_t>(1, min(workers, n / 1024));
+    vector<thread> threads;
+    for (size_t w = 0; w < workers; w++) {
+        size_t begin = n * w / workers, end = n * (w + 1) / workers;
+        threads.emplace_back([&f, begin, end]() { f(begin, end); });
+    }
+    for (auto& t : threads) {
+        t.join();
     }
 }
 
-// Function to reserve a book
-void studentreserveBook(int book_id, Student* user) {
-    Book* book = getBook(book_id);
-    if (!book) {
-        cout << "Book not found" << endl;
-        return;
-    }
-    if (book->is_reserved) {
-        cout << "Book is already reserved" << endl;
-        return;
+// Function to index the start of every line in a buffer so lines can be handed out to threads
+vector<size_t> lineStarts(const string& data) {
+    vector<size_t> starts;
+    size_t begin = 0;
+    while (begin < data.size()) {
+        starts.push_back(begin);
+        size_t end = data.find('\n', begin);
+        if (end == string::npos) break;
+        begin = end + 1;
     }
-    book->is_reserved = true;
-    book->reservation_id = user->user_id;
-    user->account.reserved_books[book_id] = getCurrentTime();
-    cout << "Book reserved successfully" << endl;
+    return starts;
 }
 
-// Function to cancel a reservation
-void studentcancelReservation(int book_id, Student* user) {
-    Book* book = getBook(book_id);
-    if (!book) {
-        cout << "Book not found" << endl;
-        return;
-    }
-    if (!book->is_reserved || book->reservation_id != user->user_id) {
-        cout << "Invalid reservation" << endl;
-        return;
-    }
-    book->is_reserved = false;
-    book->reservation_id = -1;
-    cout << "Reservation cancelled successfully" << endl;
+// Function to get line i of a buffer indexed by lineStarts(), without the line break
+string_view lineAt(const string& data, const vector<size_t>& starts, size_t i) {
+    size_t end = i + 1 < starts.size() ? starts[i + 1] - 1 : data.size();
+    string_view line(data.data() + starts[i], end - starts[i]);
+    if (!line.empty() && line.back() == '\n') line.remove_suffix(1);
+    if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+    return line;
 }
 
-// Function to reserve a book
-void facultyreserveBook(int book_id, Faculty* user) {
-    Book* book = getBook(book_id);
-    if (!book) {
-        cout << "Book not found" << endl;
-        return;
-    }
-    if (book->is_reserved) {
-        cout << "Book is already reserved" << endl;
-        return;
+// Function to guess the delimiter of an import file from its first line
+char detectDelimiter(string_view line) {
+    if (line.find('|') != string_view::npos) return '|';
+    if (line.find('\t') != string_view::npos) return '\t';
+    return ',';
+}
+
+// Function to split a delimited line; double-quoted fields may contain the delimiter and "" escapes
+vector<string> splitFields(string_view line, char delimiter) {
+    vector<string> fields(1);
+    bool quoted = false;
+    for (size_t i = 0; i < line.size(); i++) {
+        char c = line[i];
+        if (quoted) {
+            if (c == '"' && i + 1 < line.size() && line[i + 1] == '"') {
+                fields.back() += '"';
+                i++;
+            } else if (c == '"') {
+                quoted = false;
+            } else {
+                fields.back() += c;
+            }
+        } else if (c == '"' && fields.back().empty()) {
+            quoted = true;
+        } else if (c == delimiter) {
+            fields.emplace_back();
+        } else {
+            fields.back() += c;
+        }
     }
-    book->is_reserved = true;
-    book->reservation_id = user->user_id;
-    user->account.reserved_books[book_id] = getCurrentTime();
-    cout << "Book reserved successfully" << endl;
+    return fields;
 }
 
-// Function to cancel a reservation
-void facultycancelReservation(int book_id, Faculty* user) {
-    Book* book = getBook(book_id);
-    if (!book) {
-        cout << "Book not found" << endl;
-        return;
+// Function to write the rejected rows of a bulk import and summarise them
+static void writeRejectedRows(const string& path, const vector<pair<size_t, string>>& rejected) {
+    if (rejected.empty()) return;
+    ofstream report(path);
+    for (const auto& row : rejected) {
+        report << "line " << row.first << ": " << row.second << "\n";
     }
-    if (!book->is_reserved || book->reservation_id != user->user_id) {
-        cout << "Invalid reservation" << endl;
-        return;
+    cout << rejected.size() << " rows rejected, see " << path << endl;
+    for (size_t i = 0; i < rejected.size() && i < 5; i++) {
+        cout << "  line " << rejected[i].first << ": " << rejected[i].second << endl;
     }
-    book->is_reserved = false;
-    book->reservation_id = -1;
-    cout << "Reservation cancelled successfully" << endl;
 }
 
-// Class to represent a librarian. It contains a user id, name, email, phone, role, password and an account.
-class Librarian : public User {
-public:
-    Librarian(int user_id, string name, string email, string phone, string password = "password") 
-        : User(user_id, name, email, phone, "Librarian",password) {}
+// ImportedBook: One parsed row of a bulk catalog import
+struct ImportedBook {
+    int book_id = 0;
+    int year = 0;
+    string title, author, publisher, isbn;
+    string error;  // empty when the row passed validation
+};
 
-    //Below Two Functions are Dummy Functions as Librarian cannot borrow or return books
-    // Function to borrow a book    
-    void borrowBook(int book_id) override {
-        cout << "Librarians cannot borrow books." <<book_id<< endl;
+// Function to bulk import books from a delimited file (book_id, title, author, publisher, isbn, year[, ...])
+// Rows are parsed and validated on all threads with the same rules as the Add Book prompt, then checked
+// against the id index in one pass and committed together. Rows whose ISBN is already in the catalog
+// become new copies of that work. Rejected rows are written to error_path. Returns false if the file cannot be read.
+bool importBooks(const string& path, const string& error_path) {
+    auto start = chrono::steady_clock::now();
+    ifstream file(path, ios::binary);
+    if (!file) {
+        cout << "Cannot open " << path << endl;
+        return false;
     }
-
-    // Function to return a book
-    void returnBook(int book_id) override {
-        cout << "Librarians cannot return books." <<book_id<< endl;
+    string data((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+    if (file.bad()) {
+        cout << "Cannot read " << path << endl;
+        return false;
     }
-
-    //Main Functions for Librarian
-    // Function to add a book to the library
-    void add_Book_to_Lib(const Book& book) {
-        addBook(book);
+    vector<size_t> starts = lineStarts(data);
+    if (starts.empty()) {
+        cout << "Nothing to import" << endl;
+        return true;
     }
-
-    // Function to remove a book from the library
-    void remove_Book_from_Lib(int book_id) {
-        removeBook(book_id);
+    char delimiter = detectDelimiter(lineAt(data, starts, 0));
+    // A first line without a numeric id is a header
+    int header_id;
+    size_t first = parseNumber(splitFields(lineAt(data, starts, 0), delimiter)[0], header_id) ? 0 : 1;
+
+    vector<ImportedBook> rows(starts.size());
+    parallelRanges(starts.size(), [&](size_t begin, size_t end) {
+        for (size_t i = max(begin, first); i < end; i++) {
+            string_view line = lineAt(data, starts, i);
+            ImportedBook& row = rows[i];
+            if (line.empty()) {
+                row.error = "-";
+                continue;
+            }
+            vector<string> fields = splitFields(line, delimiter);
+            if (fields.size() < 6) {
+                row.error = "expected at least 6 fields, found " + to_string(fields.size());
+            } else if (!parseNumber(fields[0], row.book_id)) {
+                row.error = "Invalid book ID (must be numeric)";
+            } else if (fields[1].empty()) {
+                row.error = "Title cannot be empty";
+            } else if (fields[2].empty()) {
+                row.error = "Author cannot be empty";
+            } else if (fields[3].empty()) {
+                row.error = "Publisher cannot be empty";
+            } else if (fields[4].empty()) {
+                row.error = "ISBN cannot be empty";
+            } else if (!isValidTextField(fields[1]) || !isValidTextField(fields[2]) || !isValidTextField(fields[3]) || !isValidTextField(fields[4])) {
+                row.error = "Fields cannot contain '|' or line breaks";
+            } else if (!parseNumber(fields[5], row.year) || !isValidBookInput(row.book_id, row.year)) {
+                row.error = "Invalid year";
+            } else {
+                row.title = move(fields[1]);
+                row.author = move(fields[2]);
+                row.publisher = move(fields[3]);
+                row.isbn = move(fields[4]);
+            }
+        }
+    });
+
+    // One pass over the id and ISBN indexes and the ids and ISBNs seen earlier in the file
+    vector<pair<size_t, string>> rejected;
+    unordered_map<int, size_t> seen;
+    unordered_map<string, size_t> seen_isbns;  // ISBN -> first accepted row of it not already in the library
+    seen.reserve(rows.size());
+    for (size_t i = first; i < rows.size(); i++) {
+        ImportedBook& row = rows[i];
+        if (row.error == "-") continue;
+        if (row.error.empty()) {
+            auto known = library.isbn_index.find(row.isbn);
+            auto earlier = known == library.isbn_index.end() ? seen_isbns.find(row.isbn) : seen_isbns.end();
+            const ImportedBook* first_row = earlier != seen_isbns.end() ? &rows[earlier->second] : nullptr;
+            if (library.book_index.find(row.book_id) != library.book_index.end()) {
+                row.error = "Book ID " + to_string(row.book_id) + " already exists";
+            } else if (known != library.isbn_index.end() && !library.works[known->second].sameDetails(row.title, row.author, row.publisher, row.year)) {
+                row.error = "ISBN " + row.isbn + " already belongs to \"" + library.works[known->second].title + "\"";
+            } else if (first_row && (first_row->title != row.title || first_row->author != row.author || first_row->publisher != row.publisher || first_row->year != row.year)) {
+                row.error = "ISBN " + row.isbn + " has different details on line " + to_string(earlier->second + 1);
+            } else if (!seen.emplace(row.book_id, i + 1).second) {
+                row.error = "Book ID " + to_string(row.book_id) + " repeats line " + to_string(seen[row.book_id]);
+            } else if (known == library.isbn_index.end()) {
+                seen_isbns.emplace(row.isbn, i);
+            }
+        }
+        if (!row.error.empty()) {
+            rejected.push_back({i + 1, row.error});
+        }
     }
 
-    // Function to add a student to the library
-    void add_student_to_Lib(Student*user) {
-        addstudent(user);
+    // Commit every accepted row in one batch
+    size_t works_before = library.works.size();
+    size_t accepted = 0;
+    library.books.reserve(library.books.size() + seen.size());
+    library.book_index.reserve(library.books.size() + seen.size());
+    for (size_t i = first; i < rows.size(); i++) {
+        ImportedBook& row = rows[i];
+        if (!row.error.empty()) continue;
+        int work_id = findOrAddWork(Work(move(row.title), move(row.author), move(row.publisher), move(row.isbn), row.year));
+        insertCopy(Book(row.book_id, work_id));
+        accepted++;
     }
+    catalog_versions.rebuild();
+    auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+    cout << "Imported " << accepted << " books (" << library.works.size() - works_before << " new titles) in " << elapsed << " ms" << endl;
+    writeRejectedRows(error_path, rejected);
+    return true;
+}
 
-    // Function to add a faculty to the library
-    void add_faculty_to_Lib(Faculty*user) {
-        addFaculty(user);
-    }
+// EnrolledUser: One parsed row of a bulk enrolment roster
+struct EnrolledUser {
+    int user_id = 0;
+    int roll_number = 0;
+    bool is_student = true;
+    string name, email, phone;
+    string error;  // empty when the row passed validation
+};
 
-    // Function to remove a student from the library
-    void remove_student_from_Lib(int user_id) {
-        removeStudent(user_id);
+// Function to bulk enrol students and faculty from a roster file (role, user_id, name, email, phone[, roll_number])
+// Emails and phones are validated on all threads, ids are checked against every role and the rest of the
+// roster in one indexed pass, and accepted users are inserted in one batch. Rejected rows go to error_path.
+// Returns false if the file cannot be read.
+bool enrolUsers(const string& path, const string& error_path) {
+    auto start = chrono::steady_clock::now();
+    ifstream file(path, ios::binary);
+    if (!file) {
+        cout << "Cannot open " << path << endl;
+        return false;
     }
-
-    // Function to remove a faculty from the library
-    void remove_faculty_from_Lib(int user_id) {
-        removeFaculty(user_id);
+    string data((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+    if (file.bad()) {
+        cout << "Cannot read " << path << endl;
+        return false;
     }
-
-    void displayUserDetails() override {
-        User::displayUserDetails();
-        cout << "+-------------------------------------------+" << endl;
+    vector<size_t> starts = lineStarts(data);
+    if (starts.empty()) {
+        cout << "Nothing to enrol" << endl;
+        return true;
     }
-
-    // Add new methods to view all students and faculty
-    void viewAllStudents() {
-        cout << "\n+-------------------------------------------+" << endl;
-        cout << "| All Registered Students                   |" << endl;
-        cout << "+-------------------------------------------+" << endl;
-        if (library.students.empty()) {
-            cout << "No students registered in the system." << endl;
-        } else {
-            for (const auto& pair : library.students) {
-                Student* student = pair.second;
-                student->displayUserDetails();
-                cout << endl;
+    char delimiter = detectDelimiter(lineAt(data, starts, 0));
+    vector<string> header = splitFields(lineAt(data, starts, 0), delimiter);
+    // A first line without a numeric id is a header
+    int header_id;
+    size_t first = header.size() > 1 && parseNumber(header[1], header_id) ? 0 : 1;
+
+    vector<EnrolledUser> rows(starts.size());
+    parallelRanges(starts.size(), [&](size_t begin, size_t end) {
+        for (size_t i = max(begin, first); i < end; i++) {
+            string_view line = lineAt(data, starts, i);
+            EnrolledUser& row = rows[i];
+            if (line.empty()) {
+                row.error = "-";
+                continue;
+            }
+            vector<string> fields = splitFields(line, delimiter);
+            if (fields.size() < 5) {
+                row.error = "expected at least 5 fields, found " + to_string(fields.size());
+            } else if (fields[0] != "Student" && fields[0] != "Faculty") {
+                row.error = "Invalid role (must be Student or Faculty)";
+            } else if (!parseNumber(fields[1], row.user_id) || !isValidUserId(row.user_id)) {
+                row.error = "Invalid user ID (must be numeric)";
+            } else if (fields[2].empty()) {
+                row.error = "Name cannot be empty";
+            } else if (!isValidTextField(fields[2]) || !isValidTextField(fields[3])) {
+                row.error = "Fields cannot contain '|' or line breaks";
+            } else if (!isValidEmail(fields[3])) {
+                row.error = "Invalid email format";
+            } else if (!isValidPhone(fields[4])) {
+                row.error = "Invalid phone number (must be 10 digits)";
+            } else if (fields.size() > 5 && !parseNumber(fields[5], row.roll_number)) {
+                row.error = "Invalid roll number";
+            } else {
+                row.is_student = fields[0] == "Student";
+                row.name = move(fields[2]);
+                row.email = move(fields[3]);
+                row.phone = move(fields[4]);
+            }
+        }
+    });
+
+    // One pass over the id indexes of every role and the ids seen earlier in the roster
+    vector<pair<size_t, string>> rejected;
+    unordered_map<int, size_t> seen;
+    seen.reserve(rows.size());
+    for (size_t i = first; i < rows.size(); i++) {
+        EnrolledUser& row = rows[i];
+        if (row.error == "-") continue;
+        if (row.error.empty()) {
+            int id = row.user_id;
+            if (id == 1 || library.librarians.count(id)) {
+                row.error = "User ID " + to_string(id) + " is reserved for a librarian";
+            } else if (library.students.count(id) || library.faculties.count(id)) {
+                row.error = "User ID " + to_string(id) + " already exists";
+            } else if (!seen.emplace(id, i + 1).second) {
+                row.error = "User ID " + to_string(id) + " repeats line " + to_string(seen[id]);
             }
         }
+        if (!row.error.empty()) {
+            rejected.push_back({i + 1, row.error});
+        }
     }
 
-    void viewAllFaculty() {
-        cout << "\n+-------------------------------------------+" << endl;
-        cout << "| All Registered Faculty Members            |" << endl;
-        cout << "+-------------------------------------------+" << endl;
-        if (library.faculties.empty()) {
-            cout << "No faculty members registered in the system." << endl;
+    // Insert every accepted user in one batch
+    size_t students = 0, faculty = 0;
+    library.students.reserve(library.students.size() + seen.size());
+    library.faculties.reserve(library.faculties.size() + seen.size());
+    for (size_t i = first; i < rows.size(); i++) {
+        EnrolledUser& row = rows[i];
+        if (!row.error.empty()) continue;
+        if (row.is_student) {
+            library.students[row.user_id] = new Student(row.user_id, row.name, row.email, row.phone, row.roll_number);
+            students++;
         } else {
-            for (const auto& pair : library.faculties) {
-                Faculty* faculty = pair.second;
-                faculty->displayUserDetails();
-                cout << endl;
-            }
+            library.faculties[row.user_id] = new Faculty(row.user_id, row.name, row.email, row.phone);
+            faculty++;
         }
     }
-};
+    catalog_versions.rebuild();
+    auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+    cout << "Enrolled " << students << " students and " << faculty << " faculty in " << elapsed << " ms" << endl;
+    writeRejectedRows(error_path, rejected);
+    return true;
+}
 
+// Function to map a timestamp to a month index (year * 12 + month - 1) without calling gmtime
+int monthIndex(long long timestamp) {
+    long long days = dayOf(timestamp);
+    // civil_from_days: proleptic Gregorian calendar from days since 1970-01-01
+    days += 719468;
+    long long era = (days >= 0 ? days : days - 146096) / 146097;
+    long long doe = days - era * 146097;
+    long long yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    long long doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    long long mp = (5 * doy + 2) / 153;
+    long long month = mp < 10 ? mp + 3 : mp - 9;
+    long long year = yoe + era * 400 + (month <= 2);
+    return year * 12 + month - 1;
+}
 
-//These could be used further but are not used in the current implementation as I assumed that there will be only one librarian!!
-// Function to add a librarian to the library
-void addLibrarian(Librarian* user) {
-    if(library.librarians.find(user->user_id) != library.librarians.end()){
-        cout << "User already exists" << endl;
-        return;
+// CirculationStats: Circulation counts aggregated from history and current loans
+// Each worker thread fills its own partial copy, and the partials are merged at the end.
+struct CirculationStats {
+    unordered_map<int, long long> loans_per_book;
+    map<int, long long> checkouts_per_month;  // month index -> loans started
+    map<int, long long> returns_per_month;    // month index -> loans returned
+    long long loan_seconds = 0;               // total length of completed loans with a known start
+    long long timed_loans = 0;
+    long long completed_loans = 0;
+    long long active_loans = 0;
+
+    void addCompletedLoan(int book_id, long long borrowed_time, long long return_time) {
+        loans_per_book[book_id]++;
+        returns_per_month[monthIndex(return_time)]++;
+        completed_loans++;
+        if (borrowed_time > 0) {
+            checkouts_per_month[monthIndex(borrowed_time)]++;
+            loan_seconds += return_time - borrowed_time;
+            timed_loans++;
+        }
     }
-    library.librarians[user->user_id] = user;
-    cout << "Librarian added successfully" << endl;
-}
 
-// Function to remove a librarian from the library
-void removeLibrarian(int user_id) {
-    if (library.librarians.erase(user_id)) {
-        cout << "User removed successfully" << endl;
-    } else {
-        cout << "User not found" << endl;
+    void addActiveLoan(int book_id, long long borrowed_time) {
+        loans_per_book[book_id]++;
+        checkouts_per_month[monthIndex(borrowed_time)]++;
+        active_loans++;
     }
-}
 
-// Function to get a student by its id
-Student* getStudent(int user_id) {
-    auto it = library.students.find(user_id);
-    if (it != library.students.end()) {
-        return it->second;
+    void merge(const CirculationStats& other) {
+        for (const auto& pair : other.loans_per_book) loans_per_book[pair.first] += pair.second;
+        for (const auto& pair : other.checkouts_per_month) checkouts_per_month[pair.first] += pair.second;
+        for (const auto& pair : other.returns_per_month) returns_per_month[pair.first] += pair.second;
+        loan_seconds += other.loan_seconds;
+        timed_loans += other.timed_loans;
+        completed_loans += other.completed_loans;
+        active_loans += other.active_loans;
     }
-    return nullptr;
-}
+};
 
-// Function to get a faculty by its id
-Faculty* getFaculty(int user_id) {
-    auto it = library.faculties.find(user_id);
-    if (it != library.faculties.end()) {
-        return it->second;
+// Function to add one account's unsaved history and current loans to the stats
+static void addAccountLoans(Account& account, CirculationStats& stats) {
+    for (size_t i = account.saved_history; i < account.borrowing_history.size(); i++) {
+        const HistoryEntry& entry = account.borrowing_history[i];
+        stats.addCompletedLoan(entry.book_id, entry.borrowed_time, entry.return_time);
+    }
+    for (const auto& pair : account.borrowed_time) {
+        stats.addActiveLoan(pair.first, pair.second);
     }
-    return nullptr;
 }
 
-// Function to get a librarian by its id
-Librarian* getLibrarian(int user_id) {
-    auto it = library.librarians.find(user_id);
-    if (it != library.librarians.end()) {
-        return it->second;
+// Function to aggregate circulation over every history segment in parallel plus the in-memory loans
+// A worker takes the next month, reads it and cuts it into line-aligned slices of about SLICE_BYTES that any
+// idle worker may parse, so one large month is spread over every thread instead of landing on one.
+CirculationStats computeCirculationStats() {
+    constexpr size_t SLICE_BYTES = 1 << 20;
+    struct Slice {
+        shared_ptr<const string> data;
+        size_t begin, end;
+    };
+    vector<string> months = history_store.segments();
+    size_t workers = max(1u, thread::hardware_concurrency());
+    vector<CirculationStats> partials(workers);
+    mutex queue_mutex;
+    condition_variable queued;
+    deque<Slice> slices;
+    size_t next_month = 0, reading = 0;
+
+    vector<thread> threads;
+    for (size_t w = 0; w < workers; w++) {
+        threads.emplace_back([&, w]() {
+            CirculationStats& stats = partials[w];
+            while (true) {
+                Slice slice;
+                string month;
+                {
+                    // Wait while another worker is still reading a month that may yield slices
+                    unique_lock<mutex> lock(queue_mutex);
+                    queued.wait(lock, [&] { return !slices.empty() || next_month < months.size() || reading == 0; });
+                    if (!slices.empty()) {
+                        slice = move(slices.front());
+                        slices.pop_front();
+                    } else if (next_month < months.size()) {
+                        month = months[next_month++];
+                        reading++;
+                    } else {
+                        break;
+                    }
+                }
+                if (!slice.data) {
+                    auto data = make_shared<string>();
+                    storage->load(history_store.segmentTable(month), *data);
+                    vector<Slice> cut;
+                    for (size_t begin = 0; begin < data->size();) {
+                        size_t end = data->find('\n', min(data->size(), begin + SLICE_BYTES));
+                        end = end == string::npos ? data->size() : end + 1;
+                        cut.push_back({data, begin, end});
+                        begin = end;
+                    }
+                    {
+                        lock_guard<mutex> lock(queue_mutex);
+                        reading--;
+                        for (size_t i = 1; i < cut.size(); i++) slices.push_back(cut[i]);
+                    }
+                    queued.notify_all();
+                    if (cut.empty()) continue;
+                    slice = cut[0];
+                }
+                HistoryStore::forEachLine(string_view(*slice.data).substr(slice.begin, slice.end - slice.begin), [&stats](int, const HistoryEntry& entry) {
+                    stats.addCompletedLoan(entry.book_id, entry.borrowed_time, entry.return_time);
+                });
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
     }
-    return nullptr;
-}
 
-// Function to save books to a file
-void saveBooks() {
-    ofstream file("books.txt");
-    for (const auto& book : library.books) {
-        file << book.book_id << "|" << book.title << "|" << book.author << "|" << book.publisher << "|" << book.isbn << "|" << book.year << "|" << book.status << "|" << book.borrower_id << "|" << book.borrowed_time << "|" << book.is_reserved << "|" << book.reservation_id << endl;
+    CirculationStats total;
+    for (const auto& partial : partials) {
+        total.merge(partial);
     }
-    file.close();
+    for (const auto& pair : library.students) {
+        addAccountLoans(pair.second->account, total);
+    }
+    for (const auto& pair : library.faculties) {
+        addAccountLoans(pair.second->account, total);
+    }
+    return total;
 }
 
-// Function to load books from a file
-void loadBooks() {
-    ifstream file("books.txt");
-    if (!file) return;
-    
-    library.books.clear();
-    string line;
-    while (getline(file, line)) {
-        stringstream ss(line);
-        string temp;
-        int id, year, borrower_id, reservation_id;
-        string title, author, publisher, isbn, status;
-        long long borrowed_time;
-        bool is_reserved;
-
-        getline(ss, temp, '|'); id = stoi(temp);
-        getline(ss, title, '|');
-        getline(ss, author, '|');
-        getline(ss, publisher, '|');
-        getline(ss, isbn, '|');
-        getline(ss, temp, '|'); year = stoi(temp);
-        getline(ss, status, '|');
-        getline(ss, temp, '|'); borrower_id = stoi(temp);
-        getline(ss, temp, '|'); borrowed_time = stoll(temp);
-        getline(ss, temp, '|'); is_reserved = (temp == "1");
-        getline(ss, temp, '|'); reservation_id = stoi(temp);
-
-        Book book(id, title, author, publisher, isbn, year, status, borrower_id, borrowed_time, is_reserved, reservation_id);
-        library.books.push_back(book);
+// Function to print the top entries of a count table
+static void printTopCounts(const string& heading, const unordered_map<string, long long>& counts, size_t top_n) {
+    vector<pair<long long, string>> ranked;
+    ranked.reserve(counts.size());
+    for (const auto& pair : counts) {
+        ranked.push_back({pair.second, pair.first});
+    }
+    size_t shown = min(top_n, ranked.size());
+    partial_sort(ranked.begin(), ranked.begin() + shown, ranked.end(), [](const auto& a, const auto& b) {
+        return a.first != b.first ? a.first > b.first : a.second < b.second;
+    });
+    cout << "\n" << heading << ":" << endl;
+    if (shown == 0) {
+        cout << "No loans recorded" << endl;
+    }
+    for (size_t i = 0; i < shown; i++) {
+        cout << i + 1 << ". " << ranked[i].second << " - " << ranked[i].first << " loans" << endl;
     }
-    file.close();
 }
 
-// Function to save students to a file
-void saveStudents() {
-    ofstream file("students.txt");
-    for (const auto& pair: library.students) {
-        Student* student = pair.second;
-        file << student->user_id << "|" << student->name << "|" << student->email << "|" << student->phone << "|" << student->role << "|" << student->view_password() << endl;
+// Function to print one section of the circulation report (0 prints every section)
+void displayCirculationReport(const CirculationStats& stats, int section, size_t top_n) {
+    if (section == 0 || section == 1 || section == 2 || section == 3) {
+        unordered_map<string, long long> per_title, per_author, per_publisher;
+        for (const auto& pair : stats.loans_per_book) {
+            Book* book = getBook(pair.first);
+            if (!book) {
+                per_title["Book ID " + to_string(pair.first) + " (removed)"] += pair.second;
+                continue;
+            }
+            const Work* work = getWork(book->work_id);
+            per_title[work->title] += pair.second;
+            per_author[work->author] += pair.second;
+            per_publisher[work->publisher] += pair.second;
+        }
+        if (section == 0 || section == 1) printTopCounts("Most Borrowed Titles", per_title, top_n);
+        if (section == 0 || section == 2) printTopCounts("Loans by Author", per_author, top_n);
+        if (section == 0 || section == 3) printTopCounts("Loans by Publisher", per_publisher, top_n);
+    }
+    if (section == 0 || section == 4) {
+        cout << "\nLoan Duration:" << endl;
+        cout << "Completed loans: " << stats.completed_loans << endl;
+        cout << "Active loans: " << stats.active_loans << endl;
+        if (stats.timed_loans > 0) {
+            cout << "Average loan duration: " << fixed << setprecision(1) << double(stats.loan_seconds) / stats.timed_loans / 86400 << " days" << endl;
+            cout.unsetf(ios::floatfield);
+        } else {
+            cout << "Average loan duration: no loans with a recorded start" << endl;
+        }
+    }
+    if (section == 0 || section == 5) {
+        cout << "\nMonthly Circulation (checkouts / returns):" << endl;
+        map<int, pair<long long, long long>> months;
+        for (const auto& pair : stats.checkouts_per_month) months[pair.first].first = pair.second;
+        for (const auto& pair : stats.returns_per_month) months[pair.first].second = pair.second;
+        if (months.empty()) {
+            cout << "No loans recorded" << endl;
+        }
+        for (const auto& pair : months) {
+            int month = pair.first % 12 + 1;
+            cout << pair.first / 12 << "-" << (month < 10 ? "0" : "") << month << ": " << pair.second.first << " / " << pair.second.second << endl;
+        }
     }
-    file.close();
 }
 
-// Function to load students from a file
-void loadStudents() {
-    ifstream file("students.txt");
-    if (!file) return;
-    
-    library.students.clear();
-    string line;
-    while (getline(file, line)) {
-        stringstream ss(line);
-        string temp;
-        int user_id;
-        string name, email, phone, role, password;
+// Function to compute and display circulation reports with the time taken
+void runCirculationReport(int section, size_t top_n) {
+    auto start = chrono::steady_clock::now();
+    CirculationStats stats = computeCirculationStats();
+    auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+    displayCirculationReport(stats, section, top_n);
+    cout << "\nReport computed in " << elapsed << " ms" << endl;
+}
 
-        getline(ss, temp, '|'); user_id = stoi(temp);
-        getline(ss, name, '|');
-        getline(ss, email, '|');
-        getline(ss, phone, '|');
-        getline(ss, role, '|');
-        getline(ss, password, '|');
+// FinesReport: Outstanding fines of every account, taken from one catalog version
+struct FinesReport {
+    uint64_t version = 0;
+    size_t loans = 0;          // copies out on loan
+    size_t overdue_loans = 0;  // loans old enough to be fined
+    size_t account_loans = 0;  // loans as the accounts count them; equal to loans in a consistent version
+    long long accrued = 0;     // fines building up on current loans
+    long long unpaid = 0;      // fines charged on returns and not yet paid
+    vector<tuple<long long, int, string>> owing;  // (amount, user id, name), largest first
+};
 
-        Student* student = new Student(user_id, name, email, phone, 0, password);
-        library.students[user_id] = student;
+// Function to sweep the fines of every account in a catalog version
+FinesReport computeFines(const CatalogVersion& version, long long now) {
+    FinesReport report;
+    report.version = version.number;
+    for (size_t slot = 0; slot < version.book_count; slot++) {
+        const Book& book = version.book(slot);
+        if (book.status != BookStatus::Borrowed) continue;
+        report.loans++;
+        if (calendar.daysLate(book.borrowed_time, now, 15) > 0) report.overdue_loans++;
     }
-    file.close();
-}
-
-// Function to save faculties to a file
-void saveFaculties() {
-    ofstream file("faculties.txt");
-    for (const auto& pair: library.faculties) {
-        Faculty* faculty = pair.second;
-        file << faculty->user_id << "|" << faculty->name << "|" << faculty->email << "|" << faculty->phone << "|" << faculty->role << "|" << faculty->view_password() << endl;
+    unordered_map<int, long long> accrued = accruedFines(version, now);
+    for (size_t slot = 0; slot < version.account_count; slot++) {
+        const AccountVersion& account = version.account(slot);
+        if (!account.active) continue;
+        report.account_loans += account.loans;
+        auto it = accrued.find(account.record->user_id);
+        long long fine = it != accrued.end() ? it->second : 0;
+        report.accrued += fine;
+        report.unpaid += account.prev_fine;
+        if (fine + account.prev_fine > 0) report.owing.emplace_back(fine + account.prev_fine, account.record->user_id, account.record->name);
     }
-    file.close();
+    sort(report.owing.begin(), report.owing.end(), [](const auto& a, const auto& b) { return get<0>(a) > get<0>(b); });
+    return report;
 }
 
-// Function to load faculties from a file
-void loadFaculties() {
-    ifstream file("faculties.txt");
-    if (!file) return;
-    
-    library.faculties.clear();
-    string line;
-    while (getline(file, line)) {
-        stringstream ss(line);
-        string temp;
-        int user_id;
-        string name, email, phone, role, password;
-
-        getline(ss, temp, '|'); user_id = stoi(temp);
-        getline(ss, name, '|');
-        getline(ss, email, '|');
-        getline(ss, phone, '|');
-        getline(ss, role, '|');
-        getline(ss, password, '|');
-
-        Faculty* faculty = new Faculty(user_id, name, email, phone, password);
-        library.faculties[user_id] = faculty;
+// Function to print the fines sweep with the top_n accounts that owe the most
+void runFinesReport(size_t top_n) {
+    auto start = chrono::steady_clock::now();
+    VersionView view;
+    if (!view.version) {
+        cout << "No accounts loaded" << endl;
+        return;
     }
-    file.close();
+    FinesReport report = computeFines(*view.version, getCurrentTime());
+    auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+    cout << "\nOutstanding Fines (catalog version " << report.version << "):" << endl;
+    cout << "Loans: " << report.loans << " (" << report.overdue_loans << " overdue)" << endl;
+    cout << "Accruing on current loans: " << report.accrued << endl;
+    cout << "Charged and unpaid: " << report.unpaid << endl;
+    cout << "Accounts owing: " << report.owing.size() << endl;
+    for (size_t i = 0; i < report.owing.size() && i < top_n; i++) {
+        cout << "  " << get<1>(report.owing[i]) << " " << get<2>(report.owing[i]) << ": " << get<0>(report.owing[i]) << endl;
+    }
+    cout << "\nReport computed in " << elapsed << " ms" << endl;
 }
 
-// Function to save librarians to a file
-void saveLibrarians() {
-    ofstream file("librarians.txt");
-    for (const auto& pair : library.librarians) {
-        Librarian* librarian = pair.second;
-        file << librarian->user_id << "|" << librarian->name << "|" << librarian->email << "|" << librarian->phone << "|" << librarian->role << "|" << librarian->view_password() << endl;
+// Function to print the fine ledger month by month, streaming one segment at a time
+// The ledger's net per user is checked against the cached balances the accounts hold; returns the number of
+// accounts that disagree.
+size_t runFineLedgerReport() {
+    auto start = chrono::steady_clock::now();
+    unordered_map<int, long long> net;
+    long long total_charged = 0, total_paid = 0;
+    size_t rows = 0;
+    string data;
+    cout << "\nFine Ledger:" << endl;
+    cout << left << setw(10) << "Month" << setw(10) << "Charges" << setw(12) << "Charged" << setw(10) << "Payments" << "Paid" << endl;
+    for (const string& month : fine_ledger.months()) {
+        size_t charges = 0, payments = 0;
+        long long charged = 0, paid = 0;
+        auto add = [&](const FineEntry& entry) {
+            net[entry.user_id] += entry.amount;
+            if (entry.amount >= 0) {
+                charges++;
+                charged += entry.amount;
+            } else {
+                payments++;
+                paid -= entry.amount;
+            }
+        };
+        if (storage->load(fine_ledger.segmentTable(month), data)) forEachRow<FineEntry>(data, add);
+        auto pending = fine_ledger.pending.find(month);
+        if (pending != fine_ledger.pending.end()) forEachRow<FineEntry>(pending->second, add);
+        cout << left << setw(10) << month << setw(10) << charges << setw(12) << charged << setw(10) << payments << paid << endl;
+        total_charged += charged;
+        total_paid += paid;
+        rows += charges + payments;
     }
-    file.close();
+    cout << right;
+
+    size_t mismatched = 0;
+    long long cached = 0;
+    for (const FineBalance& balance : fineBalances()) {
+        cached += balance.balance;
+        auto it = net.find(balance.user_id);
+        if (it == net.end() || it->second != balance.balance) mismatched++;
+        if (it != net.end()) it->second = 0;
+    }
+    for (const auto& pair : net) {
+        if (pair.second != 0) mismatched++;
+    }
+    auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+    cout << "Rows: " << rows << ", charged: " << total_charged << ", paid: " << total_paid << ", outstanding: " << total_charged - total_paid << endl;
+    cout << "Cached balances: " << cached;
+    if (mismatched == 0) {
+        cout << " (agree with the ledger)" << endl;
+    } else {
+        cout << " (" << mismatched << " accounts disagree with the ledger)" << endl;
+    }
+    cout << "\nReport computed in " << elapsed << " ms" << endl;
+    return mismatched;
 }
 
-// Function to load librarians from a file
-void loadLibrarians() {
-    ifstream file("librarians.txt");
-    if (!file) return;
-    
-    library.librarians.clear();
-    string line;
-    while (getline(file, line)) {
-        stringstream ss(line);
-        string temp;
-        int user_id;
-        string name, email, phone, role, password;
+// IntegrityCheck: Cross-table invariants verified by the integrity checker, in report order
+enum class IntegrityCheck {
+    CopyState, CopyBitmaps, CopyBorrowerUnknown, CopyLoanNotInAccount, CopyReserverUnknown, CopyReservationNotInAccount,
+    CopyReservedByBorrower, FreeList, LoanBookUnknown, LoanNotOnCopy, LoanTime, LoanDuplicate, ReservationBookUnknown,
+    ReservationNotOnCopy, OverLimit, SharedUserId, FineBalance, HistoryIndex, HistoryTimes, HistoryUnknownUser,
+    HistoryUnknownBook, LedgerUnknownUser, Count
+};
 
-        getline(ss, temp, '|'); user_id = stoi(temp);
-        getline(ss, name, '|');
-        getline(ss, email, '|');
-        getline(ss, phone, '|');
-        getline(ss, role, '|');
-        getline(ss, password, '|');
+// IntegrityCheckInfo: How a check is reported and repaired; repair is null for checks that are only reported,
+// and a note is expected in a healthy library (rows kept for books or users that have since been removed)
+struct IntegrityCheckInfo {
+    const char* description;
+    const char* repair;
+    bool note;
+};
 
-        Librarian* librarian = new Librarian(user_id, name, email, phone, password);
-        library.librarians[user_id] = librarian;
-    }
-    file.close();
+const IntegrityCheckInfo& integrityCheckInfo(IntegrityCheck check) {
+    static const IntegrityCheckInfo info[] = {
+        {"copy status disagrees with its borrower or reservation fields", "cleared the stray field", false},
+        {"availability bitmaps or free list slot disagree with the copy", "recomputed from the copy", false},
+        {"copy lent to a user who does not exist", "put the copy back on the shelf", false},
+        {"copy lent but missing from the borrower's loans", "added the loan to the account", false},
+        {"copy reserved for a user who does not exist", "cleared the reservation", false},
+        {"copy reserved but missing from the user's reservations", "added the reservation to the account", false},
+        {"copy reserved for its own borrower", "cleared the reservation", false},
+        {"free list of a title disagrees with its free copies", "rebuilt the free list", false},
+        {"loan of a book that is not in the catalog", "dropped the loan", false},
+        {"loan the copy does not show", "lent the copy if it was free, otherwise dropped the loan", false},
+        {"loan time differs from the copy's", "took the copy's time", false},
+        {"the same loan listed twice", "removed the duplicate", false},
+        {"reservation of a book that is not in the catalog", "dropped the reservation", false},
+        {"reservation the copy does not show", "reserved the copy if it was free, otherwise dropped the reservation", false},
+        {"account over its loan limit", nullptr, false},
+        {"user id used by more than one role", nullptr, false},
+        {"fine balance disagrees with the fine ledger", "took the ledger's balance", false},
+        {"history segment missing from the user's index entry", "added the index entry", false},
+        {"history row returned before it was borrowed", nullptr, false},
+        {"history rows of users no longer enrolled (not loaded)", nullptr, true},
+        {"history rows of books no longer in the catalog", nullptr, true},
+        {"fine ledger rows of users no longer enrolled", nullptr, true},
+    };
+    return info[static_cast<int>(check)];
 }
 
-// Function to save borrowing history to a file
-void saveBorrowingHistory() {
-    ofstream file("borrowing_history.txt");
-    for (const auto& pair: library.students) {
-        Student* user = pair.second;
-        for (const auto& history_pair : user->account.borrowing_history) {
-            Book* book = history_pair.first;
-            long long return_time = history_pair.second;
-            file << user->user_id << "|" << book->book_id << "|" << return_time << endl;
-        }
+// IntegrityIssue: One mismatch; value is the ledger balance of a FineBalance issue or the work id of a FreeList one
+struct IntegrityIssue {
+    IntegrityCheck check;
+    int user_id = -1;
+    int book_id = -1;
+    long long value = 0;
+    string month;  // history segment of a HistoryIndex issue
+};
+
+// IntegrityChecker Class: fsck for the loaded library, the history segments and the fine ledger
+// Copies, titles and accounts are checked against each other through the id indexes in parallel ranges; the
+// history and ledger segments are read and checked in parallel, one month per task. The passes only read, so
+// every issue is found against the same state. repair() then fixes the repairable ones on the calling thread
+// under one catalog version. Where a copy and an account disagree and the copy is free, the account's loan or
+// reservation is kept and put back on the copy; where the copy is held by someone else, the copy wins.
+class IntegrityChecker {
+public:
+    static constexpr size_t CHECKS = static_cast<size_t>(IntegrityCheck::Count);
+    static constexpr size_t MAX_EXAMPLES = 5;
+
+    array<size_t, CHECKS> found{}, repaired{};
+    vector<IntegrityIssue> issues;  // every repairable issue, and the first MAX_EXAMPLES of the others
+    size_t copies = 0, accounts = 0, history_rows = 0, ledger_rows = 0;
+    double seconds = 0;
+
+    void run() {
+        auto start = chrono::steady_clock::now();
+        found.fill(0);
+        repaired.fill(0);
+        issues.clear();
+        copies = library.books.size();
+        checkCopies();
+        checkTitles();
+        checkAccounts();
+        checkSegments();
+        seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
     }
-    for (const auto& pair: library.faculties) {
-        Faculty* user = pair.second;
-        for (const auto& history_pair : user->account.borrowing_history) {
-            Book* book = history_pair.first;
-            long long return_time = history_pair.second;
-            file << user->user_id << "|" << book->book_id << "|" << return_time << endl;
+
+    // Function to count the issues that are not notes
+    size_t errors() const {
+        size_t total = 0;
+        for (size_t c = 0; c < CHECKS; c++) {
+            if (!integrityCheckInfo(static_cast<IntegrityCheck>(c)).note) total += found[c];
         }
+        return total;
     }
-    file.close();
-}
 
-// Function to load borrowing history from a file
-void loadBorrowingHistory() {
-    ifstream file("borrowing_history.txt");
-    if (!file) return;
+    // Function to count the issues repair() can fix
+    size_t repairable() const {
+        size_t total = 0;
+        for (size_t c = 0; c < CHECKS; c++) {
+            if (integrityCheckInfo(static_cast<IntegrityCheck>(c)).repair) total += found[c];
+        }
+        return total;
+    }
 
-    string line;
-    while (getline(file, line)) {
-        stringstream ss(line);
-        string temp;
-        int user_id, book_id;
-        long long return_time;
+    // Function to fix every repairable issue found by the last run; returns how many changed something
+    // Each fix looks at the state again first, since an earlier fix may already have settled it.
+    size_t repair() {
+        VersionedWrite write;
+        size_t total = 0;
+        for (const IntegrityIssue& issue : issues) {
+            if (integrityCheckInfo(issue.check).repair && repairOne(issue)) {
+                repaired[static_cast<int>(issue.check)]++;
+                total++;
+            }
+        }
+        history_store.flushIndex();
+        return total;
+    }
 
-        getline(ss, temp, '|'); user_id = stoi(temp);
-        getline(ss, temp, '|'); book_id = stoi(temp);
-        getline(ss, temp, '|'); return_time = stoll(temp);
+    void print(ostream& out) const {
+        ios::fmtflags flags = out.flags();
+        out << "Checked " << copies << " copies, " << accounts << " accounts, " << history_rows << " history rows and " << ledger_rows
+            << " ledger rows in " << fixed << setprecision(2) << seconds << " s" << endl;
+        for (size_t c = 0; c < CHECKS; c++) {
+            if (found[c] == 0) continue;
+            const IntegrityCheckInfo& info = integrityCheckInfo(static_cast<IntegrityCheck>(c));
+            out << (info.note ? "  note: " : "  ") << found[c] << " x " << info.description;
+            if (repaired[c]) out << " (" << info.repair << ": " << repaired[c] << ")";
+            out << endl;
+            size_t shown = 0;
+            for (const IntegrityIssue& issue : issues) {
+                if (static_cast<size_t>(issue.check) != c || shown++ == MAX_EXAMPLES) continue;
+                string where;
+                if (issue.user_id != -1) where += " user " + to_string(issue.user_id);
+                if (issue.book_id != -1) where += " book " + to_string(issue.book_id);
+                if (!issue.month.empty()) where += " segment " + issue.month;
+                if (issue.check == IntegrityCheck::FineBalance) where += " ledger balance " + to_string(issue.value);
+                if (issue.check == IntegrityCheck::FreeList) where += " title \"" + library.works[issue.value].title + "\"";
+                out << "     " << where << endl;
+            }
+        }
+        if (errors() == 0) out << "No integrity errors found" << endl;
+        else out << errors() << " integrity errors found, " << repairable() << " repairable" << endl;
+        out.flags(flags);
+    }
 
-        if (library.students.find(user_id) != library.students.end()) {
-            Book* book = getBook(book_id);
-            if (book) {
-                library.students[user_id]->account.borrowing_history.push_back({book, return_time});
+private:
+    // Partial: One worker's findings, merged under a lock when the worker finishes
+    struct Partial {
+        array<size_t, CHECKS> found{};
+        vector<IntegrityIssue> issues;
+        size_t rows = 0;
+
+        void add(IntegrityCheck check, int user_id, int book_id, long long value = 0, const string& month = string()) {
+            int c = static_cast<int>(check);
+            if (found[c]++ < MAX_EXAMPLES || integrityCheckInfo(check).repair) issues.push_back({check, user_id, book_id, value, month});
+        }
+    };
+
+    // IdSet: Dense membership bitmap for the per-row lookups of the segment pass; ids too large to map go to a hash set
+    struct IdSet {
+        static constexpr int DENSE_LIMIT = 1 << 26;
+        Bitmap dense;
+        unordered_set<int> sparse;
+
+        void build(const vector<int>& ids) {
+            int top = 0;
+            for (int id : ids) {
+                if (id >= 0 && id < DENSE_LIMIT) top = max(top, id + 1);
+            }
+            dense.resize(top);
+            for (int id : ids) {
+                if (id >= 0 && id < top) dense.set(id, true);
+                else sparse.insert(id);
             }
         }
-        if (library.faculties.find(user_id) != library.faculties.end()) {
-            Book* book = getBook(book_id);
-            if (book) {
-                library.faculties[user_id]->account.borrowing_history.push_back({book, return_time});
+
+        bool contains(int id) const {
+            return id >= 0 && (size_t)id < dense.bits ? dense.test(id) : sparse.count(id) > 0;
+        }
+    };
+
+    mutex merge_mutex;
+
+    void merge(Partial& partial) {
+        lock_guard<mutex> lock(merge_mutex);
+        array<size_t, CHECKS> kept{};
+        for (const IntegrityIssue& issue : issues) kept[static_cast<int>(issue.check)]++;
+        for (IntegrityIssue& issue : partial.issues) {
+            int c = static_cast<int>(issue.check);
+            if (kept[c] < MAX_EXAMPLES || integrityCheckInfo(issue.check).repair) {
+                kept[c]++;
+                issues.push_back(move(issue));
             }
         }
+        for (size_t c = 0; c < CHECKS; c++) found[c] += partial.found[c];
     }
-    file.close();
-}
 
-// Function to save currently borrowed books to a file
-void savecurrentlyborrowed() {
-    ofstream file("currently_borrowed.txt");
-    for (const auto& pair: library.students) {
-        Student* user = pair.second;
-        for (int book_id : user->account.borrowed_books) {
-            file << user->user_id << "|" << book_id << "|" << user->account.borrowed_time[book_id] << endl;
-        }
+    static User* accountHolder(int user_id) {
+        User* user = getStudent(user_id);
+        return user ? user : getFaculty(user_id);
     }
-    for (const auto& pair: library.faculties) {
-        Faculty* user = pair.second;
-        for (int book_id : user->account.borrowed_books) {
-            file << user->user_id << "|" << book_id << "|" << user->account.borrowed_time[book_id] << endl;
-        }
+
+    // Pass 1: every copy against its own fields, the bitmaps and the accounts it names
+    void checkCopies() {
+        parallelRanges(library.books.size(), [this](size_t begin, size_t end) {
+            Partial partial;
+            for (size_t slot = begin; slot < end; slot++) {
+                const Book& book = library.books[slot];
+                bool lent = book.status == BookStatus::Borrowed;
+                if (lent != (book.borrower_id != -1) || book.is_reserved != (book.reservation_id != -1)) {
+                    partial.add(IntegrityCheck::CopyState, -1, book.book_id);
+                }
+                bool free = !lent && !book.is_reserved;
+                if (library.available_map.test(slot) != !lent || library.borrowed_map.test(slot) != lent ||
+                    library.reserved_map.test(slot) != book.is_reserved || free != (book.free_slot >= 0)) {
+                    partial.add(IntegrityCheck::CopyBitmaps, -1, book.book_id);
+                }
+                if (lent && book.borrower_id != -1) {
+                    User* borrower = accountHolder(book.borrower_id);
+                    if (!borrower) partial.add(IntegrityCheck::CopyBorrowerUnknown, book.borrower_id, book.book_id);
+                    else if (!borrower->account.borrowed_time.count(book.book_id)) partial.add(IntegrityCheck::CopyLoanNotInAccount, book.borrower_id, book.book_id);
+                }
+                if (book.is_reserved && book.reservation_id != -1) {
+                    User* holder = accountHolder(book.reservation_id);
+                    if (!holder) partial.add(IntegrityCheck::CopyReserverUnknown, book.reservation_id, book.book_id);
+                    else if (!holder->account.reserved_books.count(book.book_id)) partial.add(IntegrityCheck::CopyReservationNotInAccount, book.reservation_id, book.book_id);
+                    if (lent && book.reservation_id == book.borrower_id) partial.add(IntegrityCheck::CopyReservedByBorrower, book.reservation_id, book.book_id);
+                }
+            }
+            merge(partial);
+        });
     }
-    file.close();
-}
 
-// Function to load currently borrowed books from a file
-void loadcurrentlyborrowed() {
-    ifstream file("currently_borrowed.txt");
-    if (!file) return;
+    // Pass 2: every title's free list against the state of its copies
+    void checkTitles() {
+        parallelRanges(library.works.size(), [this](size_t begin, size_t end) {
+            Partial partial;
+            for (size_t work_id = begin; work_id < end; work_id++) {
+                const Work& work = library.works[work_id];
+                size_t free_count = 0;
+                bool valid = true;
+                for (int book_id : work.copies) {
+                    auto it = library.book_index.find(book_id);
+                    if (it == library.book_index.end()) continue;
+                    const Book& book = library.books[it->second];
+                    if (book.status != BookStatus::Available || book.is_reserved) continue;
+                    free_count++;
+                    valid = valid && book.free_slot >= 0 && book.free_slot < (int)work.free_copies.size() && work.free_copies[book.free_slot] == book_id;
+                }
+                if (!valid || free_count != work.free_copies.size()) partial.add(IntegrityCheck::FreeList, -1, -1, work_id);
+            }
+            merge(partial);
+        });
+    }
 
-    string line;
-    while (getline(file, line)) {
-        stringstream ss(line);
-        string temp;
-        int user_id, book_id;
-        long long borrowed_time;
+    // Pass 3: every student and faculty account against the copies it names, plus ids shared between roles
+    void checkAccounts() {
+        vector<User*> users;
+        users.reserve(library.students.size() + library.faculties.size());
+        for (const auto& pair : library.students) users.push_back(pair.second);
+        for (const auto& pair : library.faculties) users.push_back(pair.second);
+        accounts = users.size();
+        parallelRanges(users.size(), [this, &users](size_t begin, size_t end) {
+            Partial partial;
+            vector<int> sorted;
+            for (size_t i = begin; i < end; i++) {
+                User* user = users[i];
+                const Account& account = user->account;
+                int user_id = user->user_id;
+                sorted = account.borrowed_books;
+                sort(sorted.begin(), sorted.end());
+                for (size_t j = 1; j < sorted.size(); j++) {
+                    if (sorted[j] == sorted[j - 1]) partial.add(IntegrityCheck::LoanDuplicate, user_id, sorted[j]);
+                }
+                sorted.erase(unique(sorted.begin(), sorted.end()), sorted.end());
+                if ((int)sorted.size() > user->loanLimit()) partial.add(IntegrityCheck::OverLimit, user_id, -1);
+                for (int book_id : sorted) {
+                    Book* book = getBook(book_id);
+                    auto time = account.borrowed_time.find(book_id);
+                    if (!book) partial.add(IntegrityCheck::LoanBookUnknown, user_id, book_id);
+                    else if (book->status != BookStatus::Borrowed || book->borrower_id != user_id) partial.add(IntegrityCheck::LoanNotOnCopy, user_id, book_id);
+                    else if (time == account.borrowed_time.end() || time->second != book->borrowed_time) partial.add(IntegrityCheck::LoanTime, user_id, book_id);
+                }
+                for (const auto& reserved : account.reserved_books) {
+                    Book* book = getBook(reserved.first);
+                    if (!book) partial.add(IntegrityCheck::ReservationBookUnknown, user_id, reserved.first);
+                    else if (!book->is_reserved || book->reservation_id != user_id) partial.add(IntegrityCheck::ReservationNotOnCopy, user_id, reserved.first);
+                }
+            }
+            merge(partial);
+        });
+
+        Partial shared;
+        for (const auto& pair : library.students) {
+            if (library.faculties.count(pair.first) || library.librarians.count(pair.first)) shared.add(IntegrityCheck::SharedUserId, pair.first, -1);
+        }
+        for (const auto& pair : library.faculties) {
+            if (library.librarians.count(pair.first)) shared.add(IntegrityCheck::SharedUserId, pair.first, -1);
+        }
+        merge(shared);
+    }
 
-        getline(ss, temp, '|'); user_id = stoi(temp);
-        getline(ss, temp, '|'); book_id = stoi(temp);
-        getline(ss, temp, '|'); borrowed_time = stoll(temp);
+    // Pass 4: the history and fine ledger segments, one month per task, then the ledger totals against the accounts
+    void checkSegments() {
+        vector<string> history_months = history_store.segments();
+        vector<string> ledger_months = fine_ledger.months();
+        size_t tasks = history_months.size() + ledger_months.size();
+        size_t workers = max(1u, thread::hardware_concurrency());
+        workers = min(workers, max<size_t>(1, tasks));
+        vector<unordered_map<int, long long>> balances(workers);
+        vector<size_t> history_counts(workers), ledger_counts(workers);
+        IdSet enrolled, catalog;
+        vector<int> ids;
+        for (const auto& pair : library.students) ids.push_back(pair.first);
+        for (const auto& pair : library.faculties) ids.push_back(pair.first);
+        enrolled.build(ids);
+        ids.clear();
+        for (const Book& book : library.books) ids.push_back(book.book_id);
+        catalog.build(ids);
+        atomic<size_t> next(0);
+        vector<thread> threads;
+        for (size_t w = 0; w < workers; w++) {
+            threads.emplace_back([&, w]() {
+                Partial partial;
+                vector<int> segment_users;
+                for (size_t i = next++; i < tasks; i = next++) {
+                    if (i < history_months.size()) {
+                        const string& month = history_months[i];
+                        segment_users.clear();
+                        history_store.forEachInSegment(month, [&](int user_id, const HistoryEntry& entry) {
+                            history_counts[w]++;
+                            segment_users.push_back(user_id);
+                            if (!enrolled.contains(user_id)) partial.add(IntegrityCheck::HistoryUnknownUser, user_id, entry.book_id, 0, month);
+                            if (!catalog.contains(entry.book_id)) partial.add(IntegrityCheck::HistoryUnknownBook, user_id, entry.book_id, 0, month);
+                            if (entry.borrowed_time != 0 && entry.return_time < entry.borrowed_time) partial.add(IntegrityCheck::HistoryTimes, user_id, entry.book_id, 0, month);
+                        });
+                        sort(segment_users.begin(), segment_users.end());
+                        segment_users.erase(unique(segment_users.begin(), segment_users.end()), segment_users.end());
+                        for (int user_id : segment_users) {
+                            if (!enrolled.contains(user_id)) continue;
+                            auto it = history_store.user_segments.find(user_id);
+                            if (it == history_store.user_segments.end() || !binary_search(it->second.begin(), it->second.end(), month)) {
+                                partial.add(IntegrityCheck::HistoryIndex, user_id, -1, 0, month);
+                            }
+                        }
+                        continue;
+                    }
+                    const string& month = ledger_months[i - history_months.size()];
+                    auto addEntry = [&](const FineEntry& entry) {
+                        ledger_counts[w]++;
+                        balances[w][entry.user_id] += entry.amount;
+                    };
+                    string data;
+                    if (storage->load(fine_ledger.segmentTable(month), data)) forEachRow<FineEntry>(data, addEntry);
+                    auto pending = fine_ledger.pending.find(month);
+                    if (pending != fine_ledger.pending.end()) forEachRow<FineEntry>(pending->second, addEntry);
+                }
+                merge(partial);
+            });
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+        history_rows = accumulate(history_counts.begin(), history_counts.end(), size_t(0));
+        ledger_rows = accumulate(ledger_counts.begin(), ledger_counts.end(), size_t(0));
 
-        if (library.students.find(user_id) != library.students.end()) {
-            library.students[user_id]->account.borrowed_books.push_back(book_id);
-            library.students[user_id]->account.borrowed_time[book_id] = borrowed_time;
+        unordered_map<int, long long> ledger;
+        for (const auto& partial : balances) {
+            for (const auto& pair : partial) ledger[pair.first] += pair.second;
+        }
+        Partial fines;
+        auto checkBalance = [&](int user_id, const User* user) {
+            auto it = ledger.find(user_id);
+            long long balance = it == ledger.end() ? 0 : it->second;
+            if (user->account.prev_fine != balance) fines.add(IntegrityCheck::FineBalance, user_id, -1, balance);
+            if (it != ledger.end()) ledger.erase(it);
+        };
+        for (const auto& pair : library.students) checkBalance(pair.first, pair.second);
+        for (const auto& pair : library.faculties) checkBalance(pair.first, pair.second);
+        for (const auto& pair : ledger) {
+            if (!library.librarians.count(pair.first)) fines.add(IntegrityCheck::LedgerUnknownUser, pair.first, -1);
         }
-        if (library.faculties.find(user_id) != library.faculties.end()) {
-            library.faculties[user_id]->account.borrowed_books.push_back(book_id);
-            library.faculties[user_id]->account.borrowed_time[book_id] = borrowed_time;
+        merge(fines);
+    }
+
+    static void dropLoan(Account& account, int book_id) {
+        account.borrowed_books.erase(remove(account.borrowed_books.begin(), account.borrowed_books.end(), book_id), account.borrowed_books.end());
+        account.borrowed_time.erase(book_id);
+    }
+
+    bool repairOne(const IntegrityIssue& issue) {
+        User* user = accountHolder(issue.user_id);
+        Book* book = issue.book_id != -1 ? getBook(issue.book_id) : nullptr;
+        if (user) catalog_versions.markUser(issue.user_id);
+        switch (issue.check) {
+            case IntegrityCheck::CopyState:
+                if (!book) return false;
+                if (book->status == BookStatus::Borrowed && book->borrower_id == -1) book->status = BookStatus::Available;
+                if (book->status == BookStatus::Available) book->borrower_id = -1;
+                if (book->is_reserved && book->reservation_id == -1) book->is_reserved = false;
+                if (!book->is_reserved) book->reservation_id = -1;
+                syncBookState(book);
+                return true;
+            case IntegrityCheck::CopyBitmaps:
+                if (!book) return false;
+                syncBookState(book);
+                return true;
+            case IntegrityCheck::CopyBorrowerUnknown:
+                if (!book || book->borrower_id != issue.user_id || user) return false;
+                book->status = BookStatus::Available;
+                book->borrower_id = -1;
+                syncBookState(book);
+                return true;
+            case IntegrityCheck::CopyLoanNotInAccount:
+                if (!book || !user || book->status != BookStatus::Borrowed || book->borrower_id != issue.user_id || user->account.borrowed_time.count(issue.book_id)) return false;
+                user->account.borrowed_books.push_back(issue.book_id);
+                user->account.borrowed_time[issue.book_id] = book->borrowed_time;
+                return true;
+            case IntegrityCheck::CopyReserverUnknown:
+            case IntegrityCheck::CopyReservedByBorrower:
+                if (!book || !book->is_reserved || book->reservation_id != issue.user_id) return false;
+                if (issue.check == IntegrityCheck::CopyReserverUnknown && user) return false;
+                book->is_reserved = false;
+                book->reservation_id = -1;
+                if (user) user->account.reserved_books.erase(issue.book_id);
+                syncBookState(book);
+                return true;
+            case IntegrityCheck::CopyReservationNotInAccount:
+                if (!book || !user || !book->is_reserved || book->reservation_id != issue.user_id || user->account.reserved_books.count(issue.book_id)) return false;
+                user->account.reserved_books[issue.book_id] = getCurrentTime();
+                return true;
+            case IntegrityCheck::FreeList: {
+                Work& work = library.works[issue.value];
+                work.free_copies.clear();
+                for (int book_id : work.copies) {
+                    Book* copy = getBook(book_id);
+                    if (copy) copy->free_slot = -1;
+                }
+                for (int book_id : work.copies) {
+                    Book* copy = getBook(book_id);
+                    if (copy) syncBookState(copy);
+                }
+                return true;
+            }
+            case IntegrityCheck::LoanBookUnknown:
+                if (!user || book) return false;
+                dropLoan(user->account, issue.book_id);
+                return true;
+            case IntegrityCheck::LoanNotOnCopy: {
+                if (!user || !book || (book->status == BookStatus::Borrowed && book->borrower_id == issue.user_id)) return false;
+                bool claimable = book->status == BookStatus::Available && (!book->is_reserved || book->reservation_id == issue.user_id);
+                if (!claimable) {
+                    dropLoan(user->account, issue.book_id);
+                    return true;
+                }
+                auto time = user->account.borrowed_time.find(issue.book_id);
+                book->status = BookStatus::Borrowed;
+                book->borrower_id = issue.user_id;
+                book->borrowed_time = time != user->account.borrowed_time.end() ? time->second : getCurrentTime();
+                user->account.borrowed_time[issue.book_id] = book->borrowed_time;
+                if (book->is_reserved) user->account.reserved_books.erase(issue.book_id);
+                book->is_reserved = false;
+                book->reservation_id = -1;
+                syncBookState(book);
+                return true;
+            }
+            case IntegrityCheck::LoanTime:
+                if (!user || !book || book->status != BookStatus::Borrowed || book->borrower_id != issue.user_id) return false;
+                user->account.borrowed_time[issue.book_id] = book->borrowed_time;
+                return true;
+            case IntegrityCheck::LoanDuplicate: {
+                if (!user) return false;
+                vector<int>& loans = user->account.borrowed_books;
+                auto first = find(loans.begin(), loans.end(), issue.book_id);
+                if (first == loans.end()) return false;
+                auto extra = find(first + 1, loans.end(), issue.book_id);
+                if (extra == loans.end()) return false;
+                loans.erase(extra);
+                return true;
+            }
+            case IntegrityCheck::ReservationBookUnknown:
+                if (!user || book) return false;
+                return user->account.reserved_books.erase(issue.book_id) > 0;
+            case IntegrityCheck::ReservationNotOnCopy:
+                if (!user || !book || (book->is_reserved && book->reservation_id == issue.user_id)) return false;
+                if (book->is_reserved || (book->status == BookStatus::Borrowed && book->borrower_id == issue.user_id)) {
+                    return user->account.reserved_books.erase(issue.book_id) > 0;
+                }
+                book->is_reserved = true;
+                book->reservation_id = issue.user_id;
+                syncBookState(book);
+                return true;
+            case IntegrityCheck::FineBalance:
+                if (!user || user->account.prev_fine == issue.value) return false;
+                user->account.prev_fine = issue.value;
+                return true;
+            case IntegrityCheck::HistoryIndex:
+                history_store.noteEntry(issue.user_id, issue.month);
+                return true;
+            default:
+                return false;
         }
     }
-    file.close();
+};
+
+// Function to check the loaded library and, if asked, repair it, reporting through cout
+// After a repair the checks run again and whatever remains is reported. The caller saves the repaired state.
+// Returns the number of integrity errors left; repaired, if given, receives the number of issues fixed.
+size_t runIntegrityCheck(bool repair, size_t* repaired = nullptr) {
+    IntegrityChecker checker;
+    checker.run();
+    if (!repair || checker.repairable() == 0) {
+        checker.print(cout);
+        return checker.errors();
+    }
+    size_t fixed = checker.repair();
+    if (repaired) *repaired = fixed;
+    checker.print(cout);
+    cout << "\nRepaired " << fixed << " issues; checking again" << endl;
+    IntegrityChecker after;
+    after.run();
+    after.print(cout);
+    return after.errors();
 }
 
-bool isValidUserId(int user_id) {
-    return user_id > 0;
+// Function to run the checker at startup when LIBRARY_FSCK is "check" or "repair"
+// Returns true if a repair changed the library, which the caller then has to save.
+bool checkIntegrityFromEnvironment() {
+    const char* mode = getenv("LIBRARY_FSCK");
+    if (!mode || (strcmp(mode, "check") != 0 && strcmp(mode, "repair") != 0)) return false;
+    size_t repaired = 0;
+    runIntegrityCheck(strcmp(mode, "repair") == 0, &repaired);
+    return repaired > 0;
 }
 
-// Function to save reserved books to a file
-void saveReservedBooks() {
-    ofstream file("reserved_books.txt");
-    for (const auto& pair : library.students) {
-        Student* student = pair.second;
-        for (const auto& reserved : student->account.reserved_books) {
-            int book_id = reserved.first;
-            long long reserved_time = reserved.second;
-            file << student->user_id << "|" << book_id << "|" << reserved_time << endl;
-        }
+// readCatalogQuery(): Prompts for catalog search filters; an empty answer matches everything
+CatalogQuery readCatalogQuery() {
+    CatalogQuery query;
+    string input;
+    cin.ignore();
+    cout << "Published from year (blank for any)" << endl;
+    while (getline(cin, input) && !input.empty() && !parseNumber(input, query.year_min)) {
+        cout << "Invalid year " << input << "; enter a year of up to 9 digits or leave blank" << endl;
     }
-    for (const auto& pair : library.faculties) {
-        Faculty* faculty = pair.second;
-        for (const auto& reserved : faculty->account.reserved_books) {
-            int book_id = reserved.first;
-            long long reserved_time = reserved.second;
-            file << faculty->user_id << "|" << book_id << "|" << reserved_time << endl;
-        }
+    cout << "Published up to year (blank for any)" << endl;
+    while (getline(cin, input) && !input.empty() && !parseNumber(input, query.year_max)) {
+        cout << "Invalid year " << input << "; enter a year of up to 9 digits or leave blank" << endl;
     }
-    file.close();
-}
-
-// Function to load reserved books from a file
-void loadReservedBooks() {
-    ifstream file("reserved_books.txt");
-    if (!file) return;
-
-    string line;
-    while (getline(file, line)) {
-        stringstream ss(line);
-        string temp;
-        int user_id, book_id;
-        long long reserved_time;
-
-        getline(ss, temp, '|'); user_id = stoi(temp);
-        getline(ss, temp, '|'); book_id = stoi(temp);
-        getline(ss, temp, '|'); reserved_time = stoll(temp);
-
-        if (library.students.find(user_id) != library.students.end()) {
-            library.students[user_id]->account.reserved_books[book_id] = reserved_time;
-        }
-        if (library.faculties.find(user_id) != library.faculties.end()) {
-            library.faculties[user_id]->account.reserved_books[book_id] = reserved_time;
-        }
+    cout << "Status (Available/Borrowed, blank for any)" << endl;
+    while (getline(cin, input) && !query.setStatus(input)) {
+        cout << "Unknown value " << input << "; enter Available, Borrowed or leave blank" << endl;
     }
-    file.close();
+    cout << "Publisher (blank for any)" << endl;
+    getline(cin, query.publisher);
+    cout << "Author (blank for any)" << endl;
+    getline(cin, query.author);
+    cout << "Reserved (yes/no, blank for any)" << endl;
+    while (getline(cin, input) && !query.setReserved(input)) {
+        cout << "Unknown value " << input << "; enter yes, no or leave blank" << endl;
+    }
+    return query;
 }
 
 // librarianuser(): Handles librarian login and menu interface
@@ -1290,7 +6375,7 @@ void librarianuser(){
     cout << "Enter Password" << endl;
     string password;
     cin >> password;
-    if(!librarian->check_credentials(user_id,password)){
+    if(!logIn(getLibrarian, user_id, name, password)){
         cout << "Invalid password" << endl;
         return;
     }
@@ -1310,7 +6395,10 @@ void librarianuser(){
         cout<<"[7] View All Students"<<endl;
         cout<<"[8] View All Faculty"<<endl;
         cout<<"[9] View My Details"<<endl;
-        cout<<"[10] Logout"<<endl;
+        cout<<"[10] Circulation Reports"<<endl;
+        cout<<"[11] Operation Metrics"<<endl;
+        cout<<"[12] Check Data Integrity"<<endl;
+        cout<<"[13] Logout"<<endl;
         int choice;
         cin>>choice;
         switch (choice) {
@@ -1352,14 +6440,17 @@ void librarianuser(){
                     cout << "ISBN cannot be empty" << endl;
                     break;
                 }
+                if (!isValidTextField(title) || !isValidTextField(author) || !isValidTextField(publisher) || !isValidTextField(isbn)) {
+                    cout << "Fields cannot contain '|' or line breaks" << endl;
+                    break;
+                }
                 cout<<"Enter year"<<endl;
                 cin>>year;
                 if (!isValidBookInput(book_id, year)) {
                     cout << "Invalid year" << endl;
                     break;
                 }
-                Book book(book_id, title, author, publisher, isbn, year);
-                librarian->add_Book_to_Lib(book);
+                librarian->add_Book_to_Lib(book_id, Work(title, author, publisher, isbn, year));
                 break;
             }
             case 2: {
@@ -1394,9 +6485,13 @@ void librarianuser(){
                     cout << "Name cannot be empty" << endl;
                     break;
                 }
+                if (!isValidTextField(name)) {
+                    cout << "Fields cannot contain '|' or line breaks" << endl;
+                    break;
+                }
                 cout<<"Enter email"<<endl;
                 getline(cin, email);
-                if (!isValidEmail(email)) {
+                if (!isValidEmail(email) || !isValidTextField(email)) {
                     cout << "Invalid email format" << endl;
                     break;
                 }
@@ -1507,6 +6602,9 @@ void librarianuser(){
             case 6: {
                 cout << "[1] Display All Books" << endl;
                 cout << "[2] Display Specific Book" << endl;
+                cout << "[3] Display Available Books" << endl;
+                cout << "[4] Count Books by Availability" << endl;
+                cout << "[5] Search Catalog" << endl;
                 int display_choice;
                 cin >> display_choice;
                 if (display_choice == 1) {
@@ -1523,6 +6621,12 @@ void librarianuser(){
                     book_id = stoi(book_id_str);
                     Book* book = getBook(book_id);
                     Library::displayBook(book);
+                } else if (display_choice == 3) {
+                    library.displayAvailableBooks();
+                } else if (display_choice == 4) {
+                    library.displayAvailabilityCount();
+                } else if (display_choice == 5) {
+                    runCatalogQuery(readCatalogQuery(), false);
                 } else {
                     cout << "Invalid choice" << endl;
                 }
@@ -1541,6 +6645,48 @@ void librarianuser(){
                 break;
             }
             case 10: {
+                cout << "[1] Most Borrowed Titles" << endl;
+                cout << "[2] Loans by Author" << endl;
+                cout << "[3] Loans by Publisher" << endl;
+                cout << "[4] Average Loan Duration" << endl;
+                cout << "[5] Monthly Circulation" << endl;
+                cout << "[6] Outstanding Fines" << endl;
+                cout << "[7] Fine Ledger" << endl;
+                int report_choice;
+                cin >> report_choice;
+                if (report_choice < 1 || report_choice > 7) {
+                    cout << "Invalid choice" << endl;
+                    break;
+                }
+                if (report_choice == 6) {
+                    runFinesReport(10);
+                    break;
+                }
+                if (report_choice == 7) {
+                    runFineLedgerReport();
+                    break;
+                }
+                runCirculationReport(report_choice, 10);
+                break;
+            }
+            case 11: {
+                displayMetrics();
+                break;
+            }
+            case 12: {
+                IntegrityChecker checker;
+                checker.run();
+                checker.print(cout);
+                if (checker.repairable() == 0) break;
+                cout << "Repair the " << checker.repairable() << " repairable issues? (yes/no)" << endl;
+                string answer;
+                cin >> answer;
+                if (answer == "yes") {
+                    cout << "Repaired " << checker.repair() << " issues; they are saved when you log out" << endl;
+                }
+                break;
+            }
+            case 13: {
                 cout<<"Logged out successfully"<<endl;
                 return;
                 break;
@@ -1553,6 +6699,19 @@ void librarianuser(){
     }
 }
 
+// Function to prompt for a line of book ids; false (with a message) if the line is empty or not numeric
+bool readIdList(const string& prompt, vector<int>& ids) {
+    cout << prompt << endl;
+    string line;
+    cin >> ws;
+    getline(cin, line);
+    if (!parseIdList(line, ids) || ids.empty()) {
+        cout << "Invalid book IDs (must be numeric)" << endl;
+        return false;
+    }
+    return true;
+}
+
 // studentuser(): Handles student login and menu interface
 void studentuser(){
     string name;
@@ -1579,7 +6738,7 @@ void studentuser(){
     cout << "Enter Password" << endl;
     string password;
     cin >> password;
-    if(!student->check_credentials(user_id,password)){
+    if(!logIn(getStudent, user_id, name, password)){
         cout << "Invalid password" << endl;
         return;
     }
@@ -1601,7 +6760,9 @@ void studentuser(){
         cout<<"[9] View My Details"<<endl;
         cout<<"[10] View Book Details"<<endl;
         cout<<"[11] Cancel Reservation"<<endl;
-        cout<<"[12] Logout"<<endl;
+        cout<<"[12] Borrow Several Books"<<endl;
+        cout<<"[13] Return Several Books"<<endl;
+        cout<<"[14] Logout"<<endl;
         int choice;
         cin>>choice;
         switch (choice) {
@@ -1684,6 +6845,16 @@ void studentuser(){
                 break;
             }
             case 12: {
+                vector<int> book_ids;
+                if (readIdList("Enter book ids separated by spaces", book_ids)) student->checkoutBooks(book_ids);
+                break;
+            }
+            case 13: {
+                vector<int> book_ids;
+                if (readIdList("Enter book ids separated by spaces", book_ids)) student->returnBooks(book_ids);
+                break;
+            }
+            case 14: {
                 cout<<"Logged out successfully"<<endl;
                 return;
                 break;
@@ -1722,7 +6893,7 @@ void facultyuser(){
     cout << "Enter Password" << endl;
     string password;
     cin >> password;
-    if (!faculty->check_credentials(user_id, password)) {
+    if (!logIn(getFaculty, user_id, name, password)) {
         cout << "Invalid password" << endl;
         return;
     }
@@ -1743,7 +6914,9 @@ void facultyuser(){
         cout<<"[7] View My Details"<<endl;
         cout<<"[8] View Book Details"<<endl;
         cout<<"[9] Cancel Reservation"<<endl;
-        cout<<"[10] Logout"<<endl;
+        cout<<"[10] Borrow Several Books"<<endl;
+        cout<<"[11] Return Several Books"<<endl;
+        cout<<"[12] Logout"<<endl;
         int choice;
         cin>>choice;
         switch (choice) {
@@ -1818,6 +6991,16 @@ void facultyuser(){
                 break;
             }
             case 10: {
+                vector<int> book_ids;
+                if (readIdList("Enter book ids separated by spaces", book_ids)) faculty->checkoutBooks(book_ids);
+                break;
+            }
+            case 11: {
+                vector<int> book_ids;
+                if (readIdList("Enter book ids separated by spaces", book_ids)) faculty->returnBooks(book_ids);
+                break;
+            }
+            case 12: {
                 cout<<"Logged out successfully"<<endl;
                 return;
                 break;
@@ -1831,28 +7014,16 @@ void facultyuser(){
     
 }
 
-// Main program flow:
-// 1. Initialize library
-// 2. Load existing data or create demo data
-// 3. Display main menu
-// 4. Handle user interactions
-// 5. Save all data before exit
-int main(){ 
-    // Display welcome message in a decorative box
-    cout << "\n+-------------------------------------------+" << endl;
-    cout << "|                                           |" << endl;
-    cout << "|       Library Management System           |" << endl;
-    cout << "|                                           |" << endl;
-    cout << "+-------------------------------------------+" << endl << endl;
-
+// loadLibraryData(): Loads every data file, falling back to demo data for missing users and books
+void loadLibraryData() {
+    ScopedMetric metric(MetricOp::Load);
+    storage->recover();
     // Clear the library data
     library.clear();
 
-    // Load Students if file exists and is not empty; otherwise, use demo data.
-    ifstream studentsFile("students.txt");
-    if (studentsFile && studentsFile.peek() != ifstream::traits_type::eof()){
-        loadStudents();
-    } else {
+    // Load Students from storage; if the table is missing or empty, use demo data.
+    loadStudents();
+    if (library.students.empty()) {
         vector<Student*> studentlist;
         studentlist.push_back(new Student(2, "Gautam Arora", "gautam@example.com", "1234567891", 220405));
         studentlist.push_back(new Student(3, "Rahul Yadav", "rahul@example.com", "1234567892", 230756));
@@ -1863,13 +7034,10 @@ int main(){
             addstudent(student);
         }
     }
-    studentsFile.close();
 
-    // Load Faculties if file exists and is not empty; otherwise, use demo data.
-    ifstream facultiesFile("faculties.txt");
-    if (facultiesFile && facultiesFile.peek() != ifstream::traits_type::eof()){
-        loadFaculties();
-    } else {
+    // Load Faculties from storage; if the table is missing or empty, use demo data.
+    loadFaculties();
+    if (library.faculties.empty()) {
         vector<Faculty*> Facultylist;
         Facultylist.push_back(new Faculty(7, "Prof. Anil Kumar", "anil@example.com", "9876543211"));
         Facultylist.push_back(new Faculty(8, "Prof. Meera Iyer", "meera@example.com", "9876543212"));
@@ -1878,62 +7046,790 @@ int main(){
             addFaculty(faculty);
         }
     }
-    facultiesFile.close();
 
-    // Load Books if file exists and is not empty; otherwise, use demo data.
-    ifstream booksFile("books.txt");
-    if (booksFile && booksFile.peek() != ifstream::traits_type::eof()){
-        loadBooks();
-    } else {
-        vector<Book> bookList = {
-            {1, "Introduction to Algorithms", "Thomas H. Cormen", "MIT Press", "9780262046305", 2009},
-            {2, "Cracking the Coding Interview", "Gayle Laakmann McDowell", "CareerCup", "9780984782857", 2015},
-            {3, "Data Structures and Algorithms Made Easy", "Narasimha Karumanchi", "CareerMonk", "9788193245279", 2017},
-            {4, "The 7 Habits of Highly Effective People", "Stephen Covey", "Free Press", "9780743269513", 2004},
-            {5, "Atomic Habits", "James Clear", "Avery", "9780735211292", 2018},
-            {6, "Think and Grow Rich", "Napoleon Hill", "Penguin Books", "9780141189681", 2005},
-            {7, "The Power of Now", "Eckhart Tolle", "New World Library", "9781577314806", 2004},
-            {8, "Man's Search for Meaning", "Viktor E. Frankl", "Beacon Press", "9780807014295", 2006},
-            {9, "Deep Work", "Cal Newport", "Grand Central", "9781455586691", 2016},
-            {10, "Mindset: The New Psychology of Success", "Carol S. Dweck", "Ballantine Books", "9780345472328", 2007}
+    // Load Books from storage; if the table is missing or empty, use demo data.
+    loadBooks();
+    if (library.books.empty()) {
+        vector<pair<int, Work>> bookList = {
+            {1, Work("Introduction to Algorithms", "Thomas H. Cormen", "MIT Press", "9780262046305", 2009)},
+            {2, Work("Cracking the Coding Interview", "Gayle Laakmann McDowell", "CareerCup", "9780984782857", 2015)},
+            {3, Work("Data Structures and Algorithms Made Easy", "Narasimha Karumanchi", "CareerMonk", "9788193245279", 2017)},
+            {4, Work("The 7 Habits of Highly Effective People", "Stephen Covey", "Free Press", "9780743269513", 2004)},
+            {5, Work("Atomic Habits", "James Clear", "Avery", "9780735211292", 2018)},
+            {6, Work("Think and Grow Rich", "Napoleon Hill", "Penguin Books", "9780141189681", 2005)},
+            {7, Work("The Power of Now", "Eckhart Tolle", "New World Library", "9781577314806", 2004)},
+            {8, Work("Man's Search for Meaning", "Viktor E. Frankl", "Beacon Press", "9780807014295", 2006)},
+            {9, Work("Deep Work", "Cal Newport", "Grand Central", "9781455586691", 2016)},
+            {10, Work("Mindset: The New Psychology of Success", "Carol S. Dweck", "Ballantine Books", "9780345472328", 2007)}
         };
         for (const auto& book : bookList) {
-            addBook(book);
+            addBook(book.first, book.second);
         }
     }
-    booksFile.close();
 
     
-    // Load Librarians if file exists and is not empty; otherwise, use demo data.
-    ifstream librariansFile("librarians.txt");
-    if (librariansFile && librariansFile.peek() != ifstream::traits_type::eof()){
-        loadLibrarians();
-    } else {
+    // Load Librarians from storage; if the table is missing or empty, use demo data.
+    loadLibrarians();
+    if (library.librarians.empty()) {
         Librarian* libra = new Librarian(1, "Mr. LibGod", "libgod@example.com", "9999999999");
         addLibrarian(libra);
     }
-    librariansFile.close();
 
-    // Load currently borrowed books if file exists and is not empty
-    ifstream currentlyborrowedFile("currently_borrowed.txt");
-    if (currentlyborrowedFile && currentlyborrowedFile.peek() != ifstream::traits_type::eof()) {
-        loadcurrentlyborrowed();
+    // Load the closure calendar that due dates and fines count open days against
+    loadClosures();
+
+    // Load currently borrowed books
+    loadcurrentlyborrowed();
+
+    // Load the recent borrowing history segments (migrating a legacy borrowing_history.txt once)
+    loadBorrowingHistory();
+
+    // Load reserved books
+    loadReservedBooks();
+
+    // Load the fine balances, the cached totals of the fine ledger
+    loadFineLedger();
+
+    // Readers see the loaded library from here on
+    catalog_versions.rebuild();
+}
+
+// Function to check whether any history or fine ledger rows are still waiting for a successful append
+bool hasUnsavedRows() {
+    return !history_store.unwritten.empty() || !history_store.pending_index.empty() || fine_ledger.pending_rows > 0;
+}
+
+// saveLibraryData(): Saves every table back to its data file, after any background save has finished
+void saveLibraryData() {
+    persistence.wait();
+    persistence.requeueUnwritten();
+    ScopedMetric metric(MetricOp::Save);
+    saveBooks();
+    saveStudents();
+    saveFaculties();
+    saveLibrarians();
+    savecurrentlyborrowed();
+    saveBorrowingHistory();
+    saveReservedBooks();
+    saveFineLedger();
+}
+
+// SemesterSimulator Class: Discrete-event simulation of a semester of circulation through the real library code
+// Patrons visit at exponentially distributed intervals. A visit usually pays any fine, collects reserved copies
+// that have come back, borrows one or two more books (popular titles more often) and, if refused, reserves a
+// wanted copy that is out. Each loan schedules its own return, about one in ten of them late. Events run in
+// time order with a ManualClock installed, so due dates, fines and reservations all see simulated time.
+class SemesterSimulator {
+public:
+    enum class EventKind : unsigned char { Visit, Return };
+
+    struct Event {
+        long long time;
+        EventKind kind;
+        int patron;   // index into patrons
+        int book_id;  // the loan to return
+        bool operator>(const Event& other) const { return time > other.time; }
+    };
+
+    struct Patron {
+        User* user;
+        Student* student;  // exactly one of student and faculty is set
+        Faculty* faculty;
+        int user_id;
+    };
+
+    long long start_time = 0;
+    long long days = 120;
+    size_t target_events = 1000000;
+    uint64_t seed = 1;
+
+    size_t events = 0, visits = 0, borrowed = 0, refused = 0, returned = 0, late_returns = 0, reservations = 0, payments = 0;
+    double seconds = 0;
+    vector<string> problems;
+
+    // Function to run the semester; the caller's clock is restored afterwards
+    void run() {
+        vector<Patron> patrons;
+        for (const auto& pair : library.students) patrons.push_back({pair.second, pair.second, nullptr, pair.first});
+        for (const auto& pair : library.faculties) patrons.push_back({pair.second, nullptr, pair.second, pair.first});
+        sort(patrons.begin(), patrons.end(), [](const Patron& a, const Patron& b) { return a.user_id < b.user_id; });
+        if (patrons.empty() || library.books.empty()) {
+            problems.push_back("nothing to simulate: the library has no patrons or no books");
+            return;
+        }
+
+        ManualClock clock(start_time);
+        Clock* previous = library_clock;
+        library_clock = &clock;
+        mt19937_64 rng(seed);
+        uniform_real_distribution<double> unit(0.0, 1.0);
+        long long end_time = start_time + days * 86400;
+        // Visits are about half of the events; the returns they cause make up most of the rest
+        double mean_gap = double(end_time - start_time) * patrons.size() / max<size_t>(1, target_events / 2);
+        exponential_distribution<double> gap(1.0 / mean_gap);
+        priority_queue<Event, vector<Event>, greater<Event>> queue;
+        for (size_t i = 0; i < patrons.size(); i++) {
+            queue.push({start_time + (long long)gap(rng), EventKind::Visit, int(i), -1});
+        }
+
+        auto wall_start = chrono::steady_clock::now();
+        vector<LoanRecord> loans, reserved;
+        vector<int> wanted;
+        while (!queue.empty() && queue.top().time < end_time) {
+            Event event = queue.top();
+            queue.pop();
+            clock.set(event.time);
+            events++;
+            Patron& patron = patrons[event.patron];
+
+            if (event.kind == EventKind::Return) {
+                Book* book = getBook(event.book_id);
+                if (!book || book->borrower_id != patron.user_id) continue;
+                if (calendar.daysLate(book->borrowed_time, event.time, patron.user->loanDays()) > 0) late_returns++;
+                patron.user->returnBook(event.book_id);
+                returned++;
+                continue;
+            }
+
+            visits++;
+            if (patron.user->accountVersion().prev_fine > 0 && unit(rng) < 0.7) {
+                patron.user->payFine();
+                payments++;
+            }
+            loans.clear();
+            reserved.clear();
+            patron.user->collectLoans(loans, reserved);
+            wanted.clear();
+            for (const LoanRecord& reservation : reserved) {
+                Book* book = getBook(reservation.book_id);
+                if (book && book->status == BookStatus::Available && book->reservation_id == patron.user_id) wanted.push_back(book->book_id);
+            }
+            size_t room = patron.user->loanLimit() > (int)loans.size() ? patron.user->loanLimit() - loans.size() : 0;
+            for (int extra = 1 + rng() % 2; extra > 0 && wanted.size() < room; extra--) {
+                double u = unit(rng);
+                int book_id = library.books[size_t(u * u * library.books.size())].book_id;  // low slots are the popular ones
+                if (find(wanted.begin(), wanted.end(), book_id) == wanted.end()) wanted.push_back(book_id);
+            }
+            if (!wanted.empty()) {
+                vector<int> issued = patron.user->checkoutBooks(wanted);
+                if (issued.empty()) {
+                    refused++;
+                    Book* book = getBook(wanted.back());
+                    if (book && book->status == BookStatus::Borrowed && !book->is_reserved && book->borrower_id != patron.user_id && reserved.size() < 2) {
+                        if (patron.student) studentreserveBook(book->book_id, patron.student);
+                        else facultyreserveBook(book->book_id, patron.faculty);
+                        reservations++;
+                    }
+                }
+                for (int book_id : issued) {
+                    int period = patron.user->loanDays();
+                    long long kept = unit(rng) < 0.1 ? period + 1 + rng() % 20 : 1 + rng() % period;
+                    queue.push({event.time + kept * 86400 + (long long)(rng() % 86400), EventKind::Return, event.patron, book_id});
+                    borrowed++;
+                }
+            }
+            long long next = event.time + 1 + (long long)gap(rng);
+            if (next < end_time) queue.push({next, EventKind::Visit, event.patron, -1});
+        }
+        seconds = chrono::duration<double>(chrono::steady_clock::now() - wall_start).count();
+        checkInvariants("end of semester", true);
+        library_clock = previous;
+    }
+
+    // Function to check the cross-structure invariants of the live library, adding any failure to problems
+    // Loans and reservations must agree between copies and accounts, no account may be over its limit, every
+    // title's free list must hold exactly its free copies, the current catalog version must be consistent
+    // and, when ledger is set, every cached fine balance must equal the net of its ledger rows.
+    void checkInvariants(const string& stage, bool ledger) {
+        size_t before = problems.size();
+        auto fail = [&](const string& text) {
+            if (problems.size() - before < 20) problems.push_back(stage + ": " + text);
+        };
+        size_t account_loans = 0;
+        vector<LoanRecord> loans, reserved;
+        auto checkUser = [&](int user_id, User* user) {
+            loans.clear();
+            reserved.clear();
+            user->collectLoans(loans, reserved);
+            account_loans += loans.size();
+            if ((int)loans.size() > user->loanLimit()) fail("user " + to_string(user_id) + " has " + to_string(loans.size()) + " loans, over the limit");
+            for (const LoanRecord& loan : loans) {
+                Book* book = getBook(loan.book_id);
+                if (!book || book->status != BookStatus::Borrowed || book->borrower_id != user_id) fail("user " + to_string(user_id) + " holds book " + to_string(loan.book_id) + " which is not lent to them");
+            }
+            for (const LoanRecord& reservation : reserved) {
+                Book* book = getBook(reservation.book_id);
+                if (!book || !book->is_reserved || book->reservation_id != user_id) fail("user " + to_string(user_id) + " lists a reservation of book " + to_string(reservation.book_id) + " that the book does not carry");
+            }
+        };
+        for (const auto& pair : library.students) checkUser(pair.first, pair.second);
+        for (const auto& pair : library.faculties) checkUser(pair.first, pair.second);
+
+        size_t lent = 0;
+        vector<size_t> free_count(library.works.size());
+        for (const Book& book : library.books) {
+            if (book.status == BookStatus::Borrowed) lent++;
+            if (book.status == BookStatus::Available && !book.is_reserved) free_count[book.work_id]++;
+            if (book.is_reserved) {
+                auto student = library.students.find(book.reservation_id);
+                auto faculty = library.faculties.find(book.reservation_id);
+                bool listed = (student != library.students.end() && student->second->accountVersion().reservations > 0) ||
+                              (faculty != library.faculties.end() && faculty->second->accountVersion().reservations > 0);
+                if (!listed) fail("book " + to_string(book.book_id) + " is reserved for user " + to_string(book.reservation_id) + " who has no reservations");
+            }
+        }
+        if (lent != account_loans) fail(to_string(lent) + " copies are lent but the accounts hold " + to_string(account_loans) + " loans");
+        for (size_t work_id = 0; work_id < library.works.size(); work_id++) {
+            const Work& work = library.works[work_id];
+            bool valid = work.free_copies.size() == free_count[work_id];
+            for (int book_id : work.free_copies) {
+                Book* book = getBook(book_id);
+                valid = valid && book && book->status == BookStatus::Available && !book->is_reserved;
+            }
+            if (!valid) fail("the free list of \"" + work.title + "\" does not match its free copies");
+        }
+
+        VersionView view;
+        if (view.version) {
+            FinesReport report = computeFines(*view.version, getCurrentTime());
+            if (report.loans != report.account_loans || report.loans != lent) fail("catalog version " + to_string(report.version) + " disagrees with the live loans");
+        }
+        if (ledger) {
+            size_t mismatched = runFineLedgerReport();
+            if (mismatched) fail(to_string(mismatched) + " fine balances disagree with the ledger");
+        }
+    }
+
+    // Function to count the copies out on loan
+    static size_t lentCopies() {
+        size_t lent = 0;
+        for (const Book& book : library.books) lent += book.status == BookStatus::Borrowed;
+        return lent;
+    }
+
+    // Function to print the results of the run
+    void print(ostream& out) const {
+        out << "Simulated " << days << " days from " << formatDay(dayOf(start_time)) << ": " << events << " events in " << fixed << setprecision(2)
+            << seconds << " s (" << setprecision(0) << (seconds > 0 ? events / seconds : 0) << " events/s)" << endl;
+        out << "Visits: " << visits << ", books borrowed: " << borrowed << ", checkouts refused: " << refused << endl;
+        out << "Returns: " << returned << " (" << late_returns << " late), reservations: " << reservations << ", fines paid: " << payments << endl;
+        if (problems.empty()) {
+            out << "All invariants hold" << endl;
+        } else {
+            out << problems.size() << " invariant failures:" << endl;
+            for (const string& problem : problems) out << "  " << problem << endl;
+        }
+    }
+};
+
+// Function to run the semester simulator on the loaded library and report through the real stdout
+// The library's own messages are silenced during the run. Afterwards the state is saved to and reloaded from a
+// memory backend, leaving the data files untouched, and checked again. Returns false if any invariant failed.
+bool runSemesterSimulation(SemesterSimulator& simulator) {
+    cout.setstate(ios::badbit);
+    simulator.run();
+    size_t lent = SemesterSimulator::lentCopies();
+    selectStorage("memory");
+    saveLibraryData();
+    loadLibraryData();
+    size_t reloaded = SemesterSimulator::lentCopies();
+    if (reloaded != lent) simulator.problems.push_back("after reload: " + to_string(reloaded) + " copies lent, " + to_string(lent) + " before saving");
+    simulator.checkInvariants("after reload", false);
+    cout.clear();
+    simulator.print(cout);
+    return simulator.problems.empty();
+}
+
+template <>
+struct RecordFields<CatalogQuery> {
+    static constexpr auto fields = make_tuple(&CatalogQuery::year_min, &CatalogQuery::year_max, &CatalogQuery::status, &CatalogQuery::publisher,
+                                              &CatalogQuery::author, &CatalogQuery::reserved);
+};
+
+template <>
+struct RecordFields<Work> {
+    static constexpr auto fields = make_tuple(&Work::title, &Work::author, &Work::publisher, &Work::isbn, &Work::year);
+};
+
+// Function to encode the fields of a query or a new book for a session record; strings are length-prefixed,
+// so the text may hold any character
+template <typename Record>
+string encodeSessionArguments(const Record& row) {
+    string out;
+    forEachField<Record>([&](auto member) { BinaryCodec::put(out, row.*member); });
+    return out;
+}
+
+string sessionArguments(const Work& details) {
+    return encodeSessionArguments(details);
+}
+
+string sessionArguments(const CatalogQuery& query) {
+    return encodeSessionArguments(query);
+}
+
+// Function to run one recorded operation against the library and fill in what it left behind
+// Returns false if the operation's user no longer exists or its arguments do not decode. Borrow prompts read
+// from cin, which the replayer points at an empty stream, so a borrow never turns into a reservation; the
+// reservation has its own record, logged after the borrow's.
+bool replaySessionRecord(SessionRecord& record) {
+    SessionOp op = static_cast<SessionOp>(record.op);
+    User* user = sessionUser(record.user_id);
+    if (!user && op != SessionOp::Query && op != SessionOp::AddBook && op != SessionOp::RemoveBook) return false;
+    record.before = op == SessionOp::Query ? 0 : sessionState(record);
+    vector<int> ids;
+    switch (op) {
+        case SessionOp::Borrow: user->borrowBook(record.book_id); break;
+        case SessionOp::Return: user->returnBook(record.book_id); break;
+        case SessionOp::Checkout: parseIdList(record.text, ids); user->checkoutBooks(ids); break;
+        case SessionOp::ReturnBatch: parseIdList(record.text, ids); user->returnBooks(ids); break;
+        case SessionOp::Reserve: {
+            Student* student = getStudent(record.user_id);
+            if (student) studentreserveBook(record.book_id, student);
+            else facultyreserveBook(record.book_id, getFaculty(record.user_id));
+            break;
+        }
+        case SessionOp::Cancel: user->cancelReservation(record.book_id); break;
+        case SessionOp::PayFine: user->payFine(); break;
+        case SessionOp::Query: {
+            CatalogQuery query;
+            string_view in(record.text);
+            if (!BinaryCodec::read(in, query) || !in.empty()) return false;
+            record.after = queryCatalog(query).size();
+            break;
+        }
+        case SessionOp::AddBook: {
+            Work details("", "", "", "", 0);
+            string_view in(record.text);
+            if (!BinaryCodec::read(in, details) || !in.empty()) return false;
+            addBook(record.book_id, details);
+            break;
+        }
+        case SessionOp::RemoveBook: removeBook(record.book_id); break;
+        default: return false;
+    }
+    settleSessionRecord(record);
+    return true;
+}
+
+// SessionReplayer Class: Feeds a recorded session back into the library and compares the outcomes
+// With one thread every operation runs through the same functions the menus call, on a manual clock set to the
+// recorded time, and the account summaries before and after must match the log. With more threads the
+// circulation operations (borrow, return, reserve; batches copy by copy) go through the sharded engine, one
+// client per thread with the users partitioned between them, and only whether each operation went through is
+// compared. Borrows ask for the copies the recording lent, since the engine never substitutes one; operations of
+// different users may interleave differently than they did. Everything else is skipped in that mode.
+class SessionReplayer {
+public:
+    static constexpr size_t OPS = static_cast<size_t>(SessionOp::Count);
+    static constexpr size_t MAX_LISTED = 10;
+
+    vector<SessionRecord> records;
+    bool original_pace = false;  // wait out the recorded gaps instead of running flat out
+    size_t threads = 1;
+
+    array<MetricSnapshot, OPS> latency;
+    array<size_t, OPS> replayed{}, diverged{}, skipped{};
+    vector<string> divergences;  // the first MAX_LISTED, described
+    double seconds = 0;
+
+    // Function to read a session log; false if the file is missing or was not written by the recorder
+    bool load(const string& path) {
+        ifstream file(path, ios::binary);
+        if (!file) return false;
+        string data((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+        if (!data.empty() && !isBinaryTable(data)) return false;
+        records.clear();
+        forEachRow<SessionRecord>(data, [this](const SessionRecord& record) {
+            if (record.op >= 0 && record.op < (int)OPS) records.push_back(record);
+        });
+        return true;
+    }
+
+    void run() {
+        auto start = chrono::steady_clock::now();
+        if (threads <= 1) runSerial();
+        else runSharded();
+        seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    }
+
+    size_t totalReplayed() const { return accumulate(replayed.begin(), replayed.end(), size_t(0)); }
+    size_t totalDiverged() const { return accumulate(diverged.begin(), diverged.end(), size_t(0)); }
+    size_t totalSkipped() const { return accumulate(skipped.begin(), skipped.end(), size_t(0)); }
+
+    void print(ostream& out) const {
+        ios::fmtflags flags = out.flags();
+        streamsize precision = out.precision();
+        out << "Replayed " << totalReplayed() << " of " << records.size() << " operations (" << totalSkipped() << " skipped) in " << fixed
+            << setprecision(2) << seconds << " s (" << setprecision(0) << (seconds > 0 ? totalReplayed() / seconds : 0) << " ops/s), "
+            << threads << (threads == 1 ? " thread, " : " threads, ") << (original_pace ? "original" : "maximum") << " pace" << endl;
+        out << left << setw(12) << "Op" << right << setw(9) << "Count" << setw(10) << "Diverged" << setw(10) << "p50" << setw(10) << "p90"
+            << setw(10) << "p99" << setw(12) << "Max (us)" << endl;
+        out << setprecision(1);
+        for (size_t op = 0; op < OPS; op++) {
+            const MetricSnapshot& s = latency[op];
+            if (s.count == 0) continue;
+            out << left << setw(12) << sessionOpName(static_cast<SessionOp>(op)) << right << setw(9) << s.count << setw(10) << diverged[op]
+                << setw(10) << s.quantile(0.5) / 1e3 << setw(10) << s.quantile(0.9) / 1e3 << setw(10) << s.quantile(0.99) / 1e3
+                << setw(12) << s.max_ns / 1e3 << endl;
+        }
+        if (totalDiverged() == 0) {
+            out << "No divergence from the recorded outcomes" << endl;
+        } else {
+            out << totalDiverged() << " operations diverged from the recorded outcomes; the first ones:" << endl;
+            for (const string& divergence : divergences) out << "  " << divergence << endl;
+        }
+        out.flags(flags);
+        out.precision(precision);
+    }
+
+private:
+    // Function to wait until a record's offset from the first one has passed since start
+    void pace(chrono::steady_clock::time_point start, const SessionRecord& record) const {
+        if (original_pace) this_thread::sleep_until(start + chrono::microseconds(record.offset_us - records.front().offset_us));
+    }
+
+    static string describe(size_t index, const SessionRecord& recorded, const string& replayed) {
+        return "#" + to_string(index) + " " + sessionOpName(static_cast<SessionOp>(recorded.op)) + " user " + to_string(recorded.user_id) +
+               " book " + to_string(recorded.book_id) + ": recorded " + to_string(recorded.before) + " -> " + to_string(recorded.after) +
+               " fine " + to_string(recorded.fine) + ", replayed " + replayed;
+    }
+
+    void runSerial() {
+        ManualClock clock(records.empty() ? 0 : records.front().time);
+        Clock* previous_clock = library_clock;
+        library_clock = &clock;
+        istringstream no_answers;
+        streambuf* previous_input = cin.rdbuf(no_answers.rdbuf());
+        vector<LatencyHistogram> histograms(OPS);
+        auto start = chrono::steady_clock::now();
+        for (size_t i = 0; i < records.size(); i++) {
+            const SessionRecord& recorded = records[i];
+            pace(start, recorded);
+            clock.set(recorded.time);
+            SessionRecord result = recorded;
+            auto op_start = chrono::steady_clock::now();
+            bool ran = replaySessionRecord(result);
+            auto ns = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - op_start).count();
+            if (!ran) {
+                skipped[recorded.op]++;
+                continue;
+            }
+            histograms[recorded.op].record(ns);
+            replayed[recorded.op]++;
+            if (result.before != recorded.before || result.after != recorded.after || result.fine != recorded.fine) {
+                if (diverged[recorded.op]++, divergences.size() < MAX_LISTED) {
+                    divergences.push_back(describe(i, recorded, to_string(result.before) + " -> " + to_string(result.after) + " fine " + to_string(result.fine)));
+                }
+            }
+        }
+        cin.rdbuf(previous_input);
+        cin.clear();
+        library_clock = previous_clock;
+        for (size_t op = 0; op < OPS; op++) latency[op].add(histograms[op]);
+    }
+
+    void runSharded() {
+        ManualClock clock(records.empty() ? 0 : records.front().time);
+        Clock* previous_clock = library_clock;
+        library_clock = &clock;
+        threads = min(threads, ShardedEngine::MAX_CLIENTS);
+        vector<vector<size_t>> parts(threads);
+        for (size_t i = 0; i < records.size(); i++) {
+            SessionOp op = static_cast<SessionOp>(records[i].op);
+            if (op == SessionOp::Borrow || op == SessionOp::Return || op == SessionOp::Reserve || op == SessionOp::Checkout || op == SessionOp::ReturnBatch) {
+                parts[(unsigned)records[i].user_id % threads].push_back(i);
+            } else {
+                skipped[records[i].op]++;
+            }
+        }
+
+        struct Worker {
+            vector<LatencyHistogram> histograms = vector<LatencyHistogram>(OPS);
+            array<size_t, OPS> replayed{}, diverged{};
+            vector<string> divergences;
+        };
+        vector<unique_ptr<Worker>> workers;
+        for (size_t t = 0; t < threads; t++) workers.emplace_back(new Worker);
+        ShardedEngine engine;
+        engine.start(threads, threads);
+        auto start = chrono::steady_clock::now();
+        vector<thread> pool;
+        for (size_t t = 0; t < threads; t++) {
+            pool.emplace_back([this, t, start, &engine, &clock, &parts, &workers] {
+                Worker& worker = *workers[t];
+                EngineClient client(engine, t);
+                vector<int> ids;
+                for (size_t i : parts[t]) {
+                    const SessionRecord& recorded = records[i];
+                    pace(start, recorded);
+                    // The clock only moves forward, so it follows the latest recorded time any thread has reached
+                    long long now = clock.current.load(memory_order_relaxed);
+                    while (now < recorded.time && !clock.current.compare_exchange_weak(now, recorded.time, memory_order_relaxed)) {}
+                    auto op_start = chrono::steady_clock::now();
+                    bool ok = true;
+                    switch (static_cast<SessionOp>(recorded.op)) {
+                        case SessionOp::Return: ok = client.call(EngineOp::Return, recorded.user_id, recorded.book_id) == EngineStatus::Ok; break;
+                        case SessionOp::Reserve: ok = client.call(EngineOp::Reserve, recorded.user_id, recorded.book_id) == EngineStatus::Ok; break;
+                        default: {
+                            // Borrows ask for the copies that were actually lent, since the engine has no substitution
+                            EngineOp engine_op = recorded.op == static_cast<int>(SessionOp::ReturnBatch) ? EngineOp::Return : EngineOp::Borrow;
+                            ids.clear();
+                            if (engine_op == EngineOp::Return || !parseIdList(recorded.lent, ids) || ids.empty()) {
+                                ids.clear();
+                                if (recorded.op == static_cast<int>(SessionOp::Borrow)) ids.push_back(recorded.book_id);
+                                else parseIdList(recorded.text, ids);
+                            }
+                            for (int book_id : ids) ok = client.call(engine_op, recorded.user_id, book_id) == EngineStatus::Ok && ok;
+                        }
+                    }
+                    worker.histograms[recorded.op].record(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - op_start).count());
+                    worker.replayed[recorded.op]++;
+                    if (ok != (recorded.before != recorded.after)) {
+                        if (worker.diverged[recorded.op]++, worker.divergences.size() < MAX_LISTED) {
+                            worker.divergences.push_back(describe(i, recorded, ok ? "went through" : "was refused"));
+                        }
+                    }
+                }
+            });
+        }
+        for (thread& worker : pool) worker.join();
+        engine.stop();
+        library_clock = previous_clock;
+        for (const auto& worker : workers) {
+            for (size_t op = 0; op < OPS; op++) {
+                latency[op].add(worker->histograms[op]);
+                replayed[op] += worker->replayed[op];
+                diverged[op] += worker->diverged[op];
+            }
+            for (const string& divergence : worker->divergences) {
+                if (divergences.size() < MAX_LISTED) divergences.push_back(divergence);
+            }
+        }
+    }
+};
+
+// Function to replay a session log against the loaded library and report through the real stdout
+// Recording is paused and the library's own messages are silenced during the run. Nothing is saved, so the data
+// files stay as they were. Returns false if any operation diverged from the log.
+bool runSessionReplay(SessionReplayer& replayer) {
+    bool recording = session_recorder.enabled.exchange(false);
+    cout.setstate(ios::badbit);
+    replayer.run();
+    cout.clear();
+    session_recorder.enabled.store(recording);
+    replayer.print(cout);
+    return replayer.totalDiverged() == 0;
+}
+
+// Function to read "--option value" pairs of a batch command into a map
+map<string, string> parseOptions(int argc, char* argv[], int first) {
+    map<string, string> options;
+    for (int i = first; i + 1 < argc; i += 2) {
+        options[argv[i]] = argv[i + 1];
+    }
+    return options;
+}
+
+// Function to read a non-negative whole-number option into value, leaving value alone when the option
+// is absent; a malformed, negative or out-of-range value is reported and returns false
+template <typename T>
+bool numberOption(const map<string, string>& options, const string& name, T& value) {
+    auto it = options.find(name);
+    if (it == options.end()) return true;
+    T parsed;
+    if (TextCodec::get(it->second, parsed) && parsed >= 0) {
+        value = parsed;
+        return true;
     }
-    currentlyborrowedFile.close();
+    cout << "Invalid value " << it->second << " for " << name << "; expected a non-negative whole number" << endl;
+    return false;
+}
 
-    // Load borrowing history if file exists and is not empty
-    ifstream historyFile("borrowing_history.txt");
-    if (historyFile && historyFile.peek() != ifstream::traits_type::eof()) {
-        loadBorrowingHistory();
+// runBatchCommand(): Runs one non-interactive command given on the command line
+// Usage: library_system query [--year-min N] [--year-max N] [--status S] [--publisher P] [--author A] [--reserved yes|no]
+//        library_system history-export [--from borrowing_history.txt] [--to history_archive.bin]
+//        library_system history-import [--from history_archive.bin] --to borrowing_history.txt
+//        library_system history-scan [--from history_archive.bin] [--since T] [--until T]
+//        library_system report [--top N]
+//        library_system fines [--top N]
+//        library_system ledger
+//        library_system simulate [--days N] [--events N] [--seed N] [--start EPOCH]
+//        library_system replay FILE [--pace original|max] [--threads N]
+//        library_system fsck [--repair]
+//        library_system import-books FILE [--errors import_errors.txt]
+//        library_system enrol FILE [--errors enrol_errors.txt]
+int runBatchCommand(int argc, char* argv[]) {
+    string command = argv[1];
+    if (command == "enrol" && argc > 2) {
+        map<string, string> options = parseOptions(argc, argv, 3);
+        if (!enrolUsers(argv[2], options.count("--errors") ? options["--errors"] : "enrol_errors.txt")) return 1;
+        saveLibraryData();
+        return 0;
+    }
+    if (command == "import-books" && argc > 2) {
+        map<string, string> options = parseOptions(argc, argv, 3);
+        if (!importBooks(argv[2], options.count("--errors") ? options["--errors"] : "import_errors.txt")) return 1;
+        saveLibraryData();
+        return 0;
+    }
+    if (command == "report") {
+        map<string, string> options = parseOptions(argc, argv, 2);
+        size_t top = 10;
+        if (!numberOption(options, "--top", top)) return 1;
+        runCirculationReport(0, top);
+        return 0;
+    }
+    if (command == "fines") {
+        map<string, string> options = parseOptions(argc, argv, 2);
+        size_t top = 10;
+        if (!numberOption(options, "--top", top)) return 1;
+        runFinesReport(top);
+        return 0;
+    }
+    if (command == "ledger") {
+        runFineLedgerReport();
+        return 0;
+    }
+    if (command == "simulate") {
+        map<string, string> options = parseOptions(argc, argv, 2);
+        SemesterSimulator simulator;
+        simulator.start_time = getCurrentTime();
+        if (!numberOption(options, "--start", simulator.start_time) || !numberOption(options, "--days", simulator.days) ||
+            !numberOption(options, "--events", simulator.target_events) || !numberOption(options, "--seed", simulator.seed)) {
+            return 1;
+        }
+        // Keep start + days * 86400 inside the range the clock and formatDay() handle
+        if (simulator.days < 1 || simulator.days > 36500) {
+            cout << "--days must be between 1 and 36500" << endl;
+            return 1;
+        }
+        if (simulator.start_time > 253402300799LL) {
+            cout << "--start must be an epoch time before the year 10000" << endl;
+            return 1;
+        }
+        return runSemesterSimulation(simulator) ? 0 : 1;
+    }
+    if (command == "fsck") {
+        bool repair = argc > 2 && string(argv[2]) == "--repair";
+        size_t errors = runIntegrityCheck(repair);
+        if (repair) saveLibraryData();
+        return errors == 0 ? 0 : 1;
+    }
+    if (command == "replay" && argc > 2) {
+        map<string, string> options = parseOptions(argc, argv, 3);
+        SessionReplayer replayer;
+        if (!replayer.load(argv[2])) {
+            cout << argv[2] << " is not a session log" << endl;
+            return 1;
+        }
+        replayer.original_pace = options.count("--pace") && options["--pace"] == "original";
+        if (!numberOption(options, "--threads", replayer.threads)) return 1;
+        replayer.threads = max<size_t>(1, replayer.threads);
+        return runSessionReplay(replayer) ? 0 : 1;
+    }
+    if (command == "history-export" || command == "history-import" || command == "history-scan") {
+        map<string, string> options = parseOptions(argc, argv, 2);
+        if (command == "history-export") {
+            return exportHistoryArchive(options["--from"], options.count("--to") ? options["--to"] : "history_archive.bin") ? 0 : 1;
+        }
+        string archive = options.count("--from") ? options["--from"] : "history_archive.bin";
+        if (command == "history-import") {
+            if (!options.count("--to")) {
+                cout << "history-import needs --to <text file>" << endl;
+                return 1;
+            }
+            return importHistoryArchive(archive, options["--to"]) ? 0 : 1;
+        }
+        long long since = LLONG_MIN, until = LLONG_MAX;
+        if (!numberOption(options, "--since", since) || !numberOption(options, "--until", until)) return 1;
+        size_t rows = 0, blocks_read = 0, blocks_skipped = 0;
+        auto start = chrono::steady_clock::now();
+        if (!HistoryArchive::scan(archive, since, until, [&rows](const HistoryRow&) { rows++; }, &blocks_read, &blocks_skipped)) {
+            cout << archive << " is not a valid history archive" << endl;
+            return 1;
+        }
+        auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+        cout << rows << " rows in range, " << blocks_read << " blocks read, " << blocks_skipped << " skipped, " << elapsed << " ms" << endl;
+        return 0;
+    }
+    if (command == "query") {
+        CatalogQuery query;
+        for (int i = 2; i + 1 < argc; i += 2) {
+            string option = argv[i], value = argv[i + 1];
+            if (option == "--year-min" || option == "--year-max") {
+                if (!parseNumber(value, option == "--year-min" ? query.year_min : query.year_max)) {
+                    cout << "Invalid year " << value << " for " << option << endl;
+                    return 1;
+                }
+            }
+            else if (option == "--status" || option == "--reserved") {
+                if (!(option == "--status" ? query.setStatus(value) : query.setReserved(value))) {
+                    cout << "Unknown value " << value << " for " << option << endl;
+                    return 1;
+                }
+            }
+            else if (option == "--publisher") query.publisher = value;
+            else if (option == "--author") query.author = value;
+            else {
+                cout << "Unknown option " << option << endl;
+                return 1;
+            }
+        }
+        runCatalogQuery(query, true);
+        return 0;
     }
-    historyFile.close();
+    cout << "Unknown command " << command << endl;
+    return 1;
+}
 
-    // Load reserved books if file exists and is not empty
-    ifstream reservedBooksFile("reserved_books.txt");
-    if (reservedBooksFile && reservedBooksFile.peek() != ifstream::traits_type::eof()) {
-        loadReservedBooks();
+// bench.cpp includes this file with LIBRARY_NO_MAIN defined to benchmark the engine without the menus
+#ifndef LIBRARY_NO_MAIN
+// Main program flow:
+// 1. Initialize library
+// 2. Load existing data or create demo data
+// 3. Display main menu
+// 4. Handle user interactions
+// 5. Save all data before exit and write metrics.prom
+// With command line arguments the data is loaded and a single batch command is run instead of the menus.
+// Usage: library_system [--storage=text|memory|journal] [command ...]
+int main(int argc, char* argv[]){ 
+    // A leading --storage=text|memory|journal picks where the tables are kept
+    if (argc > 1 && string(argv[1]).rfind("--storage=", 0) == 0) {
+        if (!selectStorage(argv[1] + 10)) {
+            cout << "Unknown storage backend " << argv[1] + 10 << " (use text, memory or journal)" << endl;
+            return 1;
+        }
+        argv[1] = argv[0];
+        argv++;
+        argc--;
     }
-    reservedBooksFile.close();
+    startTraceFromEnvironment();
+    if (argc > 1) {
+        loadLibraryData();
+        // Most batch commands (report, query, replay, ...) never save, so a startup repair is saved
+        // before the command runs rather than lost when it exits
+        if (checkIntegrityFromEnvironment()) saveLibraryData();
+        startRecordingFromEnvironment();
+        int status = runBatchCommand(argc, argv);
+        saveMetrics("metrics.prom");
+        tracer.stop();
+        session_recorder.stop();
+        return status;
+    }
+
+    // Display welcome message in a decorative box
+    cout << "\n+-------------------------------------------+" << endl;
+    cout << "|                                           |" << endl;
+    cout << "|       Library Management System           |" << endl;
+    cout << "|                                           |" << endl;
+    cout << "+-------------------------------------------+" << endl << endl;
+
+    // Load the library data from files; a session log starts after the load so it holds only what users do
+    loadLibraryData();
+    // A startup repair is saved with everything else on exit
+    checkIntegrityFromEnvironment();
+    startRecordingFromEnvironment();
 
     // Main menu
     cout << "Welcome to the Library Management System" << endl;
@@ -1968,16 +7864,26 @@ int main(){
                 break;
             }
         }
+        // Changes made in a session are saved in the background while the menu stays responsive
+        if (running && choice >= 1 && choice <= 3) {
+            persistence.submit(takeSnapshot());
+        }
     }
 
-    // Save data to files
-    saveBooks();
-    saveStudents();
-    saveFaculties();
-    saveLibrarians();
-    savecurrentlyborrowed();
-    saveBorrowingHistory();
-    saveReservedBooks();
-    return 0;
+    // Save data to files (waiting for the final write), then the metrics of this session
+    // Rows the final background write left behind get one synchronous retry before the program exits
+    int status = 0;
+    persistence.submit(takeSnapshot());
+    if (!persistence.stop()) {
+        saveLibraryData();
+        if (hasUnsavedRows()) {
+            cout << "History or fine ledger rows could not be saved and will be lost on exit; check that the data directory is writable" << endl;
+            status = 1;
+        }
+    }
+    saveMetrics("metrics.prom");
+    tracer.stop();
+    session_recorder.stop();
+    return status;
 }
-
+#endif